@@ -0,0 +1,378 @@
+#include "batch.h"
+#include "jit.h"
+#include "supervisor.h"
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <cstdio>
+#include <exception>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <stdexcept>
+#include <thread>
+
+static std::string jsonString(const std::string& text)
+{
+    std::string out = "\"";
+    for (char ch : text)
+    {
+        unsigned char c = static_cast<unsigned char>(ch);
+        if (c == '"' || c == '\\')
+        {
+            out += '\\';
+            out += ch;
+        }
+        else if (c < 0x20 || c >= 0x7F)
+        {
+            char buf[8];
+            std::snprintf(buf, sizeof(buf), "\\u%04X", c);
+            out += buf;
+        }
+        else
+        {
+            out += ch;
+        }
+    }
+    return out + "\"";
+}
+
+bool BatchRunner::isHexByte(const std::string& text)
+{
+    return text.size() == 2 && std::isxdigit(static_cast<unsigned char>(text[0]))
+        && std::isxdigit(static_cast<unsigned char>(text[1]));
+}
+
+static std::string upper(std::string text)
+{
+    for (char& c : text)
+    {
+        c = std::toupper(static_cast<unsigned char>(c));
+    }
+    return text;
+}
+
+static void collectPath(const std::string& path, const std::string& startMem, std::vector<BatchJob>& jobs)
+{
+    if (std::filesystem::is_directory(path))
+    {
+        std::vector<std::string> files;
+        for (const auto& entry : std::filesystem::directory_iterator(path))
+        {
+            if (entry.is_regular_file())
+            {
+                files.push_back(entry.path().string());
+            }
+        }
+        std::sort(files.begin(), files.end());
+        for (const std::string& file : files)
+        {
+            collectPath(file, startMem, jobs);
+        }
+    }
+    else if (ImageArchive::isImageFile(path))
+    {
+        try
+        {
+            auto archive = std::make_shared<const ImageArchive>(path);
+            for (std::size_t i = 0; i < archive->count(); ++i)
+            {
+                const ProgramImage& image = (*archive)[i];
+                jobs.push_back({image.name, ALU::DecToHex(image.startAddress), archive, i, ""});
+            }
+        }
+        catch (const std::exception& e)
+        {
+            jobs.push_back({path, startMem, nullptr, 0, e.what()});
+        }
+    }
+    else
+    {
+        jobs.push_back({path, startMem, nullptr, 0, ""});
+    }
+}
+
+void BatchRunner::addPath(const std::string& path, const std::string& startMem)
+{
+    collectPath(path, startMem, jobs);
+}
+
+void BatchRunner::collect(const std::string& argument, const std::string& startMem, std::vector<BatchJob>& jobs)
+{
+    std::size_t at = argument.rfind('@');
+    if (at != std::string::npos && isHexByte(argument.substr(at + 1)))
+    {
+        collectPath(argument.substr(0, at), upper(argument.substr(at + 1)), jobs);
+    }
+    else
+    {
+        collectPath(argument, startMem, jobs);
+    }
+}
+
+void BatchRunner::load(const BatchJob& job, Machine& machine)
+{
+    if (!job.error.empty())
+    {
+        throw std::runtime_error(job.error);
+    }
+    if (job.archive)
+    {
+        job.archive->load(job.index, machine);
+    }
+    else
+    {
+        machine.loadProgram(job.fileName, job.startMem);
+    }
+}
+
+/**
+ * @brief The cache key of running `job`: the engine, budget and start address, then the bytes of
+ *        the program file or of its archive image
+ * @return False if the program cannot be read
+ */
+static bool cacheKey(const BatchJob& job, long long maxSteps, bool useJit, std::vector<std::uint8_t>& key)
+{
+    if (!job.error.empty())
+    {
+        return false;
+    }
+    key = {'V', 'O', 'L', 'B', static_cast<std::uint8_t>(useJit)};
+    for (int shift = 0; shift < 64; shift += 8)
+    {
+        key.push_back(static_cast<std::uint8_t>(static_cast<std::uint64_t>(maxSteps) >> shift));
+    }
+    key.insert(key.end(), job.startMem.begin(), job.startMem.end());
+    if (job.archive)
+    {
+        const ProgramImage& image = (*job.archive)[job.index];
+        key.push_back(static_cast<std::uint8_t>(image.loadAddress));
+        key.push_back(static_cast<std::uint8_t>(image.startAddress));
+        key.insert(key.end(), image.bytes, image.bytes + image.length);
+        return true;
+    }
+    std::ifstream fin(job.fileName, std::ios::binary);
+    if (!fin)
+    {
+        return false;
+    }
+    key.insert(key.end(), std::istreambuf_iterator<char>(fin), std::istreambuf_iterator<char>());
+    return !fin.bad();
+}
+
+std::string BatchRunner::runJob(const BatchJob& job) const
+{
+    std::string line = "{\"file\":" + jsonString(job.fileName) + ",\"start\":\"" + job.startMem + "\"";
+    std::vector<std::uint8_t> key;
+    if (cache && cacheKey(job, maxSteps, useJit, key))
+    {
+        std::vector<std::uint8_t> value;
+        if (cache->get(key, value))
+        {
+            return line.append(value.begin(), value.end());
+        }
+    }
+    else
+    {
+        key.clear();
+    }
+
+    Machine machine;
+    std::string status = "budget";
+    std::string error;
+    long long steps = 0;
+    try
+    {
+        load(job, machine);
+        if (useJit)
+        {
+            JIT jit(machine);
+            jit.run(maxSteps, steps);
+            if (machine.cpu.isHalt)
+            {
+                status = "halted";
+            }
+        }
+        if (!useJit)
+        {
+            Supervisor::Result result = Supervisor(maxSteps, timeout).run(machine);
+            status = Supervisor::reasonName(result.reason);
+            steps = result.steps;
+            error = result.error;
+        }
+    }
+    catch (const std::exception& e)
+    {
+        status = "error";
+        error = e.what();
+    }
+
+    std::size_t prefix = line.size();
+    line += ",\"status\":\"" + status + "\"";
+    if (!error.empty())
+    {
+        line += ",\"error\":" + jsonString(error);
+    }
+    line += ",\"steps\":" + std::to_string(steps);
+    line += ",\"pc\":\"" + ALU::DecToHex(machine.cpu.getPC()) + "\"";
+    line += ",\"registers\":[";
+    for (int i = 0; i < 16; ++i)
+    {
+        line += (i ? ",\"" : "\"") + ALU::DecToHex(machine.cpu.reg.getValue(i)) + "\"";
+    }
+    line += "],\"memory\":\"";
+    for (int i = 0; i < 256; ++i)
+    {
+        line += ALU::DecToHex(machine.memory.getCell(i));
+    }
+    line += "\",\"screen_bytes\":" + std::to_string(machine.memory.screen.total());
+    line += ",\"screen_ascii\":" + jsonString(machine.memory.screen.ascii());
+    line += ",\"screen_hex\":" + jsonString(machine.memory.screen.hex()) + "}";
+    if (!key.empty() && status != "timeout")
+    {
+        cache->put(key, std::vector<std::uint8_t>(line.begin() + prefix, line.end()));
+    }
+    return line;
+}
+
+void BatchRunner::run(std::ostream& out)
+{
+    std::vector<std::string> results(jobs.size());
+    std::atomic<std::size_t> next{0};
+    auto worker = [&]()
+    {
+        for (std::size_t i = next++; i < jobs.size(); i = next++)
+        {
+            results[i] = runJob(jobs[i]);
+        }
+    };
+
+    int count = std::max(1, std::min<int>(threads, static_cast<int>(jobs.size())));
+    std::vector<std::thread> pool;
+    for (int i = 1; i < count; ++i)
+    {
+        pool.emplace_back(worker);
+    }
+    worker();
+    for (std::thread& t : pool)
+    {
+        t.join();
+    }
+
+    for (const std::string& line : results)
+    {
+        out << line << '\n';
+    }
+}
+
+int BatchRunner::main(const std::vector<std::string>& args)
+{
+    int threads = static_cast<int>(std::thread::hardware_concurrency());
+    long long maxSteps = 1000000;
+    double timeout = 0;
+    std::string startMem = "10";
+    std::string outFile;
+    bool useJit = false;
+    std::size_t cacheMegabytes = 0;
+    std::string cacheDirectory;
+    std::vector<std::string> paths;
+
+    try
+    {
+        for (std::size_t i = 0; i < args.size(); ++i)
+        {
+            const std::string& arg = args[i];
+            bool hasValue = i + 1 < args.size();
+            if ((arg == "-j" || arg == "--threads") && hasValue)
+            {
+                threads = std::stoi(args[++i]);
+            }
+            else if (arg == "--steps" && hasValue)
+            {
+                maxSteps = std::stoll(args[++i]);
+            }
+            else if (arg == "--timeout" && hasValue)
+            {
+                timeout = std::stod(args[++i]);
+            }
+            else if (arg == "--start" && hasValue)
+            {
+                startMem = upper(args[++i]);
+            }
+            else if (arg == "--jit")
+            {
+                useJit = true;
+            }
+            else if ((arg == "-o" || arg == "--output") && hasValue)
+            {
+                outFile = args[++i];
+            }
+            else if (arg == "--cache" && hasValue)
+            {
+                cacheMegabytes = std::stoul(args[++i]);
+            }
+            else if (arg == "--cache-dir" && hasValue)
+            {
+                cacheDirectory = args[++i];
+            }
+            else
+            {
+                paths.push_back(arg);
+            }
+        }
+    }
+    catch (const std::exception&)
+    {
+        std::cerr << "Invalid number argument\n";
+        return 2;
+    }
+
+    if (paths.empty() || !isHexByte(startMem))
+    {
+        std::cerr << "Usage: simulator --batch [-j threads] [--steps n] [--timeout s] [--start XY] [--jit] [-o file] [--cache MB] [--cache-dir dir] path[@XY]...\n";
+        return 2;
+    }
+
+    BatchRunner runner(threads, maxSteps, timeout, useJit);
+    std::shared_ptr<ResultCache> cache;
+    if (cacheMegabytes || !cacheDirectory.empty())
+    {
+        try
+        {
+            cache = std::make_shared<ResultCache>((cacheMegabytes ? cacheMegabytes : 64) << 20, cacheDirectory);
+        }
+        catch (const std::exception& e)
+        {
+            std::cerr << e.what() << '\n';
+            return 1;
+        }
+        runner.setCache(cache);
+    }
+    for (const std::string& path : paths)
+    {
+        collect(path, startMem, runner.jobs);
+    }
+
+    if (outFile.empty())
+    {
+        runner.run(std::cout);
+    }
+    else
+    {
+        std::ofstream fout{outFile};
+        if (!fout.is_open())
+        {
+            std::cerr << "Failed to open " << outFile << '\n';
+            return 1;
+        }
+        runner.run(fout);
+    }
+    if (cache)
+    {
+        ResultCache::Stats stats = cache->stats();
+        std::cerr << "Cache: " << stats.memoryHits << " hits in memory, " << stats.diskHits << " on disk, "
+                  << stats.misses << " misses\n";
+    }
+    return 0;
+}
@@ -0,0 +1,89 @@
+#pragma once
+
+#include "cache.h"
+#include "class_T4.h"
+#include "image.h"
+#include <memory>
+#include <ostream>
+#include <string>
+#include <vector>
+
+/**
+ * @brief A program file together with the memory cell it is loaded at, or one image of an archive
+ */
+struct BatchJob
+{
+    std::string fileName;
+    std::string startMem;
+    std::shared_ptr<const ImageArchive> archive;
+    std::size_t index;
+    std::string error;
+};
+
+class BatchRunner
+{
+private:
+    std::vector<BatchJob> jobs;
+    int threads;
+    long long maxSteps;
+    double timeout;
+    bool useJit;
+    std::shared_ptr<ResultCache> cache;
+
+    /**
+     * @brief Loads and runs a single job on a machine of its own and describes the final state as
+     *        one JSON line. The interpreter also stops at the timeout and at provable endless loops
+     */
+    std::string runJob(const BatchJob& job) const;
+
+public:
+    /**
+     * @param timeout The wall-clock limit of each job in seconds, 0 for none
+     */
+    BatchRunner(int threads, long long maxSteps, double timeout, bool useJit)
+        : threads(threads), maxSteps(maxSteps), timeout(timeout), useJit(useJit) {}
+
+    /**
+     * @brief Takes results from `cache` for programs that ran before with the same bytes, start
+     *        address, budget and engine, without loading them. Runs stopped by the timeout are not cached
+     */
+    void setCache(std::shared_ptr<ResultCache> resultCache) { cache = std::move(resultCache); }
+
+    /**
+     * @brief Queues a program file, or every regular file of a directory in name order. Image
+     *        files are loaded as they are and archives queue one job per image
+     * @param path The file or directory
+     * @param startMem The two hex digits of the memory cell text programs are loaded at
+     */
+    void addPath(const std::string& path, const std::string& startMem);
+
+    /**
+     * @brief Appends the jobs of a command line argument to `jobs`: a file or directory as taken by
+     *        `addPath`, optionally followed by "@XY" giving its own start address
+     * @param startMem The start address of arguments without one
+     */
+    static void collect(const std::string& argument, const std::string& startMem, std::vector<BatchJob>& jobs);
+
+    /**
+     * @brief Loads the program of `job` into `machine`, ready to run
+     * @throws std::exception if the job could not be queued or the program cannot be loaded
+     */
+    static void load(const BatchJob& job, Machine& machine);
+
+    /**
+     * @brief Whether `text` is two hex digits
+     */
+    static bool isHexByte(const std::string& text);
+
+    /**
+     * @brief Runs all queued jobs on the thread pool and writes one JSON line per job, in queue order
+     * @param out The stream receiving the results
+     */
+    void run(std::ostream& out);
+
+    /**
+     * @brief Entry point of `--batch`, parses the command line arguments following it
+     * @return The process exit code
+     */
+    static int main(const std::vector<std::string>& args);
+};
@@ -0,0 +1,376 @@
+#include "cache.h"
+#include "class_T4.h"
+#include "image.h"
+#include "jit.h"
+#include "lockstep.h"
+#include "multicore.h"
+#include "profiler.h"
+#include "trace.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+/**
+ * @brief A representative Vole program, the text is loaded at cell 10
+ */
+struct BenchProgram
+{
+    std::string name;
+    std::string text;
+};
+
+struct BenchResult
+{
+    std::string name;
+    std::string unit;
+    double value;
+};
+
+static const std::vector<BenchProgram> programs = {
+    // Counts R1 up to FF with a compare and a jump per iteration
+    {"tight_loop", "20FF 2100 2201 5112 B11C B016 C000"},
+    // Copies cells 80-BF to C0-FF by patching the address bytes of its own load and store
+    {"memory_copy", "20C0 2201 1180 31C0 1315 5332 3315 1417 5442 3417 B32A B014 C000 C000"},
+    // Adds a small positive float into an accumulator 64 times
+    {"float_accumulate", "2040 2101 2401 2300 6221 5334 B320 B018 C000"},
+    // Writes 64 characters to the screen
+    {"screen_output", "2040 2141 2201 2300 3100 5332 B320 B018 C000"},
+};
+
+static volatile int sink;
+
+static double seconds(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+/**
+ * @brief Times `op(i)` for `iterations` values of i and gives the mean cost of one call in nanoseconds
+ */
+template <typename Op>
+static double nsPerOp(long long iterations, Op op)
+{
+    auto start = std::chrono::steady_clock::now();
+    for (long long i = 0; i < iterations; ++i)
+    {
+        op(i);
+    }
+    return seconds(start) * 1e9 / iterations;
+}
+
+static std::string writeProgram(const std::filesystem::path& dir, const std::string& name, const std::string& text)
+{
+    std::string fileName = (dir / (name + ".txt")).string();
+    std::ofstream fout{fileName};
+    fout << text << '\n';
+    return fileName;
+}
+
+/**
+ * @brief Runs a loaded machine to halt over and over for at least `minSeconds` and gives instructions per second
+ */
+static double instructionsPerSecond(const Machine& loaded, double minSeconds)
+{
+    long long executed = 0;
+    auto start = std::chrono::steady_clock::now();
+    double elapsed = 0;
+    do
+    {
+        for (int rep = 0; rep < 64; ++rep)
+        {
+            Machine machine = loaded;
+            while (!machine.cpu.isHalt)
+            {
+                machine.cpu.runInstruction(machine.memory);
+                ++executed;
+            }
+        }
+        elapsed = seconds(start);
+    } while (elapsed < minSeconds);
+    return executed / elapsed;
+}
+
+/**
+ * @brief Same as instructionsPerSecond with the machine run by the JIT, which is kept across runs
+ */
+static double jitInstructionsPerSecond(const Machine& loaded, double minSeconds)
+{
+    Machine machine;
+    JIT jit(machine);
+    long long executed = 0;
+    auto start = std::chrono::steady_clock::now();
+    double elapsed = 0;
+    do
+    {
+        for (int rep = 0; rep < 64; ++rep)
+        {
+            machine = loaded;
+            jit.run(1LL << 40, executed);
+        }
+        elapsed = seconds(start);
+    } while (elapsed < minSeconds);
+    return executed / elapsed;
+}
+
+/**
+ * @brief Same as instructionsPerSecond with every run recorded to a trace file in `dir`
+ */
+static double tracedInstructionsPerSecond(const Machine& loaded, double minSeconds, const std::filesystem::path& dir)
+{
+    std::string fileName = (dir / "bench.vtr").string();
+    long long executed = 0;
+    double elapsed = 0;
+    {
+        Machine machine = loaded;
+        TraceRecorder recorder(fileName, machine);
+        auto start = std::chrono::steady_clock::now();
+        do
+        {
+            for (int rep = 0; rep < 64; ++rep)
+            {
+                machine = loaded;
+                while (!machine.cpu.isHalt)
+                {
+                    recorder.step(machine);
+                }
+            }
+            elapsed = seconds(start);
+        } while (elapsed < minSeconds);
+        executed = recorder.count();
+    }
+    std::filesystem::remove(fileName);
+    return executed / elapsed;
+}
+
+/**
+ * @brief Same as instructionsPerSecond with `Lockstep::LANES` copies of the machine run in lockstep,
+ *        counting the instructions of every lane
+ */
+static double lockstepInstructionsPerSecond(const Machine& loaded, double minSeconds)
+{
+    std::vector<Machine> machines(Lockstep::LANES, loaded);
+    long long executed = 0;
+    auto start = std::chrono::steady_clock::now();
+    double elapsed = 0;
+    do
+    {
+        for (int rep = 0; rep < 8; ++rep)
+        {
+            Lockstep lockstep(machines);
+            lockstep.run(1LL << 40);
+            for (int lane = 0; lane < lockstep.count(); ++lane)
+            {
+                executed += lockstep.laneSteps(lane);
+            }
+        }
+        elapsed = seconds(start);
+    } while (elapsed < minSeconds);
+    return executed / elapsed;
+}
+
+/**
+ * @brief Same as instructionsPerSecond with every run counted by a profiler
+ */
+static double profiledInstructionsPerSecond(const Machine& loaded, double minSeconds)
+{
+    Profiler profiler;
+    auto start = std::chrono::steady_clock::now();
+    double elapsed = 0;
+    do
+    {
+        for (int rep = 0; rep < 64; ++rep)
+        {
+            Machine machine = loaded;
+            while (!machine.cpu.isHalt)
+            {
+                profiler.step(machine);
+            }
+        }
+        elapsed = seconds(start);
+    } while (elapsed < minSeconds);
+    return profiler.instructionCount() / elapsed;
+}
+
+/**
+ * @brief Instructions per second of all cores of a `MultiCore` with one core per host thread, each
+ *        running `loaded` for a fixed budget. The program must not write to memory
+ */
+static double multiCoreInstructionsPerSecond(const Machine& loaded, double minSeconds)
+{
+    int cores = std::max(1, std::min(static_cast<int>(std::thread::hardware_concurrency()), 64));
+    long long executed = 0;
+    auto start = std::chrono::steady_clock::now();
+    double elapsed = 0;
+    do
+    {
+        MultiCore multiCore(loaded, cores);
+        multiCore.run(1 << 22);
+        for (int core = 0; core < cores; ++core)
+        {
+            executed += multiCore.coreSteps(core);
+        }
+        elapsed = seconds(start);
+    } while (elapsed < minSeconds);
+    return executed / elapsed;
+}
+
+/**
+ * @brief Nanoseconds to run a copy of `loaded` until it faults, through the exception of
+ *        `CPU::runInstruction` or the status code of `CPU::run`
+ */
+static double nsPerFault(const Machine& loaded, long long iterations, bool throwing)
+{
+    return nsPerOp(iterations, [&](long long) {
+        Machine machine = loaded;
+        if (throwing)
+        {
+            try
+            {
+                while (!machine.cpu.isHalt)
+                {
+                    machine.cpu.runInstruction(machine.memory);
+                }
+            }
+            catch (const std::exception&)
+            {
+            }
+        }
+        else
+        {
+            long long steps = 0;
+            machine.cpu.run(machine.memory, 1LL << 40, steps);
+        }
+        sink = machine.cpu.getPC();
+    });
+}
+
+static void writeResults(const std::string& fileName, const std::vector<BenchResult>& results)
+{
+    std::ofstream fout{fileName};
+    fout << "{\n  \"results\": [\n";
+    for (std::size_t i = 0; i < results.size(); ++i)
+    {
+        char value[64];
+        std::snprintf(value, sizeof(value), "%.6g", results[i].value);
+        fout << "    {\"name\": \"" << results[i].name << "\", \"unit\": \"" << results[i].unit
+             << "\", \"value\": " << value << "}" << (i + 1 < results.size() ? ",\n" : "\n");
+    }
+    fout << "  ]\n}\n";
+}
+
+int main(int argc, char* argv[])
+{
+    std::string outFile = "bench_results.json";
+    double scale = 1.0;
+    for (int i = 1; i < argc; ++i)
+    {
+        std::string arg = argv[i];
+        if (arg == "--out" && i + 1 < argc)
+        {
+            outFile = argv[++i];
+        }
+        else if (arg == "--scale" && i + 1 < argc)
+        {
+            scale = std::stod(argv[++i]);
+        }
+        else
+        {
+            std::cerr << "Usage: bench [--out file] [--scale factor]\n";
+            return 2;
+        }
+    }
+
+    std::vector<BenchResult> results;
+    long long iterations = static_cast<long long>(2000000 * scale) + 1;
+
+    std::vector<std::string> hex(256);
+    for (int i = 0; i < 256; ++i)
+    {
+        hex[i] = ALU::DecToHex(i);
+    }
+    auto n1 = [&](long long i) -> const std::string& { return hex[i & 0xFF]; };
+    auto n2 = [&](long long i) -> const std::string& { return hex[(i * 7 + 3) & 0xFF]; };
+    // Positive operands only, so no sum is zero
+    auto f1 = [&](long long i) -> const std::string& { return hex[i & 0x7F]; };
+    auto f2 = [&](long long i) -> const std::string& { return hex[(i * 7 + 3) & 0x7F]; };
+
+    results.push_back({"alu.HexToDec", "ns/op", nsPerOp(iterations, [&](long long i) { sink = ALU::HexToDec(n1(i)); })});
+    results.push_back({"alu.DecToHex", "ns/op", nsPerOp(iterations, [&](long long i) { sink = ALU::DecToHex(i & 0xFF)[0]; })});
+    results.push_back({"alu.addHexInt", "ns/op", nsPerOp(iterations, [&](long long i) { sink = ALU::addHexInt(n1(i), n2(i))[0]; })});
+    results.push_back({"alu.addHexFloat", "ns/op", nsPerOp(iterations, [&](long long i) { sink = ALU::addHexFloat(f1(i), f2(i))[0]; })});
+    results.push_back({"alu.OR", "ns/op", nsPerOp(iterations, [&](long long i) { sink = ALU::OR(n1(i), n2(i))[0]; })});
+    results.push_back({"alu.AND", "ns/op", nsPerOp(iterations, [&](long long i) { sink = ALU::AND(n1(i), n2(i))[0]; })});
+    results.push_back({"alu.XOR", "ns/op", nsPerOp(iterations, [&](long long i) { sink = ALU::XOR(n1(i), n2(i))[0]; })});
+    results.push_back({"alu.rotate", "ns/op", nsPerOp(iterations, [&](long long i) { sink = ALU::rotate(n1(i), hex[i & 0x7])[0]; })});
+
+    auto b1 = [](long long i) { return static_cast<std::uint8_t>(i); };
+    auto b2 = [](long long i) { return static_cast<std::uint8_t>(i * 7 + 3); };
+    results.push_back({"alu.kernel.addInt", "ns/op", nsPerOp(iterations, [&](long long i) { sink = ALU::addInt(b1(i), b2(i)); })});
+    results.push_back({"alu.kernel.addFloat", "ns/op", nsPerOp(iterations, [&](long long i) { sink = ALU::addFloat(b1(i), b2(i)); })});
+    results.push_back({"alu.kernel.orBits", "ns/op", nsPerOp(iterations, [&](long long i) { sink = ALU::orBits(b1(i), b2(i)); })});
+    results.push_back({"alu.kernel.andBits", "ns/op", nsPerOp(iterations, [&](long long i) { sink = ALU::andBits(b1(i), b2(i)); })});
+    results.push_back({"alu.kernel.xorBits", "ns/op", nsPerOp(iterations, [&](long long i) { sink = ALU::xorBits(b1(i), b2(i)); })});
+    results.push_back({"alu.kernel.rotateRight", "ns/op", nsPerOp(iterations, [&](long long i) { sink = ALU::rotateRight(b1(i), b2(i)); })});
+
+    std::filesystem::path dir = std::filesystem::temp_directory_path() / "vole_bench";
+    std::filesystem::create_directories(dir);
+    for (const BenchProgram& program : programs)
+    {
+        Machine loaded;
+        loaded.loadProgram(writeProgram(dir, program.name, program.text), "10");
+        results.push_back({"run." + program.name, "instr/s", instructionsPerSecond(loaded, 0.5 * scale)});
+        results.push_back({"jit." + program.name, "instr/s", jitInstructionsPerSecond(loaded, 0.5 * scale)});
+        results.push_back({"lockstep." + program.name, "instr/s", lockstepInstructionsPerSecond(loaded, 0.5 * scale)});
+        results.push_back({"profile." + program.name, "instr/s", profiledInstructionsPerSecond(loaded, 0.5 * scale)});
+        results.push_back({"trace." + program.name, "instr/s", tracedInstructionsPerSecond(loaded, 0.5 * scale, dir)});
+    }
+
+    Machine counting;
+    counting.loadProgram(writeProgram(dir, "counting", "2201 5112 B010"), "10");
+    results.push_back({"multicore.counting", "instr/s", multiCoreInstructionsPerSecond(counting, 0.5 * scale)});
+
+    Machine faulty;
+    faulty.loadProgram(writeProgram(dir, "faulty", "2001 2102 5201 E000"), "10");
+    results.push_back({"fault.throw", "ns/op", nsPerFault(faulty, iterations / 10 + 1, true)});
+    results.push_back({"fault.status", "ns/op", nsPerFault(faulty, iterations / 10 + 1, false)});
+
+    Machine cached;
+    cached.loadProgram(writeProgram(dir, "cached", programs[0].text), "10");
+    std::vector<std::uint8_t> key = ResultCache::keyOf(cached, 1000000);
+    std::vector<std::uint8_t> value = cached.snapshot();
+    std::vector<std::uint8_t> found;
+    ResultCache memoryCache(1 << 20);
+    memoryCache.put(key, value);
+    results.push_back({"cache.hit", "ns/op", nsPerOp(iterations / 10 + 1, [&](long long) { sink = memoryCache.get(key, found); })});
+    ResultCache diskCache(0, (dir / "cache").string());
+    diskCache.put(key, value);
+    results.push_back({"cache.disk_hit", "ns/op", nsPerOp(iterations / 100 + 1, [&](long long) { sink = diskCache.get(key, found); })});
+
+    std::string large;
+    for (int i = 0; i < 120; ++i)
+    {
+        large += ALU::DecToHex(0x20 | (i & 0xF)) + ALU::DecToHex(i) + (i % 8 == 7 ? "\n" : " ");
+    }
+    std::string largeFile = writeProgram(dir, "large", large);
+    Machine machine;
+    results.push_back({"load.large_program", "ns/op", nsPerOp(iterations / 100 + 1, [&](long long) { machine.loadProgram(largeFile, "10"); })});
+
+    std::string largeArchive = (dir / "large.vola").string();
+    ImageFormat::writeArchive(largeArchive, {{"large", ImageFormat::fromText(largeFile, "10")}});
+    ImageArchive archive(largeArchive);
+    results.push_back({"load.large_image", "ns/op", nsPerOp(iterations / 100 + 1, [&](long long) { archive.load(0, machine); })});
+
+    for (const BenchResult& result : results)
+    {
+        std::printf("%-24s %14.2f %s\n", result.name.c_str(), result.value, result.unit.c_str());
+    }
+    writeResults(outFile, results);
+    std::cout << "Results written to " << outFile << '\n';
+    return 0;
+}
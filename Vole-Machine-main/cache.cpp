@@ -0,0 +1,261 @@
+#include "cache.h"
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <random>
+#include <stdexcept>
+#include <system_error>
+#include <thread>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <unistd.h>
+#define VOLE_CACHE_PID 1
+#else
+#define VOLE_CACHE_PID 0
+#endif
+
+static const std::size_t ENTRY_OVERHEAD = 128;
+static const std::size_t FILE_HEADER_SIZE = 16;
+
+static void put32(std::vector<std::uint8_t>& out, std::uint32_t value)
+{
+    for (int shift = 0; shift < 32; shift += 8)
+    {
+        out.push_back(static_cast<std::uint8_t>(value >> shift));
+    }
+}
+
+static std::uint32_t get32(const std::uint8_t* p)
+{
+    return p[0] | (p[1] << 8) | (p[2] << 16) | (static_cast<std::uint32_t>(p[3]) << 24);
+}
+
+static inline std::uint64_t rotl(std::uint64_t x, int n)
+{
+    return (x << n) | (x >> (64 - n));
+}
+
+/**
+ * @brief The finalizer of SplitMix64, every input bit affects every output bit
+ */
+static inline std::uint64_t avalanche(std::uint64_t x)
+{
+    x ^= x >> 30;
+    x *= 0xBF58476D1CE4E5B9ULL;
+    x ^= x >> 27;
+    x *= 0x94D049BB133111EBULL;
+    return x ^ (x >> 31);
+}
+
+ResultCache::Digest ResultCache::digest(const std::uint8_t* data, std::size_t size)
+{
+    std::uint64_t a = 0x9E3779B97F4A7C15ULL ^ size;
+    std::uint64_t b = 0xC2B2AE3D27D4EB4FULL + size;
+    std::size_t i = 0;
+    for (; i + 8 <= size; i += 8)
+    {
+        std::uint64_t word;
+        std::memcpy(&word, data + i, 8);
+        a = rotl((a ^ word) * 0xFF51AFD7ED558CCDULL, 31);
+        b = rotl((b + word) * 0xC4CEB9FE1A85EC53ULL, 29) ^ a;
+    }
+    std::uint64_t tail = 0;
+    std::memcpy(&tail, data + i, size - i);
+    a = (a ^ tail) * 0xFF51AFD7ED558CCDULL;
+    b = (b + tail) * 0xC4CEB9FE1A85EC53ULL;
+    return Digest{avalanche(a ^ rotl(b, 17)), avalanche(b + rotl(a, 41))};
+}
+
+std::string ResultCache::Digest::hex() const
+{
+    static const char digits[] = "0123456789abcdef";
+    std::string text(32, '0');
+    for (int i = 0; i < 16; ++i)
+    {
+        text[15 - i] = digits[(high >> (4 * i)) & 0xF];
+        text[31 - i] = digits[(low >> (4 * i)) & 0xF];
+    }
+    return text;
+}
+
+std::vector<std::uint8_t> ResultCache::keyOf(const Machine& machine, long long maxSteps)
+{
+    std::vector<std::uint8_t> key = machine.snapshot();
+    put32(key, static_cast<std::uint32_t>(maxSteps));
+    put32(key, static_cast<std::uint32_t>(static_cast<std::uint64_t>(maxSteps) >> 32));
+    return key;
+}
+
+ResultCache::ResultCache(std::size_t memoryBytes, const std::string& directory)
+    : memoryBytes(memoryBytes), directory(directory), used(0), counts{}
+{
+    if (!directory.empty())
+    {
+        std::error_code error;
+        std::filesystem::create_directories(directory, error);
+        if (!std::filesystem::is_directory(directory))
+        {
+            throw std::runtime_error("Failed to create " + directory);
+        }
+    }
+}
+
+std::string ResultCache::pathOf(const Digest& digest) const
+{
+    std::string name = digest.hex();
+    return directory + "/" + name.substr(0, 2) + "/" + name.substr(2);
+}
+
+/**
+ * @brief Tells processes sharing a cache directory apart in temporary file names
+ */
+static std::uint64_t processId()
+{
+#if VOLE_CACHE_PID
+    return static_cast<std::uint64_t>(getpid());
+#else
+    static const std::uint64_t id = std::random_device()();
+    return id;
+#endif
+}
+
+bool ResultCache::readFile(const Digest& digest, const std::vector<std::uint8_t>& key, std::vector<std::uint8_t>& value) const
+{
+    std::string path = pathOf(digest);
+    std::ifstream fin(path, std::ios::binary);
+    std::uint8_t header[FILE_HEADER_SIZE];
+    if (!fin.read(reinterpret_cast<char*>(header), FILE_HEADER_SIZE) || std::memcmp(header, "VOLC", 4) != 0
+        || header[4] != VERSION || get32(header + 8) != key.size())
+    {
+        return false;
+    }
+    // The value length comes from disk, a truncated or corrupt entry must not decide an allocation
+    std::size_t valueSize = get32(header + 12);
+    std::error_code error;
+    std::uintmax_t fileSize = std::filesystem::file_size(path, error);
+    if (error || fileSize != FILE_HEADER_SIZE + key.size() + valueSize
+        || key.size() + valueSize + ENTRY_OVERHEAD > memoryBytes)
+    {
+        return false;
+    }
+    std::vector<std::uint8_t> stored(key.size());
+    if (!fin.read(reinterpret_cast<char*>(stored.data()), stored.size()) || stored != key)
+    {
+        return false;
+    }
+    std::vector<std::uint8_t> found(valueSize);
+    if (!fin.read(reinterpret_cast<char*>(found.data()), found.size()))
+    {
+        return false;
+    }
+    value.swap(found);
+    return true;
+}
+
+void ResultCache::writeFile(const Digest& digest, const std::vector<std::uint8_t>& key, const std::vector<std::uint8_t>& value) const
+{
+    std::string path = pathOf(digest);
+    std::string temporary = path + ".tmp" + std::to_string(processId()) + "-"
+                          + std::to_string(std::hash<std::thread::id>()(std::this_thread::get_id()));
+    std::error_code error;
+    std::filesystem::create_directories(std::filesystem::path(path).parent_path(), error);
+
+    std::vector<std::uint8_t> header = {'V', 'O', 'L', 'C', VERSION, 0, 0, 0};
+    put32(header, static_cast<std::uint32_t>(key.size()));
+    put32(header, static_cast<std::uint32_t>(value.size()));
+    {
+        std::ofstream fout(temporary, std::ios::binary | std::ios::trunc);
+        fout.write(reinterpret_cast<const char*>(header.data()), header.size());
+        fout.write(reinterpret_cast<const char*>(key.data()), key.size());
+        fout.write(reinterpret_cast<const char*>(value.data()), value.size());
+        if (!fout.flush())
+        {
+            fout.close();
+            std::filesystem::remove(temporary, error);
+            return;
+        }
+    }
+    // Readers see the old file or the whole new one, never a partial write
+    std::filesystem::rename(temporary, path, error);
+    if (error)
+    {
+        std::filesystem::remove(temporary, error);
+    }
+}
+
+void ResultCache::remember(const Digest& digest, const std::vector<std::uint8_t>& key, const std::vector<std::uint8_t>& value)
+{
+    auto found = index.find(digest);
+    if (found != index.end())
+    {
+        used -= found->second->key.size() + found->second->value.size() + ENTRY_OVERHEAD;
+        entries.erase(found->second);
+        index.erase(found);
+    }
+    std::size_t size = key.size() + value.size() + ENTRY_OVERHEAD;
+    if (size > memoryBytes)
+    {
+        return;
+    }
+    entries.push_front(Entry{digest, key, value});
+    index.emplace(digest, entries.begin());
+    used += size;
+    while (used > memoryBytes)
+    {
+        const Entry& oldest = entries.back();
+        used -= oldest.key.size() + oldest.value.size() + ENTRY_OVERHEAD;
+        index.erase(oldest.digest);
+        entries.pop_back();
+    }
+}
+
+bool ResultCache::get(const std::vector<std::uint8_t>& key, std::vector<std::uint8_t>& value)
+{
+    Digest hash = digest(key.data(), key.size());
+    {
+        std::lock_guard<std::mutex> hold(lock);
+        auto found = index.find(hash);
+        if (found != index.end() && found->second->key == key)
+        {
+            entries.splice(entries.begin(), entries, found->second);
+            value = found->second->value;
+            ++counts.memoryHits;
+            return true;
+        }
+    }
+    std::vector<std::uint8_t> stored;
+    if (!directory.empty() && readFile(hash, key, stored))
+    {
+        std::lock_guard<std::mutex> hold(lock);
+        remember(hash, key, stored);
+        ++counts.diskHits;
+        value.swap(stored);
+        return true;
+    }
+    std::lock_guard<std::mutex> hold(lock);
+    ++counts.misses;
+    return false;
+}
+
+void ResultCache::put(const std::vector<std::uint8_t>& key, const std::vector<std::uint8_t>& value)
+{
+    Digest hash = digest(key.data(), key.size());
+    {
+        std::lock_guard<std::mutex> hold(lock);
+        remember(hash, key, value);
+    }
+    if (!directory.empty() && key.size() + value.size() + ENTRY_OVERHEAD <= memoryBytes)
+    {
+        writeFile(hash, key, value);
+    }
+}
+
+ResultCache::Stats ResultCache::stats() const
+{
+    std::lock_guard<std::mutex> hold(lock);
+    Stats result = counts;
+    result.entries = entries.size();
+    result.bytes = used;
+    return result;
+}
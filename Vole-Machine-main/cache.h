@@ -0,0 +1,112 @@
+#pragma once
+
+#include "class_T4.h"
+#include <cstdint>
+#include <list>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * @brief Remembers the results of deterministic runs by the exact bytes that determine them. A
+ *        key is whatever describes the run completely, such as a job request without its id or
+ *        `keyOf` of a loaded machine, and a value is the encoded result.
+ *
+ *        Entries live in memory, least recently used first out when `memoryBytes` is exceeded, and
+ *        in a directory if one is given, which keeps them across processes and is never pruned.
+ *        Both tiers are addressed by a 128-bit digest of the key but store the key as well, so
+ *        two keys with the same digest can never return each other's value.
+ *
+ *        Disk entry: "VOLC", version, 0, 0, 0, u32 key length, u32 value length, key, value, in a
+ *        file named after the hex digest in a subdirectory named after its first two digits
+ */
+class ResultCache
+{
+public:
+    static const std::uint8_t VERSION = 1;
+
+    struct Digest
+    {
+        std::uint64_t high;
+        std::uint64_t low;
+
+        bool operator==(const Digest& other) const { return high == other.high && low == other.low; }
+        std::string hex() const;
+    };
+
+    struct Stats
+    {
+        std::uint64_t memoryHits;
+        std::uint64_t diskHits;
+        std::uint64_t misses;
+        std::size_t entries;
+        std::size_t bytes;
+    };
+
+private:
+    struct Entry
+    {
+        Digest digest;
+        std::vector<std::uint8_t> key;
+        std::vector<std::uint8_t> value;
+    };
+
+    struct DigestHash
+    {
+        std::size_t operator()(const Digest& digest) const { return static_cast<std::size_t>(digest.low); }
+    };
+
+    std::size_t memoryBytes;
+    std::string directory;
+
+    mutable std::mutex lock;
+    std::list<Entry> entries;
+    std::unordered_map<Digest, std::list<Entry>::iterator, DigestHash> index;
+    std::size_t used;
+    Stats counts;
+
+    /**
+     * @brief Puts an entry at the front of the memory tier and evicts from the back, `lock` held
+     */
+    void remember(const Digest& digest, const std::vector<std::uint8_t>& key, const std::vector<std::uint8_t>& value);
+
+    std::string pathOf(const Digest& digest) const;
+    bool readFile(const Digest& digest, const std::vector<std::uint8_t>& key, std::vector<std::uint8_t>& value) const;
+    void writeFile(const Digest& digest, const std::vector<std::uint8_t>& key, const std::vector<std::uint8_t>& value) const;
+
+public:
+    /**
+     * @param memoryBytes The size of the keys and values kept in memory
+     * @param directory The disk tier, created if missing, none if empty
+     * @throws std::runtime_error if the directory cannot be created
+     */
+    explicit ResultCache(std::size_t memoryBytes, const std::string& directory = "");
+    ResultCache(const ResultCache&) = delete;
+    ResultCache& operator=(const ResultCache&) = delete;
+
+    /**
+     * @brief Looks `key` up in memory, then on disk, where a hit is brought into memory
+     * @return False on a miss, `value` is then left alone
+     */
+    bool get(const std::vector<std::uint8_t>& key, std::vector<std::uint8_t>& value);
+
+    /**
+     * @brief Stores `value` under `key` in both tiers, replacing what was there. Disk errors are
+     *        ignored, the entry is then only kept in memory. An entry larger than `memoryBytes` is
+     *        not stored, and a disk entry that large is read as a miss
+     */
+    void put(const std::vector<std::uint8_t>& key, const std::vector<std::uint8_t>& value);
+
+    Stats stats() const;
+
+    /**
+     * @brief A fast non-cryptographic hash of `size` bytes at `data`
+     */
+    static Digest digest(const std::uint8_t* data, std::size_t size);
+
+    /**
+     * @brief The key of running `machine` for up to `maxSteps` instructions: its snapshot and the budget
+     */
+    static std::vector<std::uint8_t> keyOf(const Machine& machine, long long maxSteps);
+};
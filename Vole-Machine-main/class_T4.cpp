@@ -1,525 +1,1111 @@
-#include "class_T4.h"
-#include <bitset>
-#include <cmath>
-#include <iostream>
-#include <fstream>
-#include <stdexcept>
-#include <cctype>
-
-std::unordered_map<std::string, char> ALU::lookupTableToHex = {{"0000", '0'},
-        {"0001", '1'}, {"0010", '2'}, {"0011", '3'}, {"0100", '4'}, {"0101", '5'},
-        {"0110", '6'}, {"0111", '7'}, {"1000", '8'}, {"1001", '9'}, {"1010", 'A'},
-        {"1011", 'B'}, {"1100", 'C'}, {"1101", 'D'}, {"1110", 'E'}, {"1111", 'F'}};
-
-
-std::unordered_map<char, std::string> ALU::lookupTableToDec = {{'0', "0000"},
-        {'1', "0001"}, {'2', "0010"}, {'3', "0011"}, {'4', "0100"}, {'5', "0101"},
-        {'6', "0110"}, {'7', "0111"}, {'8', "1000"}, {'9', "1001"}, {'A', "1010"},
-        {'B', "1011"}, {'C', "1100"}, {'D', "1101"}, {'E', "1110"}, {'F', "1111"}};
-
-std::string Machine::screenASCII = "";
-std::string Machine::screenHex = "";
-
-bool CPU::isHalt = false;
-
-std::string ALU::DecToHex(int num)
-{
-    std::bitset<8> b(num);
-    std::string temp = "";
-    std::string hex = "";
-
-    for (int i = 7; i >= 4; --i)
-    {
-        temp += (b[i] ? '1' : '0');
-    }
-
-    hex += ALU::lookupTableToHex[temp];
-    temp = "";
-
-    for (int i = 3; i >= 0; --i)
-    {
-        temp += (b[i] ? '1' : '0');
-    }
-
-    hex += ALU::lookupTableToHex[temp];
-
-    return hex;
-}
-
-int ALU::HexToDec(const std::string& num)
-{
-    std::string bits = "";
-    bits += ALU::lookupTableToDec[num[0]];
-    bits += ALU::lookupTableToDec[num[1]];
-
-    std::bitset<8> b(bits);
-    int dec = b.to_ulong();
-
-    if (b[7] == 1)
-    {
-        dec -= (1 << 8);
-    }
-
-    return dec;
-}
-
-std::string ALU::addHexInt(const std::string& n1, const std::string& n2)
-{
-    int a = ALU::HexToDec(n1);
-    int b = ALU::HexToDec(n2);
-    return ALU::DecToHex(a + b);
-}
-
-std::string ALU::FloatToHex(float num)
-{
-    int S = (num < 0.0) ? 1 : 0;
-    num = (num < 0.0) ? -num : num;
-    int E = 0;
-    while (num >= 2.0)
-    {
-        num /= 2.0;
-        ++E;
-    }
-    while (num < 1.0)
-    {
-        num *= 2.0;
-        --E;
-    }
-    num -= 1.0;
-    E += 4;
-    int M = static_cast<int>(num * 16);
-    int ans = (S << 7) | (E << 4) | M;
-    return ALU::DecToHex(ans);
-}
-
-float ALU::HexToFloat(const std::string& num)
-{
-    std::string bits = "";
-    bits += ALU::lookupTableToDec[num[0]];
-    bits += ALU::lookupTableToDec[num[1]];
-
-    std::bitset<8> b(bits);
-    int S = b[7] ? -1 : 1;
-    int E = (b[6] << 2) | (b[5] << 1) | b[4];
-    E -= 4;
-
-    float M = 1.0;
-    for (int i = 3; i >= 0; --i)
-    {
-        M += b[i] * std::pow(2, i - 4);
-    }
-
-    return S * M * std::pow(2, E);
-}
-
-std::string ALU::addHexFloat(const std::string& n1, const std::string& n2)
-{
-    float a = ALU::HexToFloat(n1);
-    float b = ALU::HexToFloat(n2);
-    return ALU::FloatToHex(a + b);
-}
-
-std::string ALU::OR(const std::string& n1, const std::string& n2)
-{
-    int a = HexToDec(n1);
-    int b = HexToDec(n2);
-    return DecToHex(a | b);
-}
-
-std::string ALU::AND(const std::string& n1, const std::string& n2)
-{
-    int a = HexToDec(n1);
-    int b = HexToDec(n2);
-    return DecToHex(a & b);
-}
-
-std::string ALU::XOR(const std::string& n1, const std::string& n2)
-{
-    int a = HexToDec(n1);
-    int b = HexToDec(n2);
-    return DecToHex(a ^ b);
-}
-
-std::string ALU::rotate(const std::string& n1, const std::string& n2)
-{
-    int num = ALU::HexToDec(n1);
-    int x = ALU::HexToDec(n2);
-
-    return ALU::DecToHex((num >> x) | (num << (8 - x)));
-}
-
-/////////////////////////////////////////////////////////////////////////////////
-
-void Register::setValue(const int& address, const std::string& value)
-{
-    if (address < 0 || address > 15)
-    {
-        throw std::out_of_range("Register address is out of range");
-    }
-    registers[address] = value;
-}
-
-std::string Register::getValue(const int& address)
-{
-    if (address < 0 || address > 15)
-    {
-        throw std::out_of_range("Register address is out of range");
-    }
-    return registers[address];
-}
-
-////////////////////////////////////////////////////////////////////////////////////////////////////
-
-std::string Memory::getCell(const int& address)
-{
-    if (address < 0 || address > 255)
-    {
-        throw std::out_of_range("Memory address is out of range");
-    }
-    return cells[address];
-}
-
-void Memory::setCell(const int& address, const std::string& value)
-{
-    if (address < 0 || address > 255)
-    {
-        throw std::out_of_range("Memory address is out of range");
-    }
-    if (address == 0)
-    {
-        Machine::screenASCII += char(ALU::HexToDec(value));
-        Machine::screenHex += value + ' ';
-    }
-    cells[address] = value;
-}
-
-/////////////////////////////////////////////////////////////////////////////////////////////////////
-
-void CU::loadRegMem(Register& reg, const int& regIdx, Memory& mem, const int& memIdx)
-{
-    reg.setValue(regIdx, mem.getCell(memIdx));
-}
-
-void CU::loadRegVal(Register& reg, const int& regIdx, const int& val)
-{
-    reg.setValue(regIdx, ALU::DecToHex(val));
-}
-
-void CU::store(Register& reg, const int& regIdx, Memory& mem, const int& memIdx)
-{
-    mem.setCell(memIdx, reg.getValue(regIdx));
-}
-
-void CU::move(Register& reg, const int& regIdx1, const int& regIdx2)
-{
-    reg.setValue(regIdx2, reg.getValue(regIdx1));
-}
-
-void CU::jump(Register& reg, const int& regIdx, const int& memIdx, int& PC)
-{
-    if (reg.getValue(0) == reg.getValue(regIdx))
-    {
-        PC = memIdx;
-    }
-}
-
-void CU::halt()
-{
-    CPU::isHalt = true;
-}
-
-///////////////////////////////////////////////////////////////////////////////////////////////
-
-void CPU::fetch(Memory& mem)
-{
-    instruction = mem.getCell(programCounter) + mem.getCell(programCounter+1);
-    //std::cout << "\npc: " << programCounter << "->" << instruction << "\n\n";
-    programCounter += 2;
-    if (programCounter > 255)
-    {
-        throw std::overflow_error("The program counter overflowed the memory");
-    }
-}
-
-void CPU::decode(Memory& mem, Register& reg)
-{
-    if (instruction[0] == '1')
-        {
-        int regIdx = ALU::HexToDec(instruction.substr(1, 1));
-        std::string XY = instruction.substr(2, 2);
-        int memIdx = ALU::HexToDec(XY);
-        CU::loadRegMem(reg, regIdx, mem, memIdx);
-        }
-    else if (instruction[0] == '2')
-        {
-        int regIdx = ALU::HexToDec(instruction.substr(1, 1));
-        int val = ALU::HexToDec(instruction.substr(2, 2));
-        CU::loadRegVal(reg, regIdx, val);
-        }
-    else if (instruction[0] == '3')
-        {
-        int regIdx = ALU::HexToDec(instruction.substr(1, 1));
-        std::string XY = instruction.substr(2, 2);
-        int memIdx = ALU::HexToDec(XY);
-        CU::store(reg, regIdx, mem, memIdx);
-        }
-    else if (instruction[0] == '4')
-        {
-        int regIdx1 = ALU::HexToDec(instruction.substr(2, 1));
-        int regIdx2 = ALU::HexToDec(instruction.substr(3, 1));
-        CU::move(reg, regIdx1, regIdx2);
-        }
-    else if (instruction[0] == '5')
-        {
-        int R_index = ALU::HexToDec(instruction.substr(1, 1));
-        int S_index = ALU::HexToDec(instruction.substr(2, 1));
-        int T_index = ALU::HexToDec(instruction.substr(3, 1));
-        std::string addition = ALU::addHexInt(reg.getValue(S_index), reg.getValue(T_index));
-        reg.setValue(R_index, addition);
-        }
-   else if (instruction[0] == '6')
-        {
-        int R_index = ALU::HexToDec(instruction.substr(1, 1));
-        int S_index = ALU::HexToDec(instruction.substr(2, 1));
-        int T_index = ALU::HexToDec(instruction.substr(3, 1));
-        std::string addition = ALU::addHexFloat(reg.getValue(S_index), reg.getValue(T_index));
-        reg.setValue(R_index, addition);
-        }
-    else if (instruction[0] == '7')
-        {
-        int R_index = ALU::HexToDec(instruction.substr(1, 1));
-        int S_index = ALU::HexToDec(instruction.substr(2, 1));
-        int T_index = ALU::HexToDec(instruction.substr(3, 1));
-        std :: string result = ALU::OR(reg.getValue(S_index), reg.getValue(T_index));
-        reg.setValue(R_index, result);
-        }
-        else if (instruction[0] == '8')
-        {
-        int R_index = ALU::HexToDec(instruction.substr(1, 1));
-        int S_index = ALU::HexToDec(instruction.substr(2, 1));
-        int T_index = ALU::HexToDec(instruction.substr(3, 1));
-        std :: string result = ALU::AND(reg.getValue(S_index), reg.getValue(T_index));
-        reg.setValue(R_index, result);
-        }
-        else if (instruction[0] == '9')
-        {
-        int R_index = ALU::HexToDec(instruction.substr(1, 1));
-        int S_index = ALU::HexToDec(instruction.substr(2, 1));
-        int T_index = ALU::HexToDec(instruction.substr(3, 1));
-        std :: string result = ALU::XOR(reg.getValue(S_index), reg.getValue(T_index));
-        reg.setValue(R_index, result);
-        }
-        else if (instruction[0] == 'A')
-        {
-        int R_index = ALU::HexToDec(instruction.substr(1, 1));
-        std :: string result = ALU::rotate(reg.getValue(R_index),instruction.substr(3, 1));
-        reg.setValue(R_index, result);
-        }
-        else if (instruction[0] == 'B')
-        {
-        int memIdx = ALU::HexToDec(instruction.substr(2));
-        int regIdx = ALU::HexToDec(instruction.substr(1, 1));
-        CU::jump(reg, regIdx, memIdx, programCounter);
-        }
-        else if (instruction[0] == 'C')
-        {
-            CU::halt();
-        }
-        else if (instruction[0] == 'D')
-        {
-            if (reg.getValue(0) < reg.getValue(ALU::HexToDec(instruction.substr(1,1))))
-            {
-                programCounter = ALU::HexToDec(instruction.substr(2));
-            }
-        }
-        else
-        {
-            throw std::runtime_error("Unknown instruction code");
-        }
-
-}
-
-void CPU::setPC(int p)
-{
-    this->programCounter = p;
-}
-
-void CPU::runInstruction(Memory& mem)
-{
-    fetch(mem);
-    decode(mem , reg);
-}
-
-std::string CPU::getFromReg(const int& address)
-{
-    return reg.getValue(address);
-}
-
-////////////////////////////////////////////////////////////////////////////////////
-
-void Machine::loadProgram(const std::string& fileName, const std::string& startMem = "10")
-{
-    std::ifstream fin{fileName};
-
-    if (!fin.is_open())
-    {
-        throw std::runtime_error("Faild to open file");
-    }
-    std::string inst;
-    int address = ALU::HexToDec(startMem);
-    cpu.setPC(address);
-    for (int i = 0; i < 16; ++i)
-    {
-        cpu.reg.setValue(i, "00");
-    }
-    for (int i = 0; i < 256; ++i)
-    {
-        memory.setCell(i, "00");
-    }
-    screenASCII = "";
-    screenHex = "";
-    while (fin >> inst)
-    {
-        if (address + 1 >= 256)
-        {
-            throw std::overflow_error("Program length exceeds machine's memory");
-        }
-        for (char& c : inst)
-        {
-            c = std::toupper(c);
-        }
-        memory.setCell(address, inst.substr(0, 2));
-        memory.setCell(address+1, inst.substr(2));
-        address += 2;
-    }
-    fin.close();
-    std::cout << "Filed loaded successfully\n";
-}
-
-void Machine::printState()
-{
-    std::cout << "=== Registers ===\n";
-    for (int i = 0; i < 16; ++i)
-    {
-       std::cout << cpu.reg.getValue(i) << "  ";
-            if((i + 1) % 4 == 0){
-                std::cout << "\n";
-            }
-    }
-    std::cout << '\n' << "=== Memory ===\n";
-    for (int i = 0; i < 256; ++i)
-    {
-        std::cout << memory.getCell(i) << "  ";
-            if((i + 1) % 16 == 0){
-                std::cout << "\n";
-            }
-    }
-    std::cout << '\n' << "=== Screen ===\n" << "ASCII: " << screenASCII << '\n' << "HEX: " << screenHex << '\n';
-}
-
-////////////////////////////////////////////////////////////////////////////////////////////////////
-
-std::string choice;
-void VoleMain::init(Memory& mem , Register& reg)
-{
-    VoleMain::printMenu();
-    VoleMain::takeInput();
-    VoleMain::handleChoice(choice,mem, reg);
-}
-
-void VoleMain::printMenu()
-{
-    std:: cout<< "Choose one of the following choices : \n a)Read file and Load program \n b)Excute the program \n c)Run step \n d)Display the content \n e)Exit" << std :: endl;
-
-}
-
-void VoleMain::takeInput()
-{
-    std :: cin >> choice;
-    choice = tolower(choice[0]);
-    while (choice != "a" && choice != "b" && choice != "c" && choice != "d" && choice != "e")
-    {
-        std :: cout << "Please enter a valid input either a or b or c or d : \n a)Read file and Load program \n b)Excute the program \n c)Run step \n d)Display the content \n e)Exit" << std :: endl;
-        std :: cin >> choice;
-    }
-
-}
-
-void VoleMain::handleChoice(std::string& choice, Memory& mem, Register& reg)
-{
-    Machine machine;
-    std::string fileName;
-    std::string address;
-    while (choice != "e")
-    {
-        if(choice == "a")
-            {
-                std::cout << "Enter the filename \n";
-                std::cin >> fileName;
-                std::cout << "Enter the memory cell address to store the program at ";
-                std::cin >> address;
-                address[0] = std::toupper(address[0]);
-                address[1] = std::toupper(address[1]);
-                try
-                {
-                    machine.loadProgram(fileName, address);
-                }
-                catch(const std::exception& e)
-                {
-                    std::cerr << e.what() << '\n';
-                }
-            }
-        if(choice == "b")
-        {
-            machine.cpu.setPC(ALU::HexToDec(address));
-            Machine::screenASCII = "";
-            Machine::screenHex = "";
-            for (int i = 0; i < 256; i += 2)
-            {
-                machine.cpu.fetch(machine.memory);
-                try
-                {
-                    machine.cpu.decode(machine.memory, machine.cpu.reg);
-                }
-                catch (const std::exception& e)
-                {
-                    std::cerr << e.what() << "\n\n";
-                    break;
-                }
-                if (CPU::isHalt)
-                {
-                    CPU::isHalt = false;
-                    break;
-                }
-            }
-            machine.printState();
-        }
-        if(choice == "c")
-        {
-            machine.cpu.fetch(machine.memory);
-            try
-            {
-                machine.cpu.decode(machine.memory, machine.cpu.reg);
-            }
-            catch (const std::exception& e)
-            {
-                std::cerr << e.what() << "\n\n";
-            }
-            if (CPU::isHalt)
-            {
-                CPU::isHalt = false;
-                break;
-            }
-            machine.printState();
-        }
-        if (choice == "d")
-        {
-            machine.printState();
-        }
-        VoleMain::printMenu();
-        VoleMain::takeInput();
-    }
-}
-
-
-
+#include "class_T4.h"
+#include "debugger.h"
+#include "history.h"
+#include "supervisor.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <cctype>
+
+static constexpr char hexDigits[] = "0123456789ABCDEF";
+
+static constexpr int hexValue(char c)
+{
+    return (c >= '0' && c <= '9') ? c - '0'
+         : (c >= 'A' && c <= 'F') ? c - 'A' + 10
+         : (c >= 'a' && c <= 'f') ? c - 'a' + 10
+         : -1;
+}
+
+/**
+ * @brief The value of every 8-bit float pattern: sign bit, 3-bit exponent with a bias of 4 and a
+ *        4-bit mantissa with an implicit leading one. Scaling by two is exact, so this matches the
+ *        old `std::pow` based decoding bit for bit
+ */
+struct FloatValueTable
+{
+    float value[256];
+    constexpr FloatValueTable() : value{}
+    {
+        for (int bits = 0; bits < 256; ++bits)
+        {
+            float v = 1.0f + (bits & 0xF) / 16.0f;
+            for (int E = ((bits >> 4) & 0x7) - 4; E > 0; --E)
+            {
+                v *= 2.0f;
+            }
+            for (int E = ((bits >> 4) & 0x7) - 4; E < 0; ++E)
+            {
+                v /= 2.0f;
+            }
+            value[bits] = (bits & 0x80) ? -v : v;
+        }
+    }
+};
+
+static constexpr FloatValueTable floatValues;
+
+std::uint8_t ALU::floatSums[256][256];
+
+static const bool floatSumsReady = ALU::buildFloatSums();
+
+bool ALU::buildFloatSums()
+{
+    for (int a = 0; a < 256; ++a)
+    {
+        for (int b = 0; b < 256; ++b)
+        {
+            floatSums[a][b] = static_cast<std::uint8_t>(HexToDec(FloatToHex(floatValues.value[a] + floatValues.value[b])));
+        }
+    }
+    return true;
+}
+
+std::string ALU::DecToHex(int num)
+{
+    std::string hex = "00";
+    hex[0] = hexDigits[(num >> 4) & 0xF];
+    hex[1] = hexDigits[num & 0xF];
+    return hex;
+}
+
+int ALU::HexToDec(const std::string& num)
+{
+    int high = num.size() < 2 ? -1 : hexValue(num[0]);
+    int low = num.size() < 2 ? -1 : hexValue(num[1]);
+    if (high < 0 || low < 0)
+    {
+        throw std::out_of_range("Invalid hex number");
+    }
+    int dec = (high << 4) | low;
+
+    if (dec & 0x80)
+    {
+        dec -= (1 << 8);
+    }
+
+    return dec;
+}
+
+std::string ALU::addHexInt(const std::string& n1, const std::string& n2)
+{
+    return ALU::DecToHex(addInt(HexToDec(n1), HexToDec(n2)));
+}
+
+std::string ALU::FloatToHex(float num)
+{
+    if (num == 0.0)
+    {
+        return "00";
+    }
+    if (!std::isfinite(num))
+    {
+        // Infinity would halve forever and NaN has no exponent, neither fits the format
+        throw std::out_of_range("Not a finite number");
+    }
+    int S = (num < 0.0) ? 1 : 0;
+    num = (num < 0.0) ? -num : num;
+    int E = 0;
+    while (num >= 2.0)
+    {
+        num /= 2.0;
+        ++E;
+    }
+    while (num < 1.0)
+    {
+        num *= 2.0;
+        --E;
+    }
+    num -= 1.0;
+    E += 4;
+    int M = static_cast<int>(num * 16);
+    int ans = (S << 7) | ((E & 0xF) << 4) | M;
+    return ALU::DecToHex(ans);
+}
+
+float ALU::HexToFloat(const std::string& num)
+{
+    return floatValues.value[HexToDec(num) & 0xFF];
+}
+
+std::string ALU::addHexFloat(const std::string& n1, const std::string& n2)
+{
+    return ALU::DecToHex(addFloat(HexToDec(n1), HexToDec(n2)));
+}
+
+std::string ALU::OR(const std::string& n1, const std::string& n2)
+{
+    return DecToHex(orBits(HexToDec(n1), HexToDec(n2)));
+}
+
+std::string ALU::AND(const std::string& n1, const std::string& n2)
+{
+    return DecToHex(andBits(HexToDec(n1), HexToDec(n2)));
+}
+
+std::string ALU::XOR(const std::string& n1, const std::string& n2)
+{
+    return DecToHex(xorBits(HexToDec(n1), HexToDec(n2)));
+}
+
+std::string ALU::rotate(const std::string& n1, const std::string& n2)
+{
+    return ALU::DecToHex(rotateRight(HexToDec(n1), HexToDec(n2)));
+}
+
+/////////////////////////////////////////////////////////////////////////////////
+
+template <int RegisterCount>
+void BasicRegister<RegisterCount>::setValue(const int& address, const std::uint8_t& value)
+{
+    if ((RegisterCount & (RegisterCount - 1)) == 0)
+    {
+        registers[address & (RegisterCount - 1)] = value;
+        return;
+    }
+    if (address < 0 || address >= RegisterCount)
+    {
+        throw std::out_of_range("Register address is out of range");
+    }
+    registers[address] = value;
+}
+
+template <int RegisterCount>
+std::uint8_t BasicRegister<RegisterCount>::getValue(const int& address) const
+{
+    if ((RegisterCount & (RegisterCount - 1)) == 0)
+    {
+        return registers[address & (RegisterCount - 1)];
+    }
+    if (address < 0 || address >= RegisterCount)
+    {
+        throw std::out_of_range("Register address is out of range");
+    }
+    return registers[address];
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+template <int AddressBits>
+void BasicMemory<AddressBits>::setCell(const int& address, const std::uint8_t& value)
+{
+    int cell = address & Sizes::MASK;
+    if (ports[cell] == SCREEN_PORT)
+    {
+        screen.put(value);
+    }
+    cells[cell] = value;
+    for (int i = std::max(cell - Sizes::INSTRUCTION_SIZE + 1, 0); i <= cell; ++i)
+    {
+        decoded[i].opcode = UNDECODED;
+    }
+}
+
+template <int AddressBits>
+void BasicMemory<AddressBits>::load(const int& address, const std::uint8_t* data, const int& length)
+{
+    if (address < 0 || length < 0 || address + length > CELLS)
+    {
+        throw std::out_of_range("Memory address is out of range");
+    }
+    std::memcpy(cells + address, data, length);
+    for (int i = std::max(address - Sizes::INSTRUCTION_SIZE + 1, 0); i < address + length; ++i)
+    {
+        decoded[i].opcode = UNDECODED;
+    }
+}
+
+template <int AddressBits>
+void BasicMemory<AddressBits>::clear()
+{
+    std::memset(cells, 0, sizeof(cells));
+    for (int i = 0; i < CELLS; ++i)
+    {
+        decoded[i].opcode = UNDECODED;
+    }
+    screen.clear();
+}
+
+template <int AddressBits>
+void BasicMemory<AddressBits>::setTraps(const int& address, const std::uint8_t& flags)
+{
+    if (address < 0 || address >= CELLS)
+    {
+        throw std::out_of_range("Memory address is out of range");
+    }
+    trapCount += (flags != 0) - (traps[address] != 0);
+    traps[address] = flags;
+    for (int i = 0; i < CELLS; ++i)
+    {
+        decoded[i].opcode = UNDECODED;
+    }
+}
+
+template <int AddressBits>
+void BasicMemory<AddressBits>::setPort(int address, std::uint8_t port)
+{
+    std::uint8_t standard = address == 0 ? SCREEN_PORT : RAM;
+    remappedPorts += (port != standard) - (ports[address] != standard);
+    ports[address] = port;
+    for (int i = 0; i < CELLS; ++i)
+    {
+        decoded[i].opcode = UNDECODED;
+    }
+}
+
+template <int AddressBits>
+void BasicMemory<AddressBits>::mapDevice(const int& address, std::shared_ptr<Device> device)
+{
+    if (address < 0 || address >= CELLS)
+    {
+        throw std::out_of_range("Memory address is out of range");
+    }
+    if (!device)
+    {
+        setPort(address, RAM);
+        return;
+    }
+    std::size_t index = std::find(devices.begin(), devices.end(), device) - devices.begin();
+    if (index == devices.size())
+    {
+        if (devices.size() >= 256 - FIRST_DEVICE)
+        {
+            throw std::length_error("Too many devices");
+        }
+        devices.push_back(std::move(device));
+    }
+    setPort(address, static_cast<std::uint8_t>(FIRST_DEVICE + index));
+}
+
+template <int AddressBits>
+void BasicMemory<AddressBits>::mapScreen(const int& address)
+{
+    if (address < 0 || address >= CELLS)
+    {
+        throw std::out_of_range("Memory address is out of range");
+    }
+    setPort(address, SCREEN_PORT);
+}
+
+template <int AddressBits>
+void BasicMemory<AddressBits>::resetDevices()
+{
+    std::memset(ports, RAM, sizeof(ports));
+    ports[0] = SCREEN_PORT;
+    remappedPorts = 0;
+    devices.clear();
+    for (int i = 0; i < CELLS; ++i)
+    {
+        decoded[i].opcode = UNDECODED;
+    }
+}
+
+template <int AddressBits>
+bool BasicMemory<AddressBits>::trapped(const int& address, const Instruction& ins) const
+{
+    return (traps[address] & BREAK)
+        || (ins.opcode == 0x1 && (traps[ins.a] & WATCH_READ))
+        || (ins.opcode == 0x3 && (traps[ins.a] & WATCH_WRITE));
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+template <class Registers, class Cells>
+void CU::loadRegMem(Registers& reg, const int& regIdx, Cells& mem, const int& memIdx)
+{
+    reg.setValue(regIdx, mem.getCell(memIdx));
+}
+
+template <class Registers>
+void CU::loadRegVal(Registers& reg, const int& regIdx, const int& val)
+{
+    reg.setValue(regIdx, static_cast<std::uint8_t>(val));
+}
+
+template <class Registers, class Cells>
+void CU::store(Registers& reg, const int& regIdx, Cells& mem, const int& memIdx)
+{
+    mem.setRamCell(memIdx, reg.getValue(regIdx));
+}
+
+template <class Registers>
+void CU::move(Registers& reg, const int& regIdx1, const int& regIdx2)
+{
+    reg.setValue(regIdx2, reg.getValue(regIdx1));
+}
+
+template <class Registers>
+void CU::jump(Registers& reg, const int& regIdx, const int& memIdx, int& PC)
+{
+    if (reg.getValue(0) == reg.getValue(regIdx))
+    {
+        PC = memIdx;
+    }
+}
+
+void CU::halt(bool& isHalt)
+{
+    isHalt = true;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////
+
+const char* RunStatus::describe(Code code)
+{
+    static const char* const messages[] = {"Running", "Halted", "Unknown instruction code",
+                                           "The program counter overflowed the memory",
+                                           "The instruction budget is used up"};
+    return messages[code];
+}
+
+template <int AddressBits, int RegisterCount>
+const typename BasicCPU<AddressBits, RegisterCount>::Handler BasicCPU<AddressBits, RegisterCount>::handlers[19] = {
+    &BasicCPU::unknown,      &BasicCPU::loadMemory, &BasicCPU::loadValue, &BasicCPU::storeMemory,
+    &BasicCPU::moveRegister, &BasicCPU::addInt,     &BasicCPU::addFloat,  &BasicCPU::bitOr,
+    &BasicCPU::bitAnd,       &BasicCPU::bitXor,     &BasicCPU::rotate,    &BasicCPU::jumpEqual,
+    &BasicCPU::halt,         &BasicCPU::jumpGreater, &BasicCPU::unknown,  &BasicCPU::unknown,
+    &BasicCPU::trap,         &BasicCPU::device,     &BasicCPU::screenStore};
+
+template <int AddressBits, int RegisterCount>
+typename BasicCPU<AddressBits, RegisterCount>::Instruction
+BasicCPU<AddressBits, RegisterCount>::predecode(std::uint8_t hi, typename Sizes::Address lo)
+{
+    Instruction ins;
+    ins.opcode = hi >> 4;
+    ins.r = hi & 0xF;
+    ins.a = lo;
+    ins.b = 0;
+    if (ins.opcode == 0x4)
+    {
+        ins.r = (lo >> 4) & 0xF;
+        ins.a = lo & 0xF;
+    }
+    else if (ins.opcode >= 0x5 && ins.opcode <= 0xA)
+    {
+        ins.a = (lo >> 4) & 0xF;
+        ins.b = lo & 0xF;
+    }
+    if (RegisterCount < 16)
+    {
+        bool inRange = (ins.opcode == 0xC || ins.r < RegisterCount)
+            && (ins.opcode != 0x4 || ins.a < RegisterCount)
+            && (ins.opcode < 0x5 || ins.opcode > 0x9 || (ins.a < RegisterCount && ins.b < RegisterCount));
+        if (!inRange)
+        {
+            ins.opcode = 0x0;
+        }
+    }
+    return ins;
+}
+
+template <int AddressBits, int RegisterCount>
+typename Geometry<AddressBits>::Address BasicCPU<AddressBits, RegisterCount>::operandAt(const Memory& mem, int address)
+{
+    int operand = 0;
+    for (int i = 0; i < Sizes::ADDRESS_BYTES; ++i)
+    {
+        operand = (operand << 8) | mem.getCell(address + i);
+    }
+    return static_cast<typename Sizes::Address>(operand & Sizes::MASK);
+}
+
+template <int AddressBits, int RegisterCount>
+void BasicCPU<AddressBits, RegisterCount>::fetch(Memory& mem)
+{
+    if (!tryFetch(mem))
+    {
+        throw std::overflow_error(RunStatus::describe(RunStatus::PC_OVERFLOW));
+    }
+}
+
+template <int AddressBits, int RegisterCount>
+bool BasicCPU<AddressBits, RegisterCount>::tryFetch(Memory& mem)
+{
+    if (programCounter < 0 || programCounter + Sizes::INSTRUCTION_SIZE > Sizes::CELLS - 1)
+    {
+        return false;
+    }
+    Instruction& slot = mem.decodedAt(programCounter);
+    if (slot.opcode == Memory::UNDECODED)
+    {
+        slot = predecode(mem.getCell(programCounter), operandAt(mem, programCounter + 1));
+        if (mem.hasTraps() && mem.trapped(programCounter, slot))
+        {
+            slot.opcode = TRAP;
+        }
+        else
+        {
+            routePorts(mem, slot);
+        }
+    }
+    instruction = slot;
+    programCounter += Sizes::INSTRUCTION_SIZE;
+    ++cycles;
+    return true;
+}
+
+template <int AddressBits, int RegisterCount>
+void BasicCPU<AddressBits, RegisterCount>::decode(Memory& mem, Register& reg)
+{
+    (this->*handlers[instruction.opcode])(mem, reg);
+}
+
+template <int AddressBits, int RegisterCount>
+void BasicCPU<AddressBits, RegisterCount>::loadMemory(Memory& mem, Register& reg)
+{
+    CU::loadRegMem(reg, instruction.r, mem, instruction.a);
+}
+
+template <int AddressBits, int RegisterCount>
+void BasicCPU<AddressBits, RegisterCount>::loadValue(Memory&, Register& reg)
+{
+    CU::loadRegVal(reg, instruction.r, instruction.a);
+}
+
+template <int AddressBits, int RegisterCount>
+void BasicCPU<AddressBits, RegisterCount>::storeMemory(Memory& mem, Register& reg)
+{
+    CU::store(reg, instruction.r, mem, instruction.a);
+}
+
+template <int AddressBits, int RegisterCount>
+void BasicCPU<AddressBits, RegisterCount>::moveRegister(Memory&, Register& reg)
+{
+    CU::move(reg, instruction.r, instruction.a);
+}
+
+template <int AddressBits, int RegisterCount>
+void BasicCPU<AddressBits, RegisterCount>::addInt(Memory&, Register& reg)
+{
+    reg.setValue(instruction.r, ALU::addInt(reg.getValue(instruction.a), reg.getValue(instruction.b)));
+}
+
+template <int AddressBits, int RegisterCount>
+void BasicCPU<AddressBits, RegisterCount>::addFloat(Memory&, Register& reg)
+{
+    reg.setValue(instruction.r, ALU::addFloat(reg.getValue(instruction.a), reg.getValue(instruction.b)));
+}
+
+template <int AddressBits, int RegisterCount>
+void BasicCPU<AddressBits, RegisterCount>::bitOr(Memory&, Register& reg)
+{
+    reg.setValue(instruction.r, ALU::orBits(reg.getValue(instruction.a), reg.getValue(instruction.b)));
+}
+
+template <int AddressBits, int RegisterCount>
+void BasicCPU<AddressBits, RegisterCount>::bitAnd(Memory&, Register& reg)
+{
+    reg.setValue(instruction.r, ALU::andBits(reg.getValue(instruction.a), reg.getValue(instruction.b)));
+}
+
+template <int AddressBits, int RegisterCount>
+void BasicCPU<AddressBits, RegisterCount>::bitXor(Memory&, Register& reg)
+{
+    reg.setValue(instruction.r, ALU::xorBits(reg.getValue(instruction.a), reg.getValue(instruction.b)));
+}
+
+template <int AddressBits, int RegisterCount>
+void BasicCPU<AddressBits, RegisterCount>::rotate(Memory&, Register& reg)
+{
+    reg.setValue(instruction.r, ALU::rotateRight(reg.getValue(instruction.r), instruction.b));
+}
+
+template <int AddressBits, int RegisterCount>
+void BasicCPU<AddressBits, RegisterCount>::jumpEqual(Memory&, Register& reg)
+{
+    CU::jump(reg, instruction.r, instruction.a, programCounter);
+}
+
+template <int AddressBits, int RegisterCount>
+void BasicCPU<AddressBits, RegisterCount>::halt(Memory&, Register&)
+{
+    CU::halt(isHalt);
+}
+
+template <int AddressBits, int RegisterCount>
+void BasicCPU<AddressBits, RegisterCount>::jumpGreater(Memory&, Register& reg)
+{
+    if (reg.getValue(0) < reg.getValue(instruction.r))
+    {
+        programCounter = instruction.a;
+    }
+}
+
+template <int AddressBits, int RegisterCount>
+void BasicCPU<AddressBits, RegisterCount>::unknown(Memory&, Register&)
+{
+    throw std::runtime_error(RunStatus::describe(RunStatus::BAD_OPCODE));
+}
+
+template <int AddressBits, int RegisterCount>
+void BasicCPU<AddressBits, RegisterCount>::trap(Memory& mem, Register& reg)
+{
+    if (!stopsAtTrap(mem, reg))
+    {
+        (this->*handlers[instruction.opcode])(mem, reg);
+    }
+}
+
+template <int AddressBits, int RegisterCount>
+void BasicCPU<AddressBits, RegisterCount>::device(Memory& mem, Register& reg)
+{
+    if (instruction.b == 0x1)
+    {
+        reg.setValue(instruction.r, mem.readPort(instruction.a, cycles));
+    }
+    else
+    {
+        mem.writePort(instruction.a, reg.getValue(instruction.r), cycles);
+    }
+}
+
+template <int AddressBits, int RegisterCount>
+void BasicCPU<AddressBits, RegisterCount>::screenStore(Memory& mem, Register& reg)
+{
+    mem.screen.put(reg.getValue(instruction.r));
+    mem.setRamCell(instruction.a, reg.getValue(instruction.r));
+}
+
+template <int AddressBits, int RegisterCount>
+bool BasicCPU<AddressBits, RegisterCount>::stopsAtTrap(Memory& mem, Register& reg)
+{
+    int pc = programCounter - Sizes::INSTRUCTION_SIZE;
+    instruction = predecode(mem.getCell(pc), operandAt(mem, pc + 1));
+    if (trapHandler != nullptr && trapHandler->stop(pc, instruction, reg, mem))
+    {
+        programCounter = pc;
+        isHalt = true;
+        return true;
+    }
+    routePorts(mem, instruction);
+    return false;
+}
+
+template <int AddressBits, int RegisterCount>
+void BasicCPU<AddressBits, RegisterCount>::setPC(int p)
+{
+    this->programCounter = p;
+}
+
+template <int AddressBits, int RegisterCount>
+int BasicCPU<AddressBits, RegisterCount>::getPC() const
+{
+    return programCounter;
+}
+
+template <int AddressBits, int RegisterCount>
+void BasicCPU<AddressBits, RegisterCount>::runInstruction(Memory& mem)
+{
+    fetch(mem);
+    decode(mem , reg);
+}
+
+template <int AddressBits, int RegisterCount>
+RunStatus::Code BasicCPU<AddressBits, RegisterCount>::execute(Memory& mem)
+{
+    if (!tryFetch(mem))
+    {
+        return RunStatus::PC_OVERFLOW;
+    }
+    if (instruction.opcode == TRAP && stopsAtTrap(mem, reg))
+    {
+        return RunStatus::HALTED;
+    }
+    if (!((KNOWN_OPCODES >> instruction.opcode) & 1))
+    {
+        return RunStatus::BAD_OPCODE;
+    }
+    (this->*handlers[instruction.opcode])(mem, reg);
+    return isHalt ? RunStatus::HALTED : RunStatus::RUNNING;
+}
+
+template <int AddressBits, int RegisterCount>
+RunStatus::Code BasicCPU<AddressBits, RegisterCount>::run(Memory& mem, long long maxSteps, long long& steps)
+{
+    if (isHalt)
+    {
+        return RunStatus::HALTED;
+    }
+    while (steps < maxSteps)
+    {
+        int pc = programCounter;
+        RunStatus::Code code = execute(mem);
+        if (code != RunStatus::RUNNING)
+        {
+            // A trap handler stopping in front of an instruction leaves the PC on it
+            steps += code == RunStatus::HALTED && programCounter != pc;
+            return code;
+        }
+        ++steps;
+    }
+    return RunStatus::BUDGET;
+}
+
+template <int AddressBits, int RegisterCount>
+std::uint8_t BasicCPU<AddressBits, RegisterCount>::getFromReg(const int& address)
+{
+    return reg.getValue(address);
+}
+
+////////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * @brief Reads `digits` hex digits from the start of `text`
+ */
+static int parseHex(const std::string& text, int digits)
+{
+    int value = 0;
+    for (int i = 0; i < digits; ++i)
+    {
+        int digit = i < static_cast<int>(text.size()) ? hexValue(text[i]) : -1;
+        if (digit < 0)
+        {
+            throw std::out_of_range("Invalid hex number");
+        }
+        value = (value << 4) | digit;
+    }
+    return value;
+}
+
+template <int AddressBits, int RegisterCount>
+std::vector<std::uint8_t> BasicMachine<AddressBits, RegisterCount>::parseProgram(const std::string& fileName)
+{
+    std::ifstream fin{fileName};
+
+    if (!fin.is_open())
+    {
+        throw std::runtime_error("Faild to open file");
+    }
+    std::vector<std::uint8_t> program;
+    std::string inst;
+    while (fin >> inst)
+    {
+        if (program.size() + Sizes::INSTRUCTION_SIZE > Sizes::CELLS)
+        {
+            throw std::overflow_error("Program length exceeds machine's memory");
+        }
+        if (inst.size() != 2 * Sizes::INSTRUCTION_SIZE)
+        {
+            throw std::runtime_error("Invalid instruction: " + inst);
+        }
+        for (char& c : inst)
+        {
+            if (!std::isxdigit(static_cast<unsigned char>(c)))
+            {
+                throw std::runtime_error("Invalid instruction: " + inst);
+            }
+            c = std::toupper(c);
+        }
+        for (int i = 0; i < Sizes::INSTRUCTION_SIZE; ++i)
+        {
+            program.push_back(static_cast<std::uint8_t>(parseHex(inst.substr(2 * i), 2)));
+        }
+    }
+    fin.close();
+    return program;
+}
+
+template <int AddressBits, int RegisterCount>
+void BasicMachine<AddressBits, RegisterCount>::loadProgram(const std::string& fileName, const std::string& startMem)
+{
+    std::vector<std::uint8_t> program = parseProgram(fileName);
+    int address = parseHex(startMem, 2 * Sizes::ADDRESS_BYTES) & Sizes::MASK;
+    if (address + program.size() > Sizes::CELLS)
+    {
+        throw std::overflow_error("Program length exceeds machine's memory");
+    }
+    loadBytes(program.data(), static_cast<int>(program.size()), address, address);
+}
+
+template <int AddressBits, int RegisterCount>
+void BasicMachine<AddressBits, RegisterCount>::loadBytes(const std::uint8_t* program, int length, int loadAddress, int startAddress)
+{
+    cpu.reg = typename CPU::Register();
+    cpu.isHalt = false;
+    cpu.cycles = 0;
+    cpu.setPC(startAddress);
+    memory.clear();
+    memory.load(loadAddress, program, length);
+}
+
+template <int AddressBits, int RegisterCount>
+std::vector<std::uint8_t> BasicMachine<AddressBits, RegisterCount>::snapshot() const
+{
+    std::vector<std::uint8_t> blob;
+    snapshot(blob);
+    return blob;
+}
+
+template <int AddressBits, int RegisterCount>
+void BasicMachine<AddressBits, RegisterCount>::snapshot(std::vector<std::uint8_t>& blob) const
+{
+    const std::uint64_t total = memory.screen.total();
+    const std::size_t kept = total < Screen::CAPACITY ? static_cast<std::size_t>(total) : Screen::CAPACITY;
+    blob.clear();
+    blob.reserve(8 + Sizes::ADDRESS_BYTES - 1 + RegisterCount + Sizes::CELLS + 12 + kept);
+    const std::uint8_t header[] = {'V', 'O', 'L', 'S', 2,
+        static_cast<std::uint8_t>(cpu.getPC()), static_cast<std::uint8_t>(cpu.isHalt), GEOMETRY};
+    blob.insert(blob.end(), header, header + sizeof(header));
+    for (int i = 1; i < Sizes::ADDRESS_BYTES; ++i)
+    {
+        blob.push_back(static_cast<std::uint8_t>(cpu.getPC() >> (8 * i)));
+    }
+    for (int i = 0; i < RegisterCount; ++i)
+    {
+        blob.push_back(cpu.reg.getValue(i));
+    }
+    for (int i = 0; i < Sizes::CELLS; ++i)
+    {
+        blob.push_back(memory.getCell(i));
+    }
+    for (int shift = 0; shift < 32; shift += 8)
+    {
+        blob.push_back(static_cast<std::uint8_t>(kept >> shift));
+    }
+    for (int shift = 0; shift < 64; shift += 8)
+    {
+        blob.push_back(static_cast<std::uint8_t>(total >> shift));
+    }
+    memory.screen.appendKept(blob);
+}
+
+template <int AddressBits, int RegisterCount>
+void BasicMachine<AddressBits, RegisterCount>::restore(const std::uint8_t* data, std::size_t size)
+{
+    const std::size_t registers = 8 + Sizes::ADDRESS_BYTES - 1;
+    const std::size_t cells = registers + RegisterCount;
+    if (size < 8 || std::memcmp(data, "VOLS", 4) != 0 || data[4] < 1 || data[4] > 2 || data[6] > 1)
+    {
+        throw std::runtime_error("Not a Vole machine snapshot");
+    }
+    if (data[7] != GEOMETRY)
+    {
+        throw std::runtime_error("Machine snapshot is of a different geometry");
+    }
+    const std::size_t lengthAt = cells + Sizes::CELLS;
+    const std::size_t header = lengthAt + (data[4] == 1 ? 4 : 12);
+    if (size < header)
+    {
+        throw std::runtime_error("Machine snapshot is truncated");
+    }
+    const std::uint8_t* screen = data + header;
+    std::size_t screenLength = data[lengthAt] | (data[lengthAt + 1] << 8) | (data[lengthAt + 2] << 16)
+                             | (static_cast<std::size_t>(data[lengthAt + 3]) << 24);
+    if (size - header != screenLength)
+    {
+        throw std::runtime_error("Machine snapshot is truncated");
+    }
+    std::uint64_t screenTotal = screenLength;
+    if (data[4] != 1)
+    {
+        screenTotal = 0;
+        for (int i = 7; i >= 0; --i)
+        {
+            screenTotal = (screenTotal << 8) | data[lengthAt + 4 + i];
+        }
+        if (screenTotal < screenLength)
+        {
+            throw std::runtime_error("Not a Vole machine snapshot");
+        }
+    }
+
+    int pc = data[5];
+    for (int i = 1; i < Sizes::ADDRESS_BYTES; ++i)
+    {
+        pc |= data[7 + i] << (8 * i);
+    }
+    cpu.setPC(pc);
+    cpu.isHalt = data[6] != 0;
+    for (int i = 0; i < RegisterCount; ++i)
+    {
+        cpu.reg.setValue(i, data[registers + i]);
+    }
+    memory.load(0, data + cells, Sizes::CELLS);
+    memory.screen.assign(screen, screenLength, screenTotal);
+}
+
+template <int AddressBits, int RegisterCount>
+void BasicMachine<AddressBits, RegisterCount>::printState()
+{
+    std::cout << "=== Registers ===\n";
+    for (int i = 0; i < RegisterCount; ++i)
+    {
+       std::cout << ALU::DecToHex(cpu.reg.getValue(i)) << "  ";
+            if((i + 1) % 4 == 0){
+                std::cout << "\n";
+            }
+    }
+    std::cout << '\n' << "=== Memory ===\n";
+    for (int i = 0; i < Sizes::CELLS; ++i)
+    {
+        std::cout << ALU::DecToHex(memory.getCell(i)) << "  ";
+            if((i + 1) % 16 == 0){
+                std::cout << "\n";
+            }
+    }
+    std::cout << '\n' << "=== Screen ===\n" << "ASCII: " << memory.screen.ascii() << '\n' << "HEX: " << memory.screen.hex() << '\n';
+}
+
+template class BasicRegister<16>;
+template class BasicMemory<8>;
+template class BasicCPU<8, 16>;
+template class BasicMachine<8, 16>;
+template class BasicMemory<16>;
+template class BasicCPU<16, 16>;
+template class BasicMachine<16, 16>;
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+std::string choice;
+void VoleMain::init(Memory& mem , Register& reg)
+{
+    VoleMain::printMenu();
+    VoleMain::takeInput();
+    VoleMain::handleChoice(choice,mem, reg);
+}
+
+void VoleMain::printMenu()
+{
+    std:: cout<< "Choose one of the following choices : \n a)Read file and Load program \n b)Excute the program \n c)Run step \n d)Display the content \n e)Exit \n f)Set breakpoints and watchpoints \n g)Run to the next breakpoint \n h)Step back \n i)Run back to a breakpoint or write" << std :: endl;
+
+}
+
+void VoleMain::takeInput()
+{
+    std :: cin >> choice;
+    choice = tolower(choice[0]);
+    while (choice != "a" && choice != "b" && choice != "c" && choice != "d" && choice != "e" && choice != "f" && choice != "g" && choice != "h" && choice != "i")
+    {
+        std :: cout << "Please enter a valid input either a or b or c or d or e or f or g or h or i : \n a)Read file and Load program \n b)Excute the program \n c)Run step \n d)Display the content \n e)Exit \n f)Set breakpoints and watchpoints \n g)Run to the next breakpoint \n h)Step back \n i)Run back to a breakpoint or write" << std :: endl;
+        std :: cin >> choice;
+    }
+
+}
+
+void VoleMain::handleChoice(std::string& choice, Memory&, Register&)
+{
+    Machine machine;
+    Debugger debugger(machine);
+    History history(machine, checkpointInterval);
+    std::string fileName;
+    std::string address;
+    while (choice != "e")
+    {
+        if(choice == "a")
+            {
+                std::cout << "Enter the filename \n";
+                std::cin >> fileName;
+                std::cout << "Enter the memory cell address to store the program at ";
+                std::cin >> address;
+                address[0] = std::toupper(address[0]);
+                address[1] = std::toupper(address[1]);
+                try
+                {
+                    machine.loadProgram(fileName, address);
+                    history.reset(machine);
+                    std::cout << "Filed loaded successfully\n";
+                }
+                catch(const std::exception& e)
+                {
+                    std::cerr << e.what() << '\n';
+                }
+            }
+        if(choice == "b")
+        {
+            try
+            {
+                machine.cpu.setPC(ALU::HexToDec(address) & 0xFF);
+                machine.memory.screen.clear();
+                debugger.resume();
+                Supervisor::Result result = Supervisor(maxSteps, timeout).run(machine);
+                if (result.reason == Supervisor::FAULT)
+                {
+                    std::cerr << result.error << "\n\n";
+                }
+                if (debugger.lastHit().kind != Debugger::NONE)
+                {
+                    std::cout << debugger.describe() << " after " << result.steps << " steps\n";
+                }
+                else
+                {
+                    std::cout << Supervisor::describe(result) << '\n';
+                }
+                machine.cpu.isHalt = false;
+                history.reset(machine);
+                machine.printState();
+            }
+            catch(const std::exception& e)
+            {
+                std::cerr << "Load a program first: " << e.what() << '\n';
+            }
+        }
+        if(choice == "c")
+        {
+            try
+            {
+                debugger.step(&history);
+            }
+            catch (const std::exception& e)
+            {
+                std::cerr << e.what() << "\n\n";
+            }
+            if (debugger.lastHit().kind != Debugger::NONE)
+            {
+                std::cout << debugger.describe() << '\n';
+            }
+            else if (machine.cpu.isHalt)
+            {
+                machine.cpu.isHalt = false;
+                break;
+            }
+            machine.printState();
+        }
+        if (choice == "d")
+        {
+            machine.printState();
+        }
+        if (choice == "f")
+        {
+            handleBreakpoints(debugger);
+        }
+        if (choice == "g")
+        {
+            try
+            {
+                long long steps = debugger.run(maxSteps, &history);
+                if (debugger.lastHit().kind != Debugger::NONE)
+                {
+                    std::cout << debugger.describe() << " after " << steps << " steps\n";
+                }
+                else if (machine.cpu.isHalt)
+                {
+                    std::cout << "Halted after " << steps << " steps\n";
+                }
+                else
+                {
+                    std::cout << "Paused after " << steps << " steps\n";
+                }
+            }
+            catch (const std::exception& e)
+            {
+                std::cerr << e.what() << "\n\n";
+            }
+            machine.printState();
+        }
+        if (choice == "h")
+        {
+            if (!history.stepBack(machine))
+            {
+                std::cout << "At the start of the history\n";
+            }
+            machine.printState();
+        }
+        if (choice == "i")
+        {
+            handleRunBack(history);
+        }
+        VoleMain::printMenu();
+        VoleMain::takeInput();
+    }
+}
+
+void VoleMain::handleRunBack(History& history)
+{
+    std::cout << "Stop at the last write of : \n R  (a register, e.g. R3) \n XY  (a memory cell) \n -  (only breakpoints)" << std::endl;
+    std::string target;
+    std::cin >> target;
+    int reg = -1;
+    int cell = -1;
+    try
+    {
+        if (target.empty())
+        {
+            throw std::out_of_range("Invalid hex number");
+        }
+        if (std::toupper(target[0]) == 'R' && target.size() == 2)
+        {
+            reg = ALU::HexToDec("0" + target.substr(1)) & 0xF;
+        }
+        else if (target != "-")
+        {
+            cell = ALU::HexToDec(target) & 0xFF;
+        }
+    }
+    catch (const std::exception& e)
+    {
+        std::cerr << e.what() << '\n';
+        return;
+    }
+    long long steps = history.runBack(machine, reg, cell);
+    std::cout << "Went back " << steps << " steps to step " << history.position() << '\n';
+    machine.printState();
+}
+
+void VoleMain::handleBreakpoints(Debugger& debugger)
+{
+    std::cout << "Enter a command : \n break XY \n break XY R op VV  (op is one of == != < <= > >=) \n delete XY \n watch XY r|w|rw \n unwatch XY \n list \n clear" << std::endl;
+    std::string command;
+    std::string address;
+    std::cin >> command;
+    try
+    {
+        if (command == "list")
+        {
+            debugger.list(std::cout);
+            return;
+        }
+        if (command == "clear")
+        {
+            debugger.clear();
+            return;
+        }
+        std::cin >> address;
+        int cell = ALU::HexToDec(address) & 0xFF;
+        if (command == "break")
+        {
+            std::string rest;
+            std::getline(std::cin, rest);
+            std::istringstream condition(rest);
+            std::string reg, comparison, value;
+            if (condition >> reg >> comparison >> value)
+            {
+                if (std::toupper(reg[0]) == 'R')
+                {
+                    reg = reg.substr(1);
+                }
+                debugger.setBreakpoint(cell, Debugger::parseComparison(comparison), ALU::HexToDec("0" + reg) & 0xF,
+                                       static_cast<std::uint8_t>(ALU::HexToDec(value)));
+            }
+            else
+            {
+                debugger.setBreakpoint(cell);
+            }
+        }
+        else if (command == "delete")
+        {
+            debugger.removeBreakpoint(cell);
+        }
+        else if (command == "watch")
+        {
+            std::string mode;
+            std::cin >> mode;
+            debugger.watch(cell, mode.find('r') != std::string::npos, mode.find('w') != std::string::npos);
+        }
+        else if (command == "unwatch")
+        {
+            debugger.watch(cell, false, false);
+        }
+        else
+        {
+            std::cout << "Unknown command\n";
+        }
+    }
+    catch (const std::exception& e)
+    {
+        std::cerr << e.what() << '\n';
+    }
+}
@@ -1,164 +1,665 @@
-#pragma once
-
-#include <string>
-#include <unordered_map>
-
-class ALU
-{
-private:
-    static std::unordered_map<std::string, char> lookupTableToHex;
-    static std::unordered_map<char, std::string> lookupTableToDec;
-public:
-    static std::string DecToHex(int num);
-    static int HexToDec(const std::string& num);
-    static std::string addHexInt(const std::string& n1, const std::string& n2);
-
-    static std::string FloatToHex(float num);
-    static float HexToFloat(const std::string& num);
-    static std::string addHexFloat(const std::string& n1, const std::string& n2);
-
-    static std::string OR(const std::string& n1, const std::string& n2);
-    static std::string AND(const std::string& n1, const std::string& n2);
-    static std::string XOR(const std::string& n1, const std::string& n2);
-    static std::string rotate(const std::string& n1, const std::string& n2);
-};
-
-class Register
-{
-private:
-    std::string registers[16];
-public:
-    Register()
-    {
-        for (int i = 0; i < 16; ++i)
-        {
-            registers[i] = "00";
-        }
-    }
-    void setValue(const int& address, const std::string& value);
-    std::string getValue(const int& address);
-};
-
-class Memory
-{
-private:
-    std::string cells[256];
-public:
-    Memory()
-    {
-        for (int i = 0; i < 256; ++i)
-        {
-            cells[i] = "00";
-        }
-    }
-    std::string getCell(const int& address);
-    void setCell(const int& address, const std::string& value);
-};
-
-class CU
-{
-public:
-    CU() {}
-
-    static void loadRegMem(Register& reg, const int& regIdx, Memory& mem, const int& memIdx);
-
-     /**
-     * @brief Loads the value of the memory at the cell `memIdx` into the register at the index `regIdx`
-     * @param reg The register of the CPU
-     * @param regIdx The index of the register
-     * @param mem The memory of the machine
-     * @param memIdx The index of the memory cell
-     */
-    static void loadRegVal(Register& reg, const int& regIdx, const int& val);
-
-    /**
-     * @brief Loads the value `val` in the register at the index `regIdx`
-     * @param reg The resgister of the CPU
-     * @param regIdx The index of the register
-     * @param val The value to be stored in the register at index `regIdx`
-     */
-    static void store(Register& reg, const int& regIDX, Memory& mem, const int& memIdx);
-
-    /**
-     * @brief Stores the value of the register at index `regIDX` into the memory at the index `memIdx`
-     * @param reg The register of the CPU
-     * @param mem The memory of the machine
-     * @param regIdx The index of the register
-     * @param memIdx The index of the memory cell
-     */
-    static void move(Register& reg, const int& regIdx1, const int& regIdx2);
-
-   /**
-     * @brief Moves the value of the register at index `regIdx1` to the register at index `regIdx2`
-     * @param reg The register of the CPU
-     * @param regIdx1 The index of the first register
-     * @param regIdx2 The index of the second register
-     */
-    static void jump(Register& reg, const int& regIdx, const int& memIdx, int& PC);
-/**
-     * @brief Checks the value of the register at index `regIdx` with the register index 0, if they are equal the
-     *        execution of the program continues from the memory cell at index `memIdx`
-     * @param reg The register of the CPU
-     * @param regIdx The index of the register to be comapred with the register at index 0
-     * @param memIdx The index of the memory cell that will be executed if the 2 registers are equal
-     * @param PC The program counter of the CPU
-     */
-    static void halt();
-};
-
-class CPU
-{
-private:
-    ALU alu;
-    CU cu;
-    std::string instruction;
-    int programCounter;
-public:
-    Register reg;
-    static bool isHalt;
-    CPU() : programCounter(0) {}
-    /**
-     * @brief Gets the instruction to be executed from the memory using the
-     *        program counter and puts it in the instruction register
-     * @param mem The memory of the machine
-     */
-    void fetch(Memory& mem);
-
-    /**
-     * @brief Decodes the instruction in the instruction register to be executed
-     */
-    void decode(Memory& mem, Register& reg);
-    void setPC(int p);
-    void runInstruction(Memory& mem);
-    std::string getFromReg(const int& address);
-};
-
-class Machine
-{
-public:
-    CPU cpu;
-    Memory memory;
-    static std::string screenASCII;
-    static std::string screenHex;
-    Machine() {}
-
-    void loadProgram(const std::string& fileName, const std::string& startMem);
-    void printState();
-};
-
-class VoleMain
-{
-private:
-    void printMenu();
-    void takeInput();
-    void handleChoice(std::string& choice ,Memory& mem, Register& reg);
-
-public:
-    Machine machine;
-    VoleMain() {}
-
-    /**
-     * @brief This starts the whole machine
-     */
-    void init(Memory& mem , Register& reg);
-};
+#pragma once
+
+#include "devices.h"
+#include "screen.h"
+#include <cstdint>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+class ALU
+{
+private:
+    friend class JIT;
+    static std::uint8_t floatSums[256][256];
+public:
+    static std::string DecToHex(int num);
+    static int HexToDec(const std::string& num);
+    static std::string addHexInt(const std::string& n1, const std::string& n2);
+
+    /**
+     * @throws std::out_of_range if `num` is infinite or NaN
+     */
+    static std::string FloatToHex(float num);
+    static float HexToFloat(const std::string& num);
+    static std::string addHexFloat(const std::string& n1, const std::string& n2);
+
+    static std::string OR(const std::string& n1, const std::string& n2);
+    static std::string AND(const std::string& n1, const std::string& n2);
+    static std::string XOR(const std::string& n1, const std::string& n2);
+    static std::string rotate(const std::string& n1, const std::string& n2);
+
+    /**
+     * @brief Fills the 8-bit float addition table from `FloatToHex`, done once before `main`
+     */
+    static bool buildFloatSums();
+
+    /**
+     * @brief Byte kernels behind the hex string operations above, used by the CPU
+     */
+    static std::uint8_t addInt(std::uint8_t a, std::uint8_t b) { return static_cast<std::uint8_t>(a + b); }
+    static std::uint8_t addFloat(std::uint8_t a, std::uint8_t b) { return floatSums[a][b]; }
+    static std::uint8_t orBits(std::uint8_t a, std::uint8_t b) { return a | b; }
+    static std::uint8_t andBits(std::uint8_t a, std::uint8_t b) { return a & b; }
+    static std::uint8_t xorBits(std::uint8_t a, std::uint8_t b) { return a ^ b; }
+
+    /**
+     * @brief Rotates the bits of `a` to the right `x` times, so only `x` modulo 8 matters
+     */
+    static std::uint8_t rotateRight(std::uint8_t a, std::uint8_t x)
+    {
+        return static_cast<std::uint8_t>((a >> (x & 7)) | (a << ((8 - x) & 7)));
+    }
+};
+
+/**
+ * @brief The sizes that follow from the width of an address. An instruction is one byte of
+ *        opcode and R followed by an address operand, so it takes 2 bytes on the classic 8-bit
+ *        machine and 3 on wider ones. The cell count is always a power of two, addresses are
+ *        masked instead of checked
+ */
+template <int AddressBits>
+struct Geometry
+{
+    static_assert(AddressBits >= 8 && AddressBits <= 16, "Addresses are 8 to 16 bits wide");
+    typedef typename std::conditional<AddressBits <= 8, std::uint8_t, std::uint16_t>::type Address;
+    static constexpr int CELLS = 1 << AddressBits;
+    static constexpr int MASK = CELLS - 1;
+    static constexpr int ADDRESS_BYTES = (AddressBits + 7) / 8;
+    static constexpr int INSTRUCTION_SIZE = 1 + ADDRESS_BYTES;
+};
+
+template <int RegisterCount>
+class BasicRegister
+{
+private:
+    static_assert(RegisterCount >= 1 && RegisterCount <= 16, "Instructions address at most 16 registers");
+    friend class JIT;
+    friend class TraceRecorder;
+    friend class Profiler;
+    friend class Lockstep;
+    friend class Supervisor;
+    friend class History;
+    std::uint8_t registers[RegisterCount];
+public:
+    static constexpr int COUNT = RegisterCount;
+    BasicRegister() : registers{} {}
+
+    /**
+     * @brief With a power of two registers the index is masked, otherwise an index out of range throws
+     */
+    void setValue(const int& address, const std::uint8_t& value);
+    std::uint8_t getValue(const int& address) const;
+};
+
+/**
+ * @brief An instruction with its opcode and operands already unpacked, as cached by the memory
+ */
+template <typename Address>
+struct BasicDecodedInstruction
+{
+    std::uint8_t opcode;
+    std::uint8_t r;
+    Address a;
+    std::uint8_t b;
+};
+
+template <int AddressBits>
+class BasicMemory;
+
+/**
+ * @brief Decides whether a trapped instruction stops the machine, see `BasicMemory::setTraps`
+ */
+template <int AddressBits, int RegisterCount>
+class BasicTrapHandler
+{
+public:
+    typedef BasicDecodedInstruction<typename Geometry<AddressBits>::Address> Instruction;
+    virtual ~BasicTrapHandler() {}
+
+    /**
+     * @brief Called before the instruction `ins` at `pc` runs
+     * @return Whether to stop in front of it instead of running it
+     */
+    virtual bool stop(int pc, const Instruction& ins, const BasicRegister<RegisterCount>& reg,
+                      const BasicMemory<AddressBits>& mem) = 0;
+};
+
+template <int AddressBits>
+class BasicMemory
+{
+public:
+    typedef Geometry<AddressBits> Sizes;
+    typedef BasicDecodedInstruction<typename Sizes::Address> Instruction;
+    static constexpr int CELLS = Sizes::CELLS;
+
+private:
+    friend class JIT;
+    friend class TraceRecorder;
+    friend class Profiler;
+    friend class Lockstep;
+    friend class Supervisor;
+    friend class History;
+    std::uint8_t cells[CELLS];
+    Instruction decoded[CELLS];
+    std::uint8_t traps[CELLS];
+    int trapCount;
+
+    /**
+     * @brief The device table: `RAM`, `SCREEN_PORT`, or `FIRST_DEVICE` plus an index into `devices`
+     *        for every cell
+     */
+    std::uint8_t ports[CELLS];
+
+    /**
+     * @brief The number of cells whose port differs from the default, the screen at cell 0
+     */
+    int remappedPorts;
+    std::vector<std::shared_ptr<Device>> devices;
+
+    void setPort(int address, std::uint8_t port);
+public:
+    static const std::uint8_t UNDECODED = 0xFF;
+    static const std::uint8_t BREAK = 1;
+    static const std::uint8_t WATCH_READ = 2;
+    static const std::uint8_t WATCH_WRITE = 4;
+
+    static const std::uint8_t RAM = 0;
+    static const std::uint8_t SCREEN_PORT = 1;
+    static const std::uint8_t FIRST_DEVICE = 2;
+
+    BasicMemory() : cells{}, traps{}, trapCount(0), ports{SCREEN_PORT}, remappedPorts(0)
+    {
+        for (int i = 0; i < CELLS; ++i)
+        {
+            decoded[i].opcode = UNDECODED;
+        }
+    }
+    Screen screen;
+
+    /**
+     * @brief Reads the cell at `address` masked to the memory size
+     */
+    std::uint8_t getCell(const int& address) const { return cells[address & Sizes::MASK]; }
+
+    /**
+     * @brief Writes `value` into the cell at `address`, a write to a screen cell is also shown on
+     *        the screen. Other devices are bypassed, the RAM byte behind them is written
+     * @param address The index of the memory cell, masked to the memory size
+     * @param value The byte to be stored
+     */
+    void setCell(const int& address, const std::uint8_t& value);
+
+    /**
+     * @brief Writes `value` into the cell at `address` as plain RAM, whatever is mapped there.
+     *        This is the store of `3RXY`, which is decoded differently for cells with a device
+     */
+    void setRamCell(const int& address, const std::uint8_t& value)
+    {
+        int cell = address & Sizes::MASK;
+        cells[cell] = value;
+        for (int i = cell - Sizes::INSTRUCTION_SIZE + 1 < 0 ? 0 : cell - Sizes::INSTRUCTION_SIZE + 1; i <= cell; ++i)
+        {
+            decoded[i].opcode = UNDECODED;
+        }
+    }
+
+    /**
+     * @brief Copies `length` bytes into the cells starting at `address`, bypassing the screen
+     * @param address The index of the first memory cell
+     * @param data The bytes to be stored
+     * @param length The number of bytes
+     */
+    void load(const int& address, const std::uint8_t* data, const int& length);
+
+    /**
+     * @brief Sets every cell to 0 and clears the screen
+     */
+    void clear();
+
+    /**
+     * @brief Gives the predecoded slot of the instruction starting at `address`. The slot holds
+     *        `UNDECODED` until the CPU fills it and is reset whenever one of its cells is written
+     * @param address The index of the first cell of the instruction, the whole instruction must be in range
+     */
+    Instruction& decodedAt(const int& address) { return decoded[address]; }
+
+    /**
+     * @brief Sets the trap flags of `address`: `BREAK` on the instruction starting there,
+     *        `WATCH_READ`/`WATCH_WRITE` on `1RXY`/`3RXY` instructions using the cell. The flags are
+     *        looked at only when an instruction is predecoded, so all slots are reset here and
+     *        instructions without a trap run as fast as before. The flags survive `clear`
+     */
+    void setTraps(const int& address, const std::uint8_t& flags);
+    std::uint8_t getTraps(const int& address) const { return traps[address]; }
+    bool hasTraps() const { return trapCount != 0; }
+
+    /**
+     * @brief Whether the instruction `ins` starting at `address` hits one of the trap flags
+     */
+    bool trapped(const int& address, const Instruction& ins) const;
+
+    /**
+     * @brief Maps `device` over the cell at `address`, or makes it plain RAM again if `device` is
+     *        empty. Like traps, ports are looked at only when an instruction is predecoded, so
+     *        loads and stores of RAM cells cost nothing extra. The ports survive `clear`
+     * @throws std::out_of_range if the address is out of range
+     * @throws std::length_error if more than 253 distinct devices are mapped
+     */
+    void mapDevice(const int& address, std::shared_ptr<Device> device);
+
+    /**
+     * @brief Shows stores to the cell at `address` on the screen, as cell 0 does by default
+     */
+    void mapScreen(const int& address);
+
+    /**
+     * @brief Maps the default layout again: the screen at cell 0 and RAM everywhere else
+     */
+    void resetDevices();
+
+    std::uint8_t getPort(const int& address) const { return ports[address & Sizes::MASK]; }
+
+    /**
+     * @brief Whether anything else than the default screen at cell 0 is mapped
+     */
+    bool hasDevices() const { return remappedPorts != 0; }
+
+    /**
+     * @brief A load through the port of `address`, the RAM byte for the screen
+     */
+    std::uint8_t readPort(const int& address, std::uint64_t cycles)
+    {
+        int port = ports[address];
+        return port >= FIRST_DEVICE ? devices[port - FIRST_DEVICE]->read(address, cycles) : cells[address];
+    }
+
+    /**
+     * @brief A store through the port of `address`
+     */
+    void writePort(const int& address, const std::uint8_t& value, std::uint64_t cycles)
+    {
+        int port = ports[address];
+        if (port >= FIRST_DEVICE)
+        {
+            devices[port - FIRST_DEVICE]->write(address, value, cycles);
+            return;
+        }
+        setCell(address, value);
+    }
+};
+
+class CU
+{
+public:
+    CU() {}
+
+    template <class Registers, class Cells>
+    static void loadRegMem(Registers& reg, const int& regIdx, Cells& mem, const int& memIdx);
+
+     /**
+     * @brief Loads the value of the memory at the cell `memIdx` into the register at the index `regIdx`
+     * @param reg The register of the CPU
+     * @param regIdx The index of the register
+     * @param mem The memory of the machine
+     * @param memIdx The index of the memory cell
+     */
+    template <class Registers>
+    static void loadRegVal(Registers& reg, const int& regIdx, const int& val);
+
+    /**
+     * @brief Loads the value `val` in the register at the index `regIdx`
+     * @param reg The resgister of the CPU
+     * @param regIdx The index of the register
+     * @param val The value to be stored in the register at index `regIdx`
+     */
+    template <class Registers, class Cells>
+    static void store(Registers& reg, const int& regIDX, Cells& mem, const int& memIdx);
+
+    /**
+     * @brief Stores the value of the register at index `regIDX` into the RAM at the index `memIdx`
+     * @param reg The register of the CPU
+     * @param mem The memory of the machine
+     * @param regIdx The index of the register
+     * @param memIdx The index of the memory cell
+     */
+    template <class Registers>
+    static void move(Registers& reg, const int& regIdx1, const int& regIdx2);
+
+   /**
+     * @brief Moves the value of the register at index `regIdx1` to the register at index `regIdx2`
+     * @param reg The register of the CPU
+     * @param regIdx1 The index of the first register
+     * @param regIdx2 The index of the second register
+     */
+    template <class Registers>
+    static void jump(Registers& reg, const int& regIdx, const int& memIdx, int& PC);
+/**
+     * @brief Checks the value of the register at index `regIdx` with the register index 0, if they are equal the
+     *        execution of the program continues from the memory cell at index `memIdx`
+     * @param reg The register of the CPU
+     * @param regIdx The index of the register to be comapred with the register at index 0
+     * @param memIdx The index of the memory cell that will be executed if the 2 registers are equal
+     * @param PC The program counter of the CPU
+     */
+
+    /**
+     * @brief Stops the execution of the program
+     * @param isHalt The halt flag of the CPU
+     */
+    static void halt(bool& isHalt);
+};
+
+/**
+ * @brief How an instruction or a run ended, returned by the exception-free `BasicCPU::execute`
+ *        and `BasicCPU::run`
+ */
+struct RunStatus
+{
+    enum Code : std::uint8_t
+    {
+        RUNNING,
+        HALTED,
+        BAD_OPCODE,
+        PC_OVERFLOW,
+        BUDGET
+    };
+
+    /**
+     * @brief The message the throwing API uses for a fault, the state in words otherwise
+     */
+    static const char* describe(Code code);
+};
+
+template <int AddressBits, int RegisterCount>
+class BasicCPU
+{
+public:
+    typedef Geometry<AddressBits> Sizes;
+    typedef BasicRegister<RegisterCount> Register;
+    typedef BasicMemory<AddressBits> Memory;
+    typedef typename Memory::Instruction Instruction;
+
+private:
+    friend class TraceRecorder;
+    friend class Profiler;
+    friend class History;
+    typedef void (BasicCPU::*Handler)(Memory& mem, Register& reg);
+    static const Handler handlers[19];
+
+    ALU alu;
+    CU cu;
+    Instruction instruction;
+    int programCounter;
+
+    /**
+     * @brief Unpacks the opcode and register byte `hi` and the address operand `lo` into the
+     *        operands used by its opcode. Register operands come from the low byte of `lo`. With
+     *        fewer than 16 registers an instruction naming a missing one decodes as unknown, so
+     *        handlers never see a register index out of range
+     */
+    static Instruction predecode(std::uint8_t hi, typename Sizes::Address lo);
+
+    /**
+     * @brief Turns a predecoded store to a screen cell into `SCREEN`, and a load or store of a
+     *        device cell into `DEVICE` keeping its opcode in the unused `b`. Loads of screen cells
+     *        read RAM and stay as they are
+     */
+    static void routePorts(const Memory& mem, Instruction& ins)
+    {
+        if (ins.opcode != 0x1 && ins.opcode != 0x3)
+        {
+            return;
+        }
+        std::uint8_t port = mem.getPort(ins.a);
+        if (port >= Memory::FIRST_DEVICE)
+        {
+            ins.b = ins.opcode;
+            ins.opcode = DEVICE;
+        }
+        else if (port == Memory::SCREEN_PORT && ins.opcode == 0x3)
+        {
+            ins.opcode = SCREEN;
+        }
+    }
+
+    /**
+     * @brief Reads the big endian address operand starting at `address`
+     */
+    static typename Sizes::Address operandAt(const Memory& mem, int address);
+
+    /**
+     * @brief `fetch` without the exception
+     * @return False if the PC is negative or the instruction would run past the end of memory
+     */
+    bool tryFetch(Memory& mem);
+
+    void loadMemory(Memory& mem, Register& reg);
+    void loadValue(Memory& mem, Register& reg);
+    void storeMemory(Memory& mem, Register& reg);
+    void moveRegister(Memory& mem, Register& reg);
+    void addInt(Memory& mem, Register& reg);
+    void addFloat(Memory& mem, Register& reg);
+    void bitOr(Memory& mem, Register& reg);
+    void bitAnd(Memory& mem, Register& reg);
+    void bitXor(Memory& mem, Register& reg);
+    void rotate(Memory& mem, Register& reg);
+    void jumpEqual(Memory& mem, Register& reg);
+    void halt(Memory& mem, Register& reg);
+    void jumpGreater(Memory& mem, Register& reg);
+    void unknown(Memory& mem, Register& reg);
+    void trap(Memory& mem, Register& reg);
+    void device(Memory& mem, Register& reg);
+    void screenStore(Memory& mem, Register& reg);
+
+    /**
+     * @brief Puts the real instruction of a trapped slot into the instruction register and asks
+     *        the trap handler about it. If it runs, its loads and stores of ports are routed
+     * @return Whether the handler stopped the machine in front of it
+     */
+    bool stopsAtTrap(Memory& mem, Register& reg);
+
+    /**
+     * @brief A bit per opcode that has a handler, `execute` reports the others without dispatching
+     */
+    static const int KNOWN_OPCODES = 0x63FFE;
+public:
+    /**
+     * @brief The opcode given to predecoded slots of trapped instructions
+     */
+    static const std::uint8_t TRAP = 16;
+
+    /**
+     * @brief The opcode given to predecoded loads and stores of cells with a port
+     */
+    static const std::uint8_t DEVICE = 17;
+
+    /**
+     * @brief The opcode given to predecoded stores to screen cells
+     */
+    static const std::uint8_t SCREEN = 18;
+
+    Register reg;
+    bool isHalt;
+
+    /**
+     * @brief The instructions fetched since the machine was loaded, the clock of the devices.
+     *        Translated code of the JIT, which only runs without devices, does not count
+     */
+    std::uint64_t cycles;
+
+    /**
+     * @brief Asked about every trapped instruction. When it stops one the PC is left on it and
+     *        the halt flag is set, without one trapped instructions simply run. Copies of the
+     *        CPU share the handler
+     */
+    BasicTrapHandler<AddressBits, RegisterCount>* trapHandler;
+    BasicCPU() : instruction{}, programCounter(0), isHalt(false), cycles(0), trapHandler(nullptr) {}
+    /**
+     * @brief Gets the instruction to be executed from the memory using the
+     *        program counter and puts it in the instruction register
+     * @param mem The memory of the machine
+     * @throws std::overflow_error if the instruction would run past the end of memory
+     */
+    void fetch(Memory& mem);
+
+    /**
+     * @brief Decodes the instruction in the instruction register and executes it
+     *        through the handler table
+     * @throws std::runtime_error for an unknown instruction
+     */
+    void decode(Memory& mem, Register& reg);
+    void setPC(int p);
+    int getPC() const;
+    void runInstruction(Memory& mem);
+
+    /**
+     * @brief Runs one instruction like `runInstruction`, but reports a fault instead of throwing
+     *        it. The machine is left as `runInstruction` leaves it: past an unknown instruction,
+     *        on one that overflows the memory
+     * @return `HALTED` once the halt flag is set, by a halt or by a trap handler stopping in
+     *         front of an instruction, `RUNNING` otherwise, or the fault
+     */
+    RunStatus::Code execute(Memory& mem);
+
+    /**
+     * @brief Executes until the machine halts, faults or `steps` reaches `maxSteps`. Every
+     *        instruction that ran, a halt included, is added to `steps`, a trap handler stopping
+     *        in front of an instruction is not
+     * @return `HALTED`, `BUDGET` or the fault
+     */
+    RunStatus::Code run(Memory& mem, long long maxSteps, long long& steps);
+    std::uint8_t getFromReg(const int& address);
+};
+
+/**
+ * @brief A whole machine. `AddressBits` sets the memory to 2^AddressBits cells and the width of
+ *        the address operand of every instruction, `RegisterCount` the number of registers. The
+ *        classic Vole machine is `Machine`, `ExtendedMachine` has 65536 cells and 3-byte instructions
+ */
+template <int AddressBits, int RegisterCount>
+class BasicMachine
+{
+public:
+    typedef Geometry<AddressBits> Sizes;
+    typedef BasicCPU<AddressBits, RegisterCount> CPU;
+    typedef BasicMemory<AddressBits> Memory;
+
+    /**
+     * @brief Marks snapshots of this geometry, 0 for the classic machine
+     */
+    static constexpr std::uint8_t GEOMETRY = ((16 - RegisterCount) << 4) | (AddressBits - 8);
+
+    CPU cpu;
+    Memory memory;
+    BasicMachine() {}
+
+    /**
+     * @brief Loads a text program at `startMem`, an address of 2 hex digits per address byte
+     */
+    void loadProgram(const std::string& fileName, const std::string& startMem);
+
+    /**
+     * @brief Reads a text program, each instruction being 2 hex digits per instruction byte
+     *        (4 on the classic machine) separated by whitespace
+     * @return The program bytes in memory order
+     */
+    static std::vector<std::uint8_t> parseProgram(const std::string& fileName);
+
+    /**
+     * @brief Resets the machine and copies `length` program bytes to `loadAddress`, the PC is set to `startAddress`
+     */
+    void loadBytes(const std::uint8_t* program, int length, int loadAddress, int startAddress);
+
+    /**
+     * @brief Serializes the state between two instructions: "VOLS", version, PC, halt flag,
+     *        `GEOMETRY`, the higher PC bytes of a wider machine, the registers, the cells, a little
+     *        endian u32 length of the bytes the screen keeps, a little endian u64 count of all bytes
+     *        written to the screen, and the bytes the screen keeps. The screen's sink is not part of
+     *        the snapshot. `restore` also takes version 1 blobs, which lack the count
+     */
+    std::vector<std::uint8_t> snapshot() const;
+
+    /**
+     * @brief Like `snapshot`, replacing the content of `blob` so its capacity is reused
+     */
+    void snapshot(std::vector<std::uint8_t>& blob) const;
+
+    /**
+     * @brief Replaces the whole state with a blob made by `snapshot` on a machine of the same
+     *        geometry, the machine is left untouched if the blob is malformed
+     */
+    void restore(const std::uint8_t* data, std::size_t size);
+    void restore(const std::vector<std::uint8_t>& blob) { restore(blob.data(), blob.size()); }
+
+    /**
+     * @brief Clones the machine in process. The clone keeps the predecoded instructions, so it
+     *        runs on from the warmed-up state without decoding again
+     */
+    BasicMachine fork() const { return *this; }
+    void printState();
+};
+
+extern template class BasicRegister<16>;
+extern template class BasicMemory<8>;
+extern template class BasicCPU<8, 16>;
+extern template class BasicMachine<8, 16>;
+extern template class BasicMemory<16>;
+extern template class BasicCPU<16, 16>;
+extern template class BasicMachine<16, 16>;
+
+typedef BasicDecodedInstruction<std::uint8_t> DecodedInstruction;
+typedef BasicRegister<16> Register;
+typedef BasicMemory<8> Memory;
+typedef BasicTrapHandler<8, 16> TrapHandler;
+typedef BasicCPU<8, 16> CPU;
+typedef BasicMachine<8, 16> Machine;
+
+/**
+ * @brief 65536 cells for programs that outgrow the classic memory. At about half a megabyte it is
+ *        best kept on the heap
+ */
+typedef BasicMachine<16, 16> ExtendedMachine;
+
+class Debugger;
+class History;
+
+class VoleMain
+{
+private:
+    void printMenu();
+    void takeInput();
+    void handleChoice(std::string& choice ,Memory& mem, Register& reg);
+
+    /**
+     * @brief Reads one breakpoint or watchpoint command and applies it to `debugger`
+     */
+    void handleBreakpoints(Debugger& debugger);
+
+    /**
+     * @brief Reads a register, cell or "-" and runs `history` back to its last write or a breakpoint
+     */
+    void handleRunBack(History& history);
+
+public:
+    Machine machine;
+
+    /**
+     * @brief The instruction budget and wall-clock limit in seconds of options b and g, so a
+     *        program that never halts gives the menu back
+     */
+    long long maxSteps;
+    double timeout;
+
+    /**
+     * @brief The number of steps between two checkpoints of the history that options h and i
+     *        step back through, a larger interval keeps fewer snapshots but replays longer
+     */
+    long long checkpointInterval;
+    VoleMain() : maxSteps(1000000000), timeout(10), checkpointInterval(1 << 16) {}
+
+    /**
+     * @brief This starts the whole machine
+     */
+    void init(Memory& mem , Register& reg);
+};
@@ -0,0 +1,216 @@
+#include "debugger.h"
+#include "history.h"
+#include <stdexcept>
+
+static const char* const comparisonNames[7] = {"", "==", "!=", "<", "<=", ">", ">="};
+
+Debugger::Debugger(Machine& machine) : machine(machine), conditions{}, hit{NONE, -1, -1}, resumePc(-1)
+{
+    machine.cpu.trapHandler = this;
+}
+
+Debugger::~Debugger()
+{
+    clear();
+    machine.cpu.trapHandler = nullptr;
+}
+
+static void checkAddress(int address)
+{
+    if (address < 0 || address > 255)
+    {
+        throw std::out_of_range("Memory address is out of range");
+    }
+}
+
+void Debugger::setBreakpoint(int pc, Comparison comparison, int reg, std::uint8_t value)
+{
+    checkAddress(pc);
+    if (reg < 0 || reg > 15)
+    {
+        throw std::out_of_range("Register index is out of range");
+    }
+    conditions[pc] = Condition{comparison, static_cast<std::uint8_t>(reg), value};
+    machine.memory.setTraps(pc, machine.memory.getTraps(pc) | Memory::BREAK);
+}
+
+void Debugger::removeBreakpoint(int pc)
+{
+    checkAddress(pc);
+    conditions[pc] = Condition{};
+    machine.memory.setTraps(pc, machine.memory.getTraps(pc) & ~Memory::BREAK);
+}
+
+void Debugger::watch(int cell, bool read, bool write)
+{
+    checkAddress(cell);
+    std::uint8_t flags = machine.memory.getTraps(cell) & Memory::BREAK;
+    flags |= (read ? Memory::WATCH_READ : 0) | (write ? Memory::WATCH_WRITE : 0);
+    machine.memory.setTraps(cell, flags);
+}
+
+void Debugger::clear()
+{
+    for (int i = 0; i < 256; ++i)
+    {
+        if (machine.memory.getTraps(i))
+        {
+            machine.memory.setTraps(i, 0);
+        }
+        conditions[i] = Condition{};
+    }
+}
+
+Debugger::Comparison Debugger::parseComparison(const std::string& text)
+{
+    for (int i = EQUAL; i <= GREATER_EQUAL; ++i)
+    {
+        if (text == comparisonNames[i])
+        {
+            return static_cast<Comparison>(i);
+        }
+    }
+    throw std::invalid_argument("Unknown comparison " + text);
+}
+
+void Debugger::resume()
+{
+    if (hit.kind != NONE && machine.cpu.isHalt && machine.cpu.getPC() == hit.pc)
+    {
+        machine.cpu.isHalt = false;
+        resumePc = hit.pc;
+    }
+    hit = Hit{NONE, -1, -1};
+}
+
+void Debugger::step(History* history)
+{
+    resume();
+    try
+    {
+        if (history)
+        {
+            history->step(machine);
+        }
+        else
+        {
+            machine.cpu.runInstruction(machine.memory);
+        }
+    }
+    catch (...)
+    {
+        resumePc = -1;
+        throw;
+    }
+    resumePc = -1;
+}
+
+long long Debugger::run(long long maxSteps, History* history)
+{
+    resume();
+    long long steps = 0;
+    try
+    {
+        while (steps < maxSteps && !machine.cpu.isHalt)
+        {
+            if (history)
+            {
+                history->step(machine);
+            }
+            else
+            {
+                machine.cpu.runInstruction(machine.memory);
+            }
+            ++steps;
+        }
+    }
+    catch (...)
+    {
+        resumePc = -1;
+        throw;
+    }
+    resumePc = -1;
+    return hit.kind != NONE ? steps - 1 : steps;
+}
+
+std::string Debugger::describe() const
+{
+    switch (hit.kind)
+    {
+    case BREAKPOINT:
+        return "Breakpoint at " + ALU::DecToHex(hit.pc);
+    case READ:
+        return "Read of cell " + ALU::DecToHex(hit.cell) + " at " + ALU::DecToHex(hit.pc);
+    case WRITE:
+        return "Write of cell " + ALU::DecToHex(hit.cell) + " at " + ALU::DecToHex(hit.pc);
+    default:
+        return "";
+    }
+}
+
+void Debugger::list(std::ostream& out) const
+{
+    for (int i = 0; i < 256; ++i)
+    {
+        std::uint8_t flags = machine.memory.getTraps(i);
+        if (flags & Memory::BREAK)
+        {
+            out << "break " << ALU::DecToHex(i);
+            const Condition& condition = conditions[i];
+            if (condition.comparison != ALWAYS)
+            {
+                out << " if R" << std::hex << std::uppercase << int(condition.reg) << std::dec << ' '
+                    << comparisonNames[condition.comparison] << ' ' << ALU::DecToHex(condition.value);
+            }
+            out << '\n';
+        }
+        if (flags & (Memory::WATCH_READ | Memory::WATCH_WRITE))
+        {
+            out << "watch " << ALU::DecToHex(i) << ' ' << ((flags & Memory::WATCH_READ) ? "r" : "")
+                << ((flags & Memory::WATCH_WRITE) ? "w" : "") << '\n';
+        }
+    }
+}
+
+static bool holds(Debugger::Comparison comparison, std::uint8_t a, std::uint8_t b)
+{
+    switch (comparison)
+    {
+    case Debugger::EQUAL:
+        return a == b;
+    case Debugger::NOT_EQUAL:
+        return a != b;
+    case Debugger::LESS:
+        return a < b;
+    case Debugger::LESS_EQUAL:
+        return a <= b;
+    case Debugger::GREATER:
+        return a > b;
+    case Debugger::GREATER_EQUAL:
+        return a >= b;
+    default:
+        return true;
+    }
+}
+
+bool Debugger::stop(int pc, const DecodedInstruction& ins, const Register& reg, const Memory& mem)
+{
+    if (pc == resumePc)
+    {
+        resumePc = -1;
+        return false;
+    }
+    const Condition& condition = conditions[pc];
+    if ((mem.getTraps(pc) & Memory::BREAK) && holds(condition.comparison, reg.getValue(condition.reg), condition.value))
+    {
+        hit = Hit{BREAKPOINT, pc, -1};
+        return true;
+    }
+    if ((ins.opcode == 0x1 && (mem.getTraps(ins.a) & Memory::WATCH_READ))
+        || (ins.opcode == 0x3 && (mem.getTraps(ins.a) & Memory::WATCH_WRITE)))
+    {
+        hit = Hit{ins.opcode == 0x1 ? READ : WRITE, pc, ins.a};
+        return true;
+    }
+    return false;
+}
@@ -0,0 +1,126 @@
+#pragma once
+
+#include "class_T4.h"
+#include <cstdint>
+#include <ostream>
+#include <string>
+
+class History;
+
+/**
+ * @brief Breakpoints on PCs, optionally only while a register compares to a value, and read and
+ *        write watchpoints on cells. They live in the trap flags of the machine's memory, so code
+ *        without any of them runs at full speed and only a trapped instruction asks the debugger
+ *        whether to stop. A stop leaves the PC on the instruction and sets the halt flag
+ */
+class Debugger : public TrapHandler
+{
+public:
+    enum HitKind : std::uint8_t
+    {
+        NONE,
+        BREAKPOINT,
+        READ,
+        WRITE
+    };
+
+    enum Comparison : std::uint8_t
+    {
+        ALWAYS,
+        EQUAL,
+        NOT_EQUAL,
+        LESS,
+        LESS_EQUAL,
+        GREATER,
+        GREATER_EQUAL
+    };
+
+    /**
+     * @brief Where the last run stopped, `cell` is the watched cell of a `READ` or `WRITE` hit
+     */
+    struct Hit
+    {
+        HitKind kind;
+        int pc;
+        int cell;
+    };
+
+private:
+    struct Condition
+    {
+        Comparison comparison;
+        std::uint8_t reg;
+        std::uint8_t value;
+    };
+
+    Machine& machine;
+    Condition conditions[256];
+    Hit hit;
+    int resumePc;
+
+public:
+    /**
+     * @brief Becomes the trap handler of `machine`, which must outlive the debugger
+     */
+    explicit Debugger(Machine& machine);
+
+    /**
+     * @brief Removes all breakpoints and watchpoints and detaches from the machine
+     */
+    ~Debugger() override;
+    Debugger(const Debugger&) = delete;
+    Debugger& operator=(const Debugger&) = delete;
+
+    /**
+     * @brief Stops in front of the instruction at `pc`, with `comparison` other than `ALWAYS` only
+     *        while register `reg` compared to `value` holds, unsigned
+     */
+    void setBreakpoint(int pc, Comparison comparison = ALWAYS, int reg = 0, std::uint8_t value = 0);
+    void removeBreakpoint(int pc);
+
+    /**
+     * @brief Stops in front of `1RXY` (`read`) and `3RXY` (`write`) instructions using `cell`,
+     *        both false removes the watchpoint
+     */
+    void watch(int cell, bool read, bool write);
+    void clear();
+
+    /**
+     * @brief Reads "==", "!=", "<", "<=", ">" or ">="
+     * @throws std::invalid_argument for anything else
+     */
+    static Comparison parseComparison(const std::string& text);
+
+    /**
+     * @brief Lets the machine run past the instruction it stopped at, the next trap stops it again
+     */
+    void resume();
+
+    /**
+     * @brief Resumes and runs one instruction, faults propagate as exceptions
+     * @param history Records the instruction so it can be stepped back, if given
+     */
+    void step(History* history = nullptr);
+
+    /**
+     * @brief Resumes and runs until a breakpoint or watchpoint is hit, the machine halts or
+     *        `maxSteps` instructions ran. Faults propagate as exceptions
+     * @param history Records the instructions so they can be stepped back, if given
+     * @return The number of instructions executed
+     */
+    long long run(long long maxSteps, History* history = nullptr);
+
+    const Hit& lastHit() const { return hit; }
+
+    /**
+     * @brief The last hit in words, empty if the last run was not stopped by one
+     */
+    std::string describe() const;
+
+    /**
+     * @brief Prints every breakpoint and watchpoint
+     */
+    void list(std::ostream& out) const;
+
+    bool stop(int pc, const DecodedInstruction& ins, const Register& reg, const Memory& mem) override;
+};
@@ -0,0 +1,133 @@
+#include "devices.h"
+#include "batch.h"
+#include "class_T4.h"
+#include "screen.h"
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <stdexcept>
+
+void InputDevice::feedFile(const std::string& path)
+{
+    if (path == "-")
+    {
+        queue.insert(queue.end(), std::istreambuf_iterator<char>(std::cin), std::istreambuf_iterator<char>());
+        return;
+    }
+    std::ifstream fin(path, std::ios::binary);
+    if (!fin)
+    {
+        throw std::runtime_error("Cannot read " + path);
+    }
+    queue.insert(queue.end(), std::istreambuf_iterator<char>(fin), std::istreambuf_iterator<char>());
+}
+
+std::uint8_t InputDevice::read(int, std::uint64_t)
+{
+    if (queue.empty())
+    {
+        return 0;
+    }
+    std::uint8_t value = queue.front();
+    queue.pop_front();
+    return value;
+}
+
+int DeviceRunner::main(const std::vector<std::string>& args)
+{
+    long long maxSteps = 1000000;
+    std::vector<std::string> screens;
+    std::vector<std::pair<std::string, std::string>> inputs;
+    std::vector<std::string> counters;
+    std::vector<std::string> positional;
+    try
+    {
+        for (std::size_t i = 0; i < args.size(); ++i)
+        {
+            const std::string& arg = args[i];
+            bool hasValue = i + 1 < args.size();
+            if (arg == "--steps" && hasValue)
+            {
+                maxSteps = std::stoll(args[++i]);
+            }
+            else if (arg == "--screen" && hasValue)
+            {
+                screens.push_back(args[++i]);
+            }
+            else if (arg == "--input" && i + 2 < args.size())
+            {
+                inputs.emplace_back(args[i + 1], args[i + 2]);
+                i += 2;
+            }
+            else if (arg == "--counter" && hasValue)
+            {
+                counters.push_back(args[++i]);
+            }
+            else
+            {
+                positional.push_back(arg);
+            }
+        }
+    }
+    catch (const std::exception&)
+    {
+        std::cerr << "Invalid number argument\n";
+        return 2;
+    }
+    bool valid = !positional.empty() && positional.size() <= 2 && maxSteps >= 1
+                 && (positional.size() < 2 || BatchRunner::isHexByte(positional[1]));
+    for (const std::string& cell : screens)
+    {
+        valid = valid && BatchRunner::isHexByte(cell);
+    }
+    for (const auto& input : inputs)
+    {
+        valid = valid && BatchRunner::isHexByte(input.first);
+    }
+    for (const std::string& cell : counters)
+    {
+        valid = valid && BatchRunner::isHexByte(cell) && cell != "FF" && cell != "ff";
+    }
+    if (!valid)
+    {
+        std::cerr << "Usage: simulator --run [--steps n] [--screen XY]... [--input XY file]... [--counter XY]... "
+                     "program [XY]\n";
+        return 2;
+    }
+
+    Machine machine;
+    try
+    {
+        machine.loadProgram(positional[0], positional.size() > 1 ? positional[1] : "10");
+        for (const std::string& cell : screens)
+        {
+            machine.memory.mapScreen(std::stoi(cell, nullptr, 16));
+        }
+        for (const auto& input : inputs)
+        {
+            auto keyboard = std::make_shared<InputDevice>();
+            keyboard->feedFile(input.second);
+            machine.memory.mapDevice(std::stoi(input.first, nullptr, 16), keyboard);
+        }
+        for (const std::string& cell : counters)
+        {
+            int base = std::stoi(cell, nullptr, 16);
+            auto counter = std::make_shared<CounterDevice>(base);
+            machine.memory.mapDevice(base, counter);
+            machine.memory.mapDevice(base + 1, counter);
+        }
+    }
+    catch (const std::exception& e)
+    {
+        std::cerr << e.what() << '\n';
+        return 1;
+    }
+
+    auto sink = std::make_shared<ThreadedSink>(std::make_shared<FdSink>(1));
+    machine.memory.screen.setSink(sink);
+    long long steps = 0;
+    RunStatus::Code status = machine.cpu.run(machine.memory, maxSteps, steps);
+    sink->flush();
+    std::cerr << RunStatus::describe(status) << " after " << steps << " steps\n";
+    return status == RunStatus::HALTED ? 0 : 1;
+}
@@ -0,0 +1,85 @@
+#pragma once
+
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <string>
+#include <vector>
+
+/**
+ * @brief A device mapped over memory cells with `BasicMemory::mapDevice`. A `1RXY` load from one
+ *        of its cells gets what `read` returns and a `3RXY` store is passed to `write`, the RAM
+ *        byte behind the cell is left alone. Other ways of reading and writing memory, such as
+ *        `getCell`, `setCell` and snapshots, see only that RAM byte. Copies of a memory share its
+ *        devices, and devices are not synchronized, so machines running on different threads
+ *        need devices of their own
+ */
+class Device
+{
+public:
+    virtual ~Device() {}
+
+    /**
+     * @param cell The cell loaded from
+     * @param cycles The instructions the CPU fetched so far, this one included
+     */
+    virtual std::uint8_t read(int cell, std::uint64_t cycles) = 0;
+    virtual void write(int cell, std::uint8_t value, std::uint64_t cycles) = 0;
+};
+
+/**
+ * @brief A keyboard: every load takes the next byte of a queue, 0 once it is empty. Stores are ignored
+ */
+class InputDevice : public Device
+{
+private:
+    std::deque<std::uint8_t> queue;
+
+public:
+    void feed(const std::uint8_t* data, std::size_t length) { queue.insert(queue.end(), data, data + length); }
+    void feed(const std::string& text) { queue.insert(queue.end(), text.begin(), text.end()); }
+    std::size_t pending() const { return queue.size(); }
+
+    /**
+     * @brief Queues the whole content of a file, "-" for the standard input
+     * @throws std::runtime_error if the file cannot be read
+     */
+    void feedFile(const std::string& path);
+
+    std::uint8_t read(int, std::uint64_t) override;
+    void write(int, std::uint8_t, std::uint64_t) override {}
+};
+
+/**
+ * @brief A cycle counter over up to 8 cells: cell `base + i` reads byte i of the instructions
+ *        fetched since the count started, least significant first. A store to any of its cells
+ *        starts the count again from 0
+ */
+class CounterDevice : public Device
+{
+private:
+    int base;
+    std::uint64_t start;
+
+public:
+    explicit CounterDevice(int base) : base(base), start(0) {}
+
+    std::uint8_t read(int cell, std::uint64_t cycles) override
+    {
+        return static_cast<std::uint8_t>((cycles - start) >> (8 * ((cell - base) & 7)));
+    }
+    void write(int, std::uint8_t, std::uint64_t cycles) override { start = cycles; }
+};
+
+/**
+ * @brief Entry point of `--run`: runs one program with the screen streamed to the standard output
+ *        and the devices given on the command line mapped
+ */
+class DeviceRunner
+{
+public:
+    /**
+     * @return The process exit code
+     */
+    static int main(const std::vector<std::string>& args);
+};
@@ -0,0 +1,513 @@
+#include "explorer.h"
+#include "batch.h"
+#include "cache.h"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <map>
+#include <stdexcept>
+#include <thread>
+
+static const int ON_PATH = -2;
+static const int UNKNOWN = -1;
+
+/**
+ * @brief Calls `work(thread, i)` for every i below `count`, spread over up to `threads` threads in
+ *        chunks. Small counts run on the calling thread alone
+ */
+template <typename Work>
+static void forEach(int threads, long long count, Work work)
+{
+    const long long chunk = 64;
+    int used = static_cast<int>(std::min<long long>(threads, (count + chunk - 1) / chunk));
+    std::atomic<long long> next{0};
+    auto loop = [&](int thread) {
+        for (long long begin = next.fetch_add(chunk); begin < count; begin = next.fetch_add(chunk))
+        {
+            for (long long i = begin; i < std::min(count, begin + chunk); ++i)
+            {
+                work(thread, i);
+            }
+        }
+    };
+    std::vector<std::thread> pool;
+    for (int thread = 1; thread < used; ++thread)
+    {
+        pool.emplace_back(loop, thread);
+    }
+    loop(0);
+    for (std::thread& thread : pool)
+    {
+        thread.join();
+    }
+}
+
+static int hexDigits(const std::string& text)
+{
+    std::size_t used = 0;
+    int value = std::stoi(text, &used, 16);
+    if (used != text.size() || text.empty())
+    {
+        throw std::invalid_argument(text);
+    }
+    return value;
+}
+
+Explorer::Input Explorer::Input::parse(const std::string& text)
+{
+    Input input{false, 0, 0, 255};
+    std::string location = text.substr(0, text.find('='));
+    try
+    {
+        if (location.size() == 2 && (location[0] == 'R' || location[0] == 'r'))
+        {
+            input.index = hexDigits(location.substr(1));
+        }
+        else if (location.size() == 3 && (location[0] == 'M' || location[0] == 'm'))
+        {
+            input.cell = true;
+            input.index = hexDigits(location.substr(1));
+        }
+        else
+        {
+            throw std::invalid_argument(text);
+        }
+        if (location.size() < text.size())
+        {
+            std::string range = text.substr(location.size() + 1);
+            std::size_t dash = range.find('-');
+            input.low = hexDigits(range.substr(0, dash));
+            input.high = dash == std::string::npos ? input.low : hexDigits(range.substr(dash + 1));
+        }
+    }
+    catch (const std::exception&)
+    {
+        throw std::invalid_argument("Expected Rn or MXY, optionally =LO-HI, instead of " + text);
+    }
+    if (input.low > input.high || input.high > 255)
+    {
+        throw std::invalid_argument("Invalid range in " + text);
+    }
+    return input;
+}
+
+std::string Explorer::Input::name() const
+{
+    return cell ? "M" + ALU::DecToHex(index) : "R" + ALU::DecToHex(index).substr(1);
+}
+
+Explorer::Explorer(const Machine& start, const std::vector<Input>& inputs, int threads, long long maxStates)
+    : start(start), inputs(inputs), threads(std::max(1, threads)), maxStates(maxStates), inputCount(1), stateCount(0),
+      complete(true)
+{
+    if (start.memory.hasDevices())
+    {
+        throw std::invalid_argument("Devices make runs depend on more than the inputs");
+    }
+    for (const Input& input : inputs)
+    {
+        inputCount *= input.high - input.low + 1;
+        if (inputCount > (1 << 24))
+        {
+            throw std::invalid_argument("The inputs make more than 2^24 combinations");
+        }
+    }
+}
+
+void Explorer::encode(const Machine& machine, std::uint8_t* state)
+{
+    state[0] = static_cast<std::uint8_t>(machine.cpu.getPC());
+    state[1] = machine.cpu.isHalt;
+    for (int i = 0; i < 16; ++i)
+    {
+        state[2 + i] = machine.cpu.reg.getValue(i);
+    }
+    for (int i = 0; i < 256; ++i)
+    {
+        state[18 + i] = machine.memory.getCell(i);
+    }
+}
+
+void Explorer::decode(const std::uint8_t* state, Machine& machine)
+{
+    machine.cpu.setPC(state[0]);
+    machine.cpu.isHalt = state[1] != 0;
+    for (int i = 0; i < 16; ++i)
+    {
+        machine.cpu.reg.setValue(i, state[2 + i]);
+    }
+    machine.memory.load(0, state + 18, 256);
+}
+
+Explorer::NodeId Explorer::visit(const std::uint8_t* state, bool& inserted)
+{
+    ResultCache::Digest digest = ResultCache::digest(state, STATE_SIZE);
+    int shardIndex = static_cast<int>(digest.high >> 58);
+    Shard& shard = shards[shardIndex];
+    std::lock_guard<std::mutex> hold(shard.lock);
+    if (shard.slots.empty())
+    {
+        shard.slots.resize(1024, Slot{0, 0, 0});
+    }
+    std::size_t mask = shard.slots.size() - 1;
+    std::size_t i = digest.low & mask;
+    for (; shard.slots[i].node; i = (i + 1) & mask)
+    {
+        if (shard.slots[i].low == digest.low && shard.slots[i].high == digest.high)
+        {
+            inserted = false;
+            return static_cast<NodeId>(shardIndex) << 32 | (shard.slots[i].node - 1);
+        }
+    }
+    if (stateCount.fetch_add(1) >= maxStates)
+    {
+        --stateCount;
+        inserted = false;
+        return TERMINAL;
+    }
+    std::uint32_t local = static_cast<std::uint32_t>(shard.links.size());
+    shard.links.push_back(TERMINAL | UNEXPLORED);
+    shard.pcs.push_back(state[0]);
+    shard.slots[i] = Slot{digest.high, digest.low, local + 1};
+    if (++shard.used * 2 > shard.slots.size())
+    {
+        std::vector<Slot> old(shard.slots.size() * 2, Slot{0, 0, 0});
+        old.swap(shard.slots);
+        mask = shard.slots.size() - 1;
+        for (const Slot& slot : old)
+        {
+            if (slot.node)
+            {
+                std::size_t j = slot.low & mask;
+                while (shard.slots[j].node)
+                {
+                    j = (j + 1) & mask;
+                }
+                shard.slots[j] = slot;
+            }
+        }
+    }
+    inserted = true;
+    return static_cast<NodeId>(shardIndex) << 32 | local;
+}
+
+void Explorer::link(NodeId node, std::uint64_t next)
+{
+    Shard& shard = shards[node >> 32];
+    std::lock_guard<std::mutex> hold(shard.lock);
+    shard.links[node & 0xFFFFFFFF] = next;
+}
+
+void Explorer::expand(Machine& machine, NodeId node, const std::uint8_t* state, std::vector<std::uint8_t>& next,
+                      std::vector<NodeId>& nextNodes)
+{
+    decode(state, machine);
+    for (;;)
+    {
+        int pc = machine.cpu.getPC();
+        int opcode = pc < 256 ? machine.memory.getCell(pc) >> 4 : 0;
+        RunStatus::Code code = machine.cpu.execute(machine.memory);
+        if (code == RunStatus::BAD_OPCODE || code == RunStatus::PC_OVERFLOW)
+        {
+            link(node, TERMINAL | (code == RunStatus::BAD_OPCODE ? BAD_OPCODE : PC_OVERFLOW) | static_cast<std::uint64_t>(pc) << 8);
+            return;
+        }
+        if (code == RunStatus::HALTED || opcode == 0xB || opcode == 0xD)
+        {
+            std::size_t offset = next.size();
+            next.resize(offset + STATE_SIZE);
+            encode(machine, next.data() + offset);
+            bool inserted = false;
+            NodeId reached = visit(next.data() + offset, inserted);
+            if (reached == TERMINAL)
+            {
+                link(node, TERMINAL | UNEXPLORED | static_cast<std::uint64_t>(pc) << 8);
+            }
+            else
+            {
+                link(node, reached);
+            }
+            if (inserted && code == RunStatus::HALTED)
+            {
+                Shard& shard = shards[reached >> 32];
+                std::lock_guard<std::mutex> hold(shard.lock);
+                shard.links[reached & 0xFFFFFFFF] = TERMINAL | HALTED | static_cast<std::uint64_t>(pc) << 8;
+                std::array<std::uint8_t, 16>& registers = shard.halts[static_cast<std::uint32_t>(reached)];
+                std::copy(next.data() + offset + 2, next.data() + offset + 18, registers.begin());
+            }
+            if (inserted && code != RunStatus::HALTED)
+            {
+                nextNodes.push_back(reached);
+            }
+            else
+            {
+                next.resize(offset);
+            }
+            return;
+        }
+    }
+}
+
+void Explorer::run()
+{
+    std::vector<Machine> machines(threads, start);
+    std::vector<std::vector<std::uint8_t>> nexts(threads);
+    std::vector<std::vector<NodeId>> nextNodes(threads);
+
+    std::uint8_t base[STATE_SIZE];
+    encode(start, base);
+    base[1] = 0;
+    inputNodes.assign(static_cast<std::size_t>(inputCount), TERMINAL);
+    forEach(threads, inputCount, [&](int thread, long long index) {
+        std::uint8_t state[STATE_SIZE];
+        std::memcpy(state, base, STATE_SIZE);
+        long long rest = index;
+        for (const Input& input : inputs)
+        {
+            int span = input.high - input.low + 1;
+            state[(input.cell ? 18 : 2) + input.index] = static_cast<std::uint8_t>(input.low + rest % span);
+            rest /= span;
+        }
+        bool inserted = false;
+        NodeId node = visit(state, inserted);
+        inputNodes[index] = node;
+        if (inserted)
+        {
+            expand(machines[thread], node, state, nexts[thread], nextNodes[thread]);
+        }
+    });
+
+    std::vector<std::uint8_t> frontier;
+    std::vector<NodeId> frontierNodes;
+    for (;;)
+    {
+        frontier.clear();
+        frontierNodes.clear();
+        for (int thread = 0; thread < threads; ++thread)
+        {
+            frontier.insert(frontier.end(), nexts[thread].begin(), nexts[thread].end());
+            frontierNodes.insert(frontierNodes.end(), nextNodes[thread].begin(), nextNodes[thread].end());
+            nexts[thread].clear();
+            nextNodes[thread].clear();
+        }
+        if (frontierNodes.empty())
+        {
+            break;
+        }
+        forEach(threads, static_cast<long long>(frontierNodes.size()), [&](int thread, long long i) {
+            expand(machines[thread], frontierNodes[i], frontier.data() + i * STATE_SIZE, nexts[thread], nextNodes[thread]);
+        });
+    }
+    classify();
+}
+
+void Explorer::classify()
+{
+    std::vector<int> marks[SHARDS];
+    for (int i = 0; i < SHARDS; ++i)
+    {
+        marks[i].assign(shards[i].links.size(), UNKNOWN);
+    }
+    std::map<std::uint64_t, int> known;
+    auto outcome = [&](OutcomeKind kind, int pc, std::uint64_t key) {
+        auto found = known.find(key);
+        if (found != known.end())
+        {
+            return found->second;
+        }
+        Outcome created{kind, pc, 0, {}, {}};
+        results.push_back(created);
+        return known[key] = static_cast<int>(results.size() - 1);
+    };
+
+    std::vector<NodeId> path;
+    results.clear();
+    complete = true;
+    for (long long index = 0; index < inputCount; ++index)
+    {
+        NodeId node = inputNodes[index];
+        int result;
+        if (node == TERMINAL)
+        {
+            result = outcome(UNEXPLORED, 0, static_cast<std::uint64_t>(UNEXPLORED) << 56);
+        }
+        else
+        {
+            path.clear();
+            for (;;)
+            {
+                int& mark = marks[node >> 32][node & 0xFFFFFFFF];
+                if (mark >= 0)
+                {
+                    result = mark;
+                    break;
+                }
+                if (mark == ON_PATH)
+                {
+                    int pc = shards[node >> 32].pcs[node & 0xFFFFFFFF];
+                    result = outcome(CYCLE, pc, static_cast<std::uint64_t>(CYCLE) << 56 | pc);
+                    break;
+                }
+                mark = ON_PATH;
+                path.push_back(node);
+                std::uint64_t next = shards[node >> 32].links[node & 0xFFFFFFFF];
+                if (!(next & TERMINAL))
+                {
+                    node = next;
+                    continue;
+                }
+                OutcomeKind kind = static_cast<OutcomeKind>(next & 0xFF);
+                int pc = static_cast<int>((next >> 8) & 0xFF);
+                result = outcome(kind, pc, static_cast<std::uint64_t>(kind) << 56 | (kind == UNEXPLORED ? 0 : pc));
+                if (kind == HALTED && results[result].inputs == 0)
+                {
+                    const auto& registers = shards[node >> 32].halts[static_cast<std::uint32_t>(node)];
+                    std::copy(registers.begin(), registers.end(), results[result].registers);
+                }
+                break;
+            }
+            for (NodeId visited : path)
+            {
+                marks[visited >> 32][visited & 0xFFFFFFFF] = result;
+            }
+        }
+
+        Outcome& entry = results[result];
+        if (entry.inputs++ == 0)
+        {
+            long long rest = index;
+            for (const Input& input : inputs)
+            {
+                int span = input.high - input.low + 1;
+                entry.example.push_back(static_cast<std::uint8_t>(input.low + rest % span));
+                rest /= span;
+            }
+        }
+        complete = complete && entry.kind != UNEXPLORED;
+    }
+}
+
+void Explorer::report(std::ostream& out) const
+{
+    out << "Explored " << states() << " states from " << inputCount << " inputs"
+        << (complete ? "" : ", stopped at the state limit") << '\n';
+    const std::size_t shown = 32;
+    for (std::size_t i = 0; i < results.size() && i < shown; ++i)
+    {
+        const Outcome& outcome = results[i];
+        switch (outcome.kind)
+        {
+        case HALTED:
+            out << "Halted at ";
+            break;
+        case BAD_OPCODE:
+        case PC_OVERFLOW:
+            out << RunStatus::describe(outcome.kind == BAD_OPCODE ? RunStatus::BAD_OPCODE : RunStatus::PC_OVERFLOW) << " at ";
+            break;
+        case CYCLE:
+            out << "Endless loop entered at ";
+            break;
+        default:
+            out << "Unexplored";
+            break;
+        }
+        if (outcome.kind != UNEXPLORED)
+        {
+            out << ALU::DecToHex(outcome.pc);
+        }
+        out << " for " << outcome.inputs << " input" << (outcome.inputs == 1 ? "" : "s");
+        for (std::size_t j = 0; j < inputs.size(); ++j)
+        {
+            out << (j ? " " : ", e.g. ") << inputs[j].name() << '=' << ALU::DecToHex(outcome.example[j]);
+        }
+        if (outcome.kind == HALTED)
+        {
+            out << "\n   ";
+            for (int r = 0; r < 16; ++r)
+            {
+                out << ' ' << ALU::DecToHex(outcome.registers[r]);
+            }
+        }
+        out << '\n';
+    }
+    if (results.size() > shown)
+    {
+        out << "... and " << results.size() - shown << " more outcomes\n";
+    }
+}
+
+int Explorer::main(const std::vector<std::string>& args)
+{
+    int threads = static_cast<int>(std::thread::hardware_concurrency());
+    long long maxStates = 1 << 20;
+    std::vector<std::string> positional;
+    try
+    {
+        for (std::size_t i = 0; i < args.size(); ++i)
+        {
+            const std::string& arg = args[i];
+            bool hasValue = i + 1 < args.size();
+            if ((arg == "-j" || arg == "--threads") && hasValue)
+            {
+                threads = std::stoi(args[++i]);
+            }
+            else if (arg == "--states" && hasValue)
+            {
+                maxStates = std::stoll(args[++i]);
+            }
+            else
+            {
+                positional.push_back(arg);
+            }
+        }
+    }
+    catch (const std::exception&)
+    {
+        std::cerr << "Invalid number argument\n";
+        return 2;
+    }
+    if (positional.empty())
+    {
+        std::cerr << "Usage: simulator --explore [-j threads] [--states n] program [XY] input...\n"
+                  << "Inputs: Rn or MXY, all 256 values, or Rn=LO-HI and MXY=LO-HI, in hex\n";
+        return 2;
+    }
+
+    Machine machine;
+    std::vector<Input> inputs;
+    try
+    {
+        std::size_t first = 1;
+        std::string startMem = "10";
+        if (positional.size() > 1 && BatchRunner::isHexByte(positional[1]))
+        {
+            startMem = positional[1];
+            first = 2;
+        }
+        machine.loadProgram(positional[0], startMem);
+        for (std::size_t i = first; i < positional.size(); ++i)
+        {
+            inputs.push_back(Input::parse(positional[i]));
+        }
+        Explorer explorer(machine, inputs, threads, maxStates);
+        auto start = std::chrono::steady_clock::now();
+        explorer.run();
+        double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        explorer.report(std::cout);
+        std::cout << "Took " << elapsed << " s\n";
+        for (const Outcome& outcome : explorer.outcomes())
+        {
+            if (outcome.kind != HALTED)
+            {
+                return 1;
+            }
+        }
+        return 0;
+    }
+    catch (const std::exception& e)
+    {
+        std::cerr << e.what() << '\n';
+        return 2;
+    }
+}
@@ -0,0 +1,172 @@
+#pragma once
+
+#include "class_T4.h"
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * @brief Checks a program for every value of some registers and cells at once. Each combination
+ *        of input values is a start state, and the states reachable from all of them are searched
+ *        breadth first on several threads, every distinct state being expanded only once, so
+ *        inputs whose runs meet are followed together from there on.
+ *
+ *        A run is deterministic, so each state has one successor. States are only recorded after
+ *        a `B` or `D` instruction, since every endless run executes those forever, which keeps the
+ *        search to one state per jump. A recorded state is its PC, halt flag, registers and memory
+ *        (not the screen), kept in the visited set as a 128-bit hash of those 274 bytes. Sets of
+ *        inputs are reported by where they end: a halt, unknown instruction or PC overflow at
+ *        some PC, a cycle of states that repeats forever, or a state left unexplored because the
+ *        state limit was reached
+ */
+class Explorer
+{
+public:
+    /**
+     * @brief A register or cell taking every value from `low` to `high`
+     */
+    struct Input
+    {
+        bool cell;
+        int index;
+        int low;
+        int high;
+
+        /**
+         * @brief Reads "Rn" for register n or "MXY" for cell XY, in hex, optionally followed by
+         *        "=LO-HI" to restrict the range
+         * @throws std::invalid_argument if the text is neither
+         */
+        static Input parse(const std::string& text);
+        std::string name() const;
+    };
+
+    enum OutcomeKind : std::uint8_t
+    {
+        HALTED,
+        BAD_OPCODE,
+        PC_OVERFLOW,
+        CYCLE,
+        UNEXPLORED
+    };
+
+    /**
+     * @brief The inputs ending one way, `pc` being where it happened or where the cycle is entered,
+     *        `example` the values of the first such input in input order
+     */
+    struct Outcome
+    {
+        OutcomeKind kind;
+        int pc;
+        long long inputs;
+        std::vector<std::uint8_t> example;
+
+        /**
+         * @brief The registers after the example halted
+         */
+        std::uint8_t registers[16];
+    };
+
+    static const std::size_t STATE_SIZE = 274;
+
+private:
+    typedef std::uint64_t NodeId;
+    static const int SHARDS = 64;
+
+    /**
+     * @brief `TERMINAL` set: the run ends with the `OutcomeKind` in bits 0-7 at the PC in bits
+     *        8-15. Otherwise the id of the next recorded state
+     */
+    static constexpr std::uint64_t TERMINAL = 1ULL << 63;
+
+    struct Slot
+    {
+        std::uint64_t high;
+        std::uint64_t low;
+        std::uint32_t node;
+    };
+
+    struct alignas(64) Shard
+    {
+        std::mutex lock;
+        std::vector<Slot> slots;
+        std::size_t used = 0;
+        std::vector<std::uint64_t> links;
+        std::vector<std::uint8_t> pcs;
+        
+        /**
+         * @brief The registers of each halted state by its local id
+         */
+        std::unordered_map<std::uint32_t, std::array<std::uint8_t, 16>> halts;
+    };
+
+    Machine start;
+    std::vector<Input> inputs;
+    int threads;
+    long long maxStates;
+    long long inputCount;
+
+    Shard shards[SHARDS];
+    std::atomic<long long> stateCount;
+    std::vector<NodeId> inputNodes;
+    std::vector<Outcome> results;
+    bool complete;
+
+    /**
+     * @brief Adds the state encoded at `state` to the visited set
+     * @param inserted Set if it was not there yet
+     * @return Its id, or `TERMINAL` if it is new and the state limit is reached
+     */
+    NodeId visit(const std::uint8_t* state, bool& inserted);
+    void link(NodeId node, std::uint64_t next);
+
+    static void encode(const Machine& machine, std::uint8_t* state);
+    static void decode(const std::uint8_t* state, Machine& machine);
+
+    /**
+     * @brief Runs the state of `node` up to the next recorded state or the end of the run, appending
+     *        that state to `next` if it is new
+     */
+    void expand(Machine& machine, NodeId node, const std::uint8_t* state, std::vector<std::uint8_t>& next,
+                std::vector<NodeId>& nextNodes);
+
+    /**
+     * @brief Follows the links of every state to its end and groups the inputs by it
+     */
+    void classify();
+
+public:
+    /**
+     * @param start The loaded machine, the inputs are written into it
+     * @param threads The number of worker threads, at least 1
+     * @param maxStates The number of states after which no new ones are expanded
+     * @throws std::invalid_argument if the inputs make more than 2^24 combinations or `start`
+     *         has devices mapped
+     */
+    Explorer(const Machine& start, const std::vector<Input>& inputs, int threads, long long maxStates);
+    Explorer(const Explorer&) = delete;
+    Explorer& operator=(const Explorer&) = delete;
+
+    void run();
+
+    const std::vector<Outcome>& outcomes() const { return results; }
+    long long states() const { return stateCount; }
+
+    /**
+     * @brief False if the state limit left some states unexplored
+     */
+    bool isComplete() const { return complete; }
+
+    void report(std::ostream& out) const;
+
+    /**
+     * @brief Entry point of `--explore`, parses the command line arguments following it
+     * @return The process exit code
+     */
+    static int main(const std::vector<std::string>& args);
+};
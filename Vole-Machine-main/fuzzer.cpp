@@ -0,0 +1,558 @@
+#include "fuzzer.h"
+#include "batch.h"
+#include <chrono>
+#include <cmath>
+#include <csignal>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <random>
+#include <stdexcept>
+#include <system_error>
+#include <thread>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <unistd.h>
+#define VOLE_FUZZ_SIGNALS 1
+#else
+#define VOLE_FUZZ_SIGNALS 0
+#endif
+
+static const int PC_BYTE = 0;
+static const int REGISTER_BYTES = 1;
+static const int CELL_BYTES = 17;
+
+#if VOLE_FUZZ_SIGNALS
+static char crashPath[4096];
+static thread_local const std::uint8_t* crashInput = nullptr;
+
+/**
+ * @brief Writes the input of the crashing worker with async-signal-safe calls only, then lets the
+ *        default action end the process
+ */
+static void onCrash(int signal)
+{
+    if (crashInput)
+    {
+        int fd = open(crashPath, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (fd >= 0)
+        {
+            ssize_t written = write(fd, crashInput, Fuzzer::INPUT_SIZE);
+            (void)written;
+            close(fd);
+        }
+        static const char message[] = "Crashed, the input is in the findings directory as crash\n";
+        ssize_t written = write(2, message, sizeof(message) - 1);
+        (void)written;
+    }
+    std::signal(signal, SIG_DFL);
+    std::raise(signal);
+}
+#endif
+
+static std::string hex32(std::uint32_t value)
+{
+    return ALU::DecToHex(value >> 24) + ALU::DecToHex(value >> 16) + ALU::DecToHex(value >> 8) + ALU::DecToHex(value);
+}
+
+/**
+ * @brief Applies 1 to 8 random changes to `input`, some of them shaped like Vole instructions
+ *        so the mutated programs get past their first fetch. `other` is spliced from
+ */
+static void mutate(std::vector<std::uint8_t>& input, const std::vector<std::uint8_t>& other, std::mt19937& random)
+{
+    static const std::uint8_t interesting[] = {0x00, 0x01, 0x02, 0x07, 0x08, 0x0F, 0x10, 0x7F, 0x80, 0xFE, 0xFF};
+    int changes = 1 << (random() % 4);
+    for (int change = 0; change < changes; ++change)
+    {
+        std::size_t at = random() % Fuzzer::INPUT_SIZE;
+        std::size_t instruction = CELL_BYTES + 2 * (random() % 128);
+        switch (random() % 8)
+        {
+        case 0:
+            input[at] ^= static_cast<std::uint8_t>(1 << (random() % 8));
+            break;
+        case 1:
+            input[at] = static_cast<std::uint8_t>(random());
+            break;
+        case 2:
+            input[at] = interesting[random() % sizeof(interesting)];
+            break;
+        case 3:
+            input[instruction] = static_cast<std::uint8_t>((1 + random() % 13) << 4 | (random() % 16));
+            input[instruction + 1] = static_cast<std::uint8_t>(random());
+            break;
+        case 4:
+            input[instruction] = static_cast<std::uint8_t>((random() % 2 ? 0xB0 : 0xD0) | (random() % 16));
+            input[instruction + 1] = static_cast<std::uint8_t>(2 * (random() % 128));
+            break;
+        case 5:
+            input[PC_BYTE] = static_cast<std::uint8_t>(2 * (random() % 128));
+            break;
+        case 6:
+        {
+            std::size_t length = std::min<std::size_t>(2 + random() % 31, Fuzzer::INPUT_SIZE - at);
+            std::memcpy(input.data() + at, other.data() + at, length);
+            break;
+        }
+        default:
+            input[REGISTER_BYTES + random() % 16] = static_cast<std::uint8_t>(random());
+            break;
+        }
+    }
+}
+
+Fuzzer::Fuzzer(const std::vector<std::vector<std::uint8_t>>& seeds, int threads, long long maxSteps, std::uint32_t seed,
+               const std::string& findingsDir)
+    : threads(std::max(1, threads)), maxSteps(maxSteps), seed(seed), findingsDir(findingsDir),
+      edges(new std::atomic<std::uint8_t>[EDGES]), edgeCount(0), corpus(seeds), stopping(false)
+{
+    for (int i = 0; i < EDGES; ++i)
+    {
+        edges[i].store(0, std::memory_order_relaxed);
+    }
+    for (const std::vector<std::uint8_t>& input : corpus)
+    {
+        if (input.size() != INPUT_SIZE)
+        {
+            throw std::invalid_argument("A seed input is not " + std::to_string(INPUT_SIZE) + " bytes");
+        }
+    }
+    if (corpus.empty())
+    {
+        corpus.emplace_back(INPUT_SIZE, 0);
+    }
+    if (!findingsDir.empty())
+    {
+        std::error_code error;
+        std::filesystem::create_directories(findingsDir, error);
+        if (!std::filesystem::is_directory(findingsDir))
+        {
+            throw std::runtime_error("Failed to create " + findingsDir);
+        }
+    }
+}
+
+std::vector<std::uint8_t> Fuzzer::inputOf(const Machine& machine)
+{
+    std::vector<std::uint8_t> input(INPUT_SIZE);
+    input[PC_BYTE] = static_cast<std::uint8_t>(machine.cpu.getPC());
+    for (int i = 0; i < 16; ++i)
+    {
+        input[REGISTER_BYTES + i] = machine.cpu.reg.getValue(i);
+    }
+    for (int i = 0; i < 256; ++i)
+    {
+        input[CELL_BYTES + i] = machine.memory.getCell(i);
+    }
+    return input;
+}
+
+void Fuzzer::apply(const std::vector<std::uint8_t>& input, Machine& machine)
+{
+    machine.cpu.setPC(input[PC_BYTE]);
+    machine.cpu.isHalt = false;
+    for (int i = 0; i < 16; ++i)
+    {
+        machine.cpu.reg.setValue(i, input[REGISTER_BYTES + i]);
+    }
+    machine.memory.load(0, input.data() + CELL_BYTES, 256);
+    machine.memory.screen.clear();
+}
+
+std::string Fuzzer::checkAlu(const std::vector<std::uint8_t>& input, std::string& detail)
+{
+    // Registers 0 and 1 are rotated, the whole byte is the count
+    int a = input[REGISTER_BYTES];
+    int x = input[REGISTER_BYTES + 1];
+    std::string rotated = ALU::rotate(ALU::DecToHex(a), ALU::DecToHex(x));
+    int n = x % 8;
+    std::string expected = ALU::DecToHex(((a >> n) | (a << (8 - n))) & 0xFF);
+    if (rotated != expected)
+    {
+        detail = "ALU::rotate(" + ALU::DecToHex(a) + ", " + ALU::DecToHex(x) + ") gave " + rotated + " instead of " + expected;
+        return "rotate";
+    }
+
+    // Registers 2 to 5 are the bit pattern of a float
+    std::uint32_t bits = 0;
+    for (int i = 0; i < 4; ++i)
+    {
+        bits |= static_cast<std::uint32_t>(input[REGISTER_BYTES + 2 + i]) << (8 * i);
+    }
+    float value;
+    std::memcpy(&value, &bits, sizeof(value));
+    std::string converted;
+    try
+    {
+        converted = ALU::FloatToHex(value);
+    }
+    catch (const std::out_of_range&)
+    {
+        if (std::isfinite(value))
+        {
+            detail = "ALU::FloatToHex(0x" + hex32(bits) + ") threw for a finite number";
+            return "float";
+        }
+        return "";
+    }
+    if (!std::isfinite(value))
+    {
+        detail = "ALU::FloatToHex(0x" + hex32(bits) + ") gave " + converted + " for a number that is not finite";
+        return "float-nonfinite";
+    }
+    // Within the representable exponents the result is the value with its mantissa truncated to 4 bits
+    float magnitude = std::fabs(value);
+    if (magnitude >= 1.0f / 16 && magnitude < 16.0f)
+    {
+        float back = ALU::HexToFloat(converted);
+        if (std::signbit(back) != std::signbit(value) || std::fabs(back) > magnitude
+            || magnitude - std::fabs(back) >= magnitude / 16)
+        {
+            detail = "ALU::FloatToHex(0x" + hex32(bits) + ") gave " + converted;
+            return "float";
+        }
+    }
+    return "";
+}
+
+bool Fuzzer::execute(const std::vector<std::uint8_t>& input, Machine& machine)
+{
+    apply(input, machine);
+    bool fresh = false;
+    int pc = machine.cpu.getPC();
+    for (long long step = 0; step < maxSteps; ++step)
+    {
+        RunStatus::Code code = machine.cpu.execute(machine.memory);
+        int next = machine.cpu.getPC() & 0xFF;
+        std::atomic<std::uint8_t>& edge = edges[pc << 8 | next];
+        if (!edge.load(std::memory_order_relaxed) && !edge.exchange(1, std::memory_order_relaxed))
+        {
+            ++edgeCount;
+            fresh = true;
+        }
+        if (code != RunStatus::RUNNING)
+        {
+            break;
+        }
+        pc = next;
+    }
+    return fresh;
+}
+
+void Fuzzer::report(const std::string& kind, const std::string& detail, const std::vector<std::uint8_t>& input)
+{
+    std::lock_guard<std::mutex> hold(lock);
+    for (const Finding& finding : found)
+    {
+        if (finding.kind == kind)
+        {
+            return;
+        }
+    }
+    found.push_back(Finding{kind, detail, input});
+    std::string path;
+    if (!findingsDir.empty())
+    {
+        path = findingsDir + "/" + kind + "-" + std::to_string(found.size());
+        std::ofstream fout(path, std::ios::binary | std::ios::trunc);
+        fout.write(reinterpret_cast<const char*>(input.data()), input.size());
+    }
+    std::cerr << "Found " << kind << ": " << detail << (path.empty() ? "" : ", input in " + path) << '\n';
+}
+
+void Fuzzer::workLoop(int self, long long maxExecs)
+{
+    Worker& worker = *workers[self];
+    std::mt19937 random(seed + static_cast<std::uint32_t>(self));
+    Machine machine;
+    // A copy of the corpus, brought up to date every 1024 inputs so the lock is rarely taken
+    std::vector<std::vector<std::uint8_t>> local;
+    std::size_t synced = 0;
+#if VOLE_FUZZ_SIGNALS
+    crashInput = worker.current.data();
+#endif
+    for (long long execs = 0; !stopping && (maxExecs <= 0 || execs < maxExecs); ++execs)
+    {
+        if (execs % 1024 == 0)
+        {
+            std::lock_guard<std::mutex> hold(lock);
+            local.insert(local.end(), corpus.begin() + synced, corpus.end());
+            synced = corpus.size();
+        }
+        {
+            std::lock_guard<std::mutex> hold(worker.lock);
+            worker.current = local[random() % local.size()];
+            mutate(worker.current, local[random() % local.size()], random);
+        }
+
+        std::string detail;
+        std::string kind = checkAlu(worker.current, detail);
+        if (!kind.empty())
+        {
+            report(kind, detail, worker.current);
+        }
+        try
+        {
+            if (execute(worker.current, machine))
+            {
+                std::lock_guard<std::mutex> hold(lock);
+                corpus.push_back(worker.current);
+            }
+        }
+        catch (const std::exception& e)
+        {
+            report("exception", e.what(), worker.current);
+        }
+        worker.execs.fetch_add(1, std::memory_order_relaxed);
+    }
+#if VOLE_FUZZ_SIGNALS
+    crashInput = nullptr;
+#endif
+}
+
+void Fuzzer::run(double seconds, long long maxExecs, double hangSeconds)
+{
+#if VOLE_FUZZ_SIGNALS
+    if (!findingsDir.empty())
+    {
+        std::snprintf(crashPath, sizeof(crashPath), "%s/crash", findingsDir.c_str());
+        for (int signal : {SIGSEGV, SIGBUS, SIGFPE, SIGILL, SIGABRT})
+        {
+            std::signal(signal, onCrash);
+        }
+    }
+#endif
+    stopping = false;
+    workers.clear();
+    for (int i = 0; i < threads; ++i)
+    {
+        workers.emplace_back(new Worker);
+        workers.back()->current.resize(INPUT_SIZE);
+    }
+    long long share = maxExecs > 0 ? (maxExecs + threads - 1) / threads : 0;
+    std::vector<std::thread> pool;
+    std::vector<std::atomic<bool>> finished(threads);
+    for (int i = 0; i < threads; ++i)
+    {
+        finished[i] = false;
+        pool.emplace_back([this, i, share, &finished] {
+            workLoop(i, share);
+            finished[i] = true;
+        });
+    }
+
+    typedef std::chrono::steady_clock Clock;
+    const auto tick = std::chrono::milliseconds(100);
+    auto start = Clock::now();
+    auto lastPrint = start;
+    long long lastExecs = 0;
+    std::vector<long long> progress(threads, -1);
+    std::vector<Clock::time_point> progressed(threads, start);
+    for (;;)
+    {
+        std::this_thread::sleep_for(tick);
+        auto now = Clock::now();
+        bool done = true;
+        for (int i = 0; i < threads; ++i)
+        {
+            long long count = workers[i]->execs.load(std::memory_order_relaxed);
+            done = done && finished[i];
+            if (count != progress[i] || finished[i])
+            {
+                progress[i] = count;
+                progressed[i] = now;
+            }
+            else if (std::chrono::duration<double>(now - progressed[i]).count() >= hangSeconds)
+            {
+                std::vector<std::uint8_t> input;
+                {
+                    std::lock_guard<std::mutex> hold(workers[i]->lock);
+                    input = workers[i]->current;
+                }
+                report("hang", "no progress for " + std::to_string(static_cast<long long>(hangSeconds)) + " s", input);
+                std::cerr << "A worker hangs and cannot be stopped, exiting\n";
+                std::_Exit(1);
+            }
+        }
+        double elapsed = std::chrono::duration<double>(now - start).count();
+        if (done || elapsed >= seconds)
+        {
+            break;
+        }
+        double sincePrint = std::chrono::duration<double>(now - lastPrint).count();
+        if (sincePrint >= 1.0)
+        {
+            long long total = execs();
+            std::cerr << "execs " << total << " (" << static_cast<long long>((total - lastExecs) / sincePrint)
+                      << "/s)  corpus " << corpusSize() << "  edges " << coveredEdges() << "  findings "
+                      << findings().size() << '\n';
+            lastPrint = now;
+            lastExecs = total;
+        }
+    }
+    stopping = true;
+    for (std::thread& thread : pool)
+    {
+        thread.join();
+    }
+}
+
+long long Fuzzer::execs() const
+{
+    long long total = 0;
+    for (const std::unique_ptr<Worker>& worker : workers)
+    {
+        total += worker->execs.load(std::memory_order_relaxed);
+    }
+    return total;
+}
+
+std::size_t Fuzzer::corpusSize() const
+{
+    std::lock_guard<std::mutex> hold(lock);
+    return corpus.size();
+}
+
+std::vector<Fuzzer::Finding> Fuzzer::findings() const
+{
+    std::lock_guard<std::mutex> hold(lock);
+    return found;
+}
+
+int Fuzzer::main(const std::vector<std::string>& args)
+{
+    int threads = static_cast<int>(std::thread::hardware_concurrency());
+    long long maxSteps = 1000;
+    double seconds = 60;
+    long long maxExecs = 0;
+    std::uint32_t seed = std::random_device()();
+    double hangSeconds = 10;
+    std::string findingsDir = "fuzz-findings";
+    std::string startMem = "10";
+    std::string replay;
+    std::vector<std::string> paths;
+    try
+    {
+        for (std::size_t i = 0; i < args.size(); ++i)
+        {
+            const std::string& arg = args[i];
+            bool hasValue = i + 1 < args.size();
+            if ((arg == "-j" || arg == "--threads") && hasValue)
+            {
+                threads = std::stoi(args[++i]);
+            }
+            else if (arg == "--steps" && hasValue)
+            {
+                maxSteps = std::stoll(args[++i]);
+            }
+            else if (arg == "--time" && hasValue)
+            {
+                seconds = std::stod(args[++i]);
+            }
+            else if (arg == "--runs" && hasValue)
+            {
+                maxExecs = std::stoll(args[++i]);
+            }
+            else if (arg == "--seed" && hasValue)
+            {
+                seed = static_cast<std::uint32_t>(std::stoul(args[++i]));
+            }
+            else if (arg == "--hang" && hasValue)
+            {
+                hangSeconds = std::stod(args[++i]);
+            }
+            else if (arg == "--out" && hasValue)
+            {
+                findingsDir = args[++i];
+            }
+            else if (arg == "--start" && hasValue)
+            {
+                startMem = args[++i];
+            }
+            else if (arg == "--replay" && hasValue)
+            {
+                replay = args[++i];
+            }
+            else
+            {
+                paths.push_back(arg);
+            }
+        }
+    }
+    catch (const std::exception&)
+    {
+        std::cerr << "Invalid number argument\n";
+        return 2;
+    }
+    if (!BatchRunner::isHexByte(startMem) || maxSteps < 1)
+    {
+        std::cerr << "Usage: simulator --fuzz [-j threads] [--steps n] [--time seconds] [--runs n] [--seed n] [--hang seconds]\n"
+                  << "                        [--out dir] [--start XY] [path[@XY]...]\n"
+                  << "       simulator --fuzz [--steps n] --replay input\n";
+        return 2;
+    }
+
+    if (!replay.empty())
+    {
+        std::ifstream fin(replay, std::ios::binary);
+        std::vector<std::uint8_t> input((std::istreambuf_iterator<char>(fin)), std::istreambuf_iterator<char>());
+        if (input.size() != INPUT_SIZE)
+        {
+            std::cerr << replay << ": not a " << INPUT_SIZE << " byte fuzzer input\n";
+            return 2;
+        }
+        std::string detail;
+        bool passed = checkAlu(input, detail).empty();
+        std::cout << (passed ? "ALU checks passed" : detail) << '\n';
+        Machine machine;
+        apply(input, machine);
+        long long steps = 0;
+        RunStatus::Code code = machine.cpu.run(machine.memory, maxSteps, steps);
+        machine.printState();
+        std::cout << RunStatus::describe(code) << " after " << steps << " steps\n";
+        return passed ? 0 : 1;
+    }
+
+    std::vector<std::vector<std::uint8_t>> seeds;
+    std::vector<BatchJob> jobs;
+    for (const std::string& path : paths)
+    {
+        BatchRunner::collect(path, startMem, jobs);
+    }
+    for (const BatchJob& job : jobs)
+    {
+        Machine machine;
+        try
+        {
+            BatchRunner::load(job, machine);
+        }
+        catch (const std::exception& e)
+        {
+            std::cerr << job.fileName << ": cannot load: " << e.what() << '\n';
+            continue;
+        }
+        seeds.push_back(inputOf(machine));
+    }
+
+    try
+    {
+        Fuzzer fuzzer(seeds, threads, maxSteps, seed, findingsDir);
+        auto start = std::chrono::steady_clock::now();
+        fuzzer.run(seconds, maxExecs, hangSeconds);
+        double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        std::cout << "Ran " << fuzzer.execs() << " inputs in " << elapsed << " s ("
+                  << static_cast<long long>(fuzzer.execs() / elapsed) << "/s), corpus " << fuzzer.corpusSize()
+                  << ", edges " << fuzzer.coveredEdges() << ", findings " << fuzzer.findings().size() << '\n';
+        return fuzzer.findings().empty() ? 0 : 1;
+    }
+    catch (const std::exception& e)
+    {
+        std::cerr << e.what() << '\n';
+        return 2;
+    }
+}
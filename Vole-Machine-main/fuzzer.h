@@ -0,0 +1,130 @@
+#pragma once
+
+#include "class_T4.h"
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+/**
+ * @brief Coverage-guided fuzzing of programs and of the simulator itself, in process. An input is
+ *        a whole start state: the PC, the registers and all 256 cells, so program and data are
+ *        mutated alike. Each worker thread loads inputs into one reused `Machine` and runs them
+ *        with `CPU::execute` for up to `maxSteps` instructions.
+ *
+ *        Coverage is the set of PC edges taken, from the PC before an instruction to the PC after
+ *        it, which is exactly 65536 bits on the classic machine, so no hashing is needed. An input
+ *        reaching an edge no earlier input reached joins the corpus that later inputs are mutated
+ *        from.
+ *
+ *        Every input also goes through the hex string ALU: `ALU::rotate` with any rotation count
+ *        and `ALU::FloatToHex` with any float bit pattern, compared against reference results.
+ *        A mismatch, an exception from the machine, a worker making no progress for `hangSeconds`
+ *        and, on POSIX hosts, a crash signal are findings. The input of the first finding of each
+ *        kind is written to the findings directory.
+ *
+ *        Input file: PC, registers 0-F, cells 00-FF, 273 bytes
+ */
+class Fuzzer
+{
+public:
+    static constexpr std::size_t INPUT_SIZE = 273;
+    static const int EDGES = 1 << 16;
+
+    struct Finding
+    {
+        std::string kind;
+        std::string detail;
+        std::vector<std::uint8_t> input;
+    };
+
+private:
+    struct alignas(64) Worker
+    {
+        /**
+         * @brief Guards `current`, which the watchdog reads when the worker hangs
+         */
+        std::mutex lock;
+        std::vector<std::uint8_t> current;
+        std::atomic<long long> execs{0};
+    };
+
+    int threads;
+    long long maxSteps;
+    std::uint32_t seed;
+    std::string findingsDir;
+
+    std::unique_ptr<std::atomic<std::uint8_t>[]> edges;
+    std::atomic<long long> edgeCount;
+
+    /**
+     * @brief Guards `corpus` and `found`, the corpus only ever grows
+     */
+    mutable std::mutex lock;
+    std::vector<std::vector<std::uint8_t>> corpus;
+    std::vector<Finding> found;
+
+    std::vector<std::unique_ptr<Worker>> workers;
+    std::atomic<bool> stopping;
+
+    void workLoop(int self, long long maxExecs);
+
+    /**
+     * @brief Runs `input` on `machine`, recording new edges
+     * @return True if it reached an edge no input reached before
+     */
+    bool execute(const std::vector<std::uint8_t>& input, Machine& machine);
+
+    /**
+     * @brief Records a finding unless one of the same kind was already recorded
+     */
+    void report(const std::string& kind, const std::string& detail, const std::vector<std::uint8_t>& input);
+
+public:
+    /**
+     * @param seeds Inputs the corpus starts with, made by `inputOf`. An empty list starts from
+     *        all-zero memory
+     * @param threads The number of worker threads, at least 1
+     * @param maxSteps The instructions an input runs at most
+     * @param findingsDir Where finding inputs are written, nowhere if empty
+     */
+    Fuzzer(const std::vector<std::vector<std::uint8_t>>& seeds, int threads, long long maxSteps, std::uint32_t seed,
+           const std::string& findingsDir);
+    Fuzzer(const Fuzzer&) = delete;
+    Fuzzer& operator=(const Fuzzer&) = delete;
+
+    /**
+     * @brief Fuzzes for `seconds` or until `maxExecs` inputs ran in total, whichever comes first,
+     *        printing progress to `std::cerr` every second
+     * @param hangSeconds How long a worker may make no progress before its input is reported and
+     *        the process exits, since a hung thread cannot be stopped
+     */
+    void run(double seconds, long long maxExecs, double hangSeconds);
+
+    long long execs() const;
+    long long coveredEdges() const { return edgeCount; }
+    std::size_t corpusSize() const;
+    std::vector<Finding> findings() const;
+
+    /**
+     * @brief Checks the string ALU on the bytes of `input`
+     * @param detail Set to what went wrong, if anything did
+     * @return The kind of finding, empty if the checks passed
+     */
+    static std::string checkAlu(const std::vector<std::uint8_t>& input, std::string& detail);
+
+    static std::vector<std::uint8_t> inputOf(const Machine& machine);
+
+    /**
+     * @brief Puts the state `input` describes into `machine`, clearing its halt flag and screen
+     */
+    static void apply(const std::vector<std::uint8_t>& input, Machine& machine);
+
+    /**
+     * @brief Entry point of `--fuzz`, parses the command line arguments following it
+     * @return The process exit code
+     */
+    static int main(const std::vector<std::string>& args);
+};
@@ -0,0 +1,139 @@
+#include "history.h"
+#include <stdexcept>
+
+History::History(const Machine& machine, long long interval) : interval(interval > 0 ? interval : 1)
+{
+    reset(machine);
+}
+
+void History::reset(const Machine& machine)
+{
+    steps = 0;
+    log.clear();
+    checkpoints.clear();
+    checkpoint(machine);
+}
+
+void History::checkpoint(const Machine& machine)
+{
+    if (checkpoints.empty() || checkpoints.back().first < steps)
+    {
+        checkpoints.emplace_back(steps, machine.snapshot());
+    }
+    log.clear();
+    logStart = steps;
+}
+
+void History::rebuild()
+{
+    long long start = (steps - 1) / interval * interval;
+    auto found = checkpoints.begin();
+    while (found + 1 != checkpoints.end() && (found + 1)->first <= start)
+    {
+        ++found;
+    }
+    Machine scratch;
+    scratch.restore(found->second);
+    log.clear();
+    log.reserve(static_cast<std::size_t>(steps - found->first));
+    while (static_cast<long long>(log.size()) < steps - found->first)
+    {
+        try
+        {
+            record(scratch, log);
+        }
+        catch (const std::exception&)
+        {
+        }
+    }
+    logStart = found->first;
+}
+
+long long History::run(Machine& machine, long long maxSteps)
+{
+    long long executed = 0;
+    while (executed < maxSteps && !machine.cpu.isHalt)
+    {
+        long long before = steps;
+        step(machine);
+        if (steps == before)
+        {
+            break;
+        }
+        ++executed;
+    }
+    return executed;
+}
+
+bool History::stepBack(Machine& machine)
+{
+    if (steps == 0)
+    {
+        return false;
+    }
+    if (log.empty())
+    {
+        if (machine.memory.hasDevices())
+        {
+            return false;
+        }
+        rebuild();
+    }
+    const Undo entry = log.back();
+    log.pop_back();
+    --steps;
+
+    machine.cpu.setPC(entry.pc);
+    machine.cpu.isHalt = false;
+    if (entry.change == TraceFormat::REGISTER)
+    {
+        machine.cpu.reg.setValue(entry.target, entry.old);
+    }
+    else if (entry.change == TraceFormat::CELL)
+    {
+        machine.memory.load(entry.target, &entry.old, 1);
+        if (machine.memory.getPort(entry.target) == Machine::Memory::SCREEN_PORT)
+        {
+            machine.memory.screen.unput(entry.pushedOut);
+        }
+    }
+    return true;
+}
+
+long long History::runBack(Machine& machine, int reg, int cell)
+{
+    long long undone = 0;
+    while (steps > 0)
+    {
+        if (log.empty())
+        {
+            if (machine.memory.hasDevices())
+            {
+                break;
+            }
+            rebuild();
+        }
+        const Undo& entry = log.back();
+        bool wrote = (entry.change == TraceFormat::REGISTER && entry.target == reg
+                      && machine.cpu.reg.getValue(reg) != entry.old)
+                  || (entry.change == TraceFormat::CELL && entry.target == cell
+                      && machine.memory.getCell(cell) != entry.old);
+        stepBack(machine);
+        ++undone;
+        if (wrote || (machine.memory.getTraps(machine.cpu.getPC()) & Memory::BREAK))
+        {
+            break;
+        }
+    }
+    return undone;
+}
+
+std::size_t History::memoryUse() const
+{
+    std::size_t bytes = log.capacity() * sizeof(Undo);
+    for (const auto& entry : checkpoints)
+    {
+        bytes += sizeof(entry) + entry.second.capacity();
+    }
+    return bytes;
+}
@@ -0,0 +1,165 @@
+#pragma once
+
+#include "class_T4.h"
+#include "trace.h"
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+/**
+ * @brief Runs a machine on the interpreter and remembers enough to step it backward.
+ *
+ *        Every `interval` steps a snapshot of the machine is kept as a checkpoint. Between two
+ *        checkpoints an undo log holds, per step, the PC and the byte the instruction overwrote
+ *        (register or cell, and the screen byte a store to a screen cell pushed out). Only the log of one
+ *        interval is kept: stepping back past its start replays the previous interval from its
+ *        checkpoint on a scratch machine to rebuild the log. Memory use is therefore one snapshot
+ *        per interval run plus at most `interval` log entries. Devices other than the screen are
+ *        not stepped back. The scratch machine has no ports and replaying would ask the devices
+ *        again, so a machine with devices mapped steps back only to the start of the current log
+ */
+class History
+{
+public:
+    /**
+     * @brief What one step overwrote, `change` being a `TraceFormat` change kind
+     */
+    struct Undo
+    {
+        std::uint8_t pc;
+        std::uint8_t change;
+        std::uint8_t target;
+        std::uint8_t old;
+        std::uint8_t pushedOut;
+    };
+
+private:
+    long long interval;
+    long long steps;
+    long long logStart;
+    std::vector<Undo> log;
+    std::vector<std::pair<long long, std::vector<std::uint8_t>>> checkpoints;
+
+    /**
+     * @brief Runs one instruction of `machine` and appends what it overwrote to `undo`. An unknown
+     *        instruction has already moved the PC when it faults, so it is appended before the
+     *        fault propagates
+     * @return Whether an instruction ran, false if a breakpoint stopped in front of it
+     */
+    static bool record(Machine& machine, std::vector<Undo>& undo)
+    {
+        int pc = machine.cpu.programCounter;
+        if (pc < 0 || pc > 253)
+        {
+            machine.cpu.runInstruction(machine.memory);
+            return true;
+        }
+        std::uint8_t* cells = machine.memory.cells;
+        std::uint8_t hi = cells[pc];
+        std::uint8_t lo = cells[pc + 1];
+        int op = hi >> 4;
+        Undo entry;
+        entry.pc = static_cast<std::uint8_t>(pc);
+        entry.change = TraceFormat::CHANGES[op];
+        entry.target = entry.change == TraceFormat::CELL ? lo : ((op == 0x4 ? lo : hi) & 0xF);
+        entry.old = entry.change == TraceFormat::CELL ? cells[lo] : machine.cpu.reg.registers[entry.target];
+        entry.pushedOut = machine.memory.screen.oldest();
+
+        try
+        {
+            machine.cpu.runInstruction(machine.memory);
+        }
+        catch (...)
+        {
+            undo.push_back(entry);
+            throw;
+        }
+        if (machine.cpu.isHalt && machine.cpu.programCounter == pc)
+        {
+            return false;
+        }
+        undo.push_back(entry);
+        return true;
+    }
+
+    void checkpoint(const Machine& machine);
+
+    void advance(const Machine& machine)
+    {
+        if (++steps % interval == 0)
+        {
+            checkpoint(machine);
+        }
+    }
+
+    /**
+     * @brief Fills the log with the interval ending at the current step, replayed from its checkpoint
+     */
+    void rebuild();
+
+public:
+    /**
+     * @brief Starts the history at the current state of `machine`
+     * @param interval The number of steps between two checkpoints
+     */
+    explicit History(const Machine& machine, long long interval = 1 << 16);
+
+    /**
+     * @brief Forgets everything and starts again at the current state of `machine`, to be called
+     *        whenever the machine was changed other than through the history
+     */
+    void reset(const Machine& machine);
+
+    /**
+     * @brief Runs one instruction and records it. Faults propagate as exceptions, a faulting
+     *        instruction that moved the PC is recorded so stepping back puts the PC back
+     */
+    void step(Machine& machine)
+    {
+        std::size_t logged = log.size();
+        try
+        {
+            if (!record(machine, log))
+            {
+                return;
+            }
+        }
+        catch (...)
+        {
+            if (log.size() != logged)
+            {
+                advance(machine);
+            }
+            throw;
+        }
+        advance(machine);
+    }
+
+    /**
+     * @brief Steps until the machine halts, is stopped by a breakpoint or `maxSteps` instructions ran
+     * @return The number of instructions executed
+     */
+    long long run(Machine& machine, long long maxSteps);
+
+    /**
+     * @brief Undoes the last recorded step, the screen's sink keeps what it received
+     * @return False if the machine is already at the start of the history, or at the start of
+     *         the log with devices mapped
+     */
+    bool stepBack(Machine& machine);
+
+    /**
+     * @brief Steps back until the machine stands on a PC breakpoint, or in front of the instruction
+     *        that last wrote register `reg` or cell `cell` with a new value (-1 for neither), or
+     *        at the start of the history, or of the log with devices mapped
+     * @return The number of steps undone
+     */
+    long long runBack(Machine& machine, int reg, int cell);
+
+    long long position() const { return steps; }
+
+    /**
+     * @brief The bytes held by checkpoints and the log
+     */
+    std::size_t memoryUse() const;
+};
@@ -0,0 +1,282 @@
+#include "image.h"
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <stdexcept>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define VOLE_IMAGE_MMAP 1
+#else
+#define VOLE_IMAGE_MMAP 0
+#endif
+
+static void put16(std::vector<std::uint8_t>& out, std::uint32_t value)
+{
+    out.push_back(static_cast<std::uint8_t>(value));
+    out.push_back(static_cast<std::uint8_t>(value >> 8));
+}
+
+static void put32(std::vector<std::uint8_t>& out, std::uint32_t value)
+{
+    put16(out, value & 0xFFFF);
+    put16(out, value >> 16);
+}
+
+static std::uint32_t get16(const std::uint8_t* p)
+{
+    return p[0] | (p[1] << 8);
+}
+
+static std::uint32_t get32(const std::uint8_t* p)
+{
+    return get16(p) | (get16(p + 2) << 16);
+}
+
+std::uint32_t ImageFormat::checksum(int loadAddress, int startAddress, const std::uint8_t* bytes, int length)
+{
+    std::uint32_t hash = 2166136261u;
+    auto mix = [&hash](std::uint8_t byte)
+    {
+        hash = (hash ^ byte) * 16777619u;
+    };
+    mix(static_cast<std::uint8_t>(loadAddress));
+    mix(static_cast<std::uint8_t>(startAddress));
+    for (int i = 0; i < length; ++i)
+    {
+        mix(bytes[i]);
+    }
+    return hash;
+}
+
+std::vector<std::uint8_t> ImageFormat::encode(const std::vector<std::uint8_t>& program, int loadAddress, int startAddress)
+{
+    if (loadAddress < 0 || startAddress < 0 || startAddress > 255 || loadAddress + program.size() > 256)
+    {
+        throw std::overflow_error("Program length exceeds machine's memory");
+    }
+    int length = static_cast<int>(program.size());
+    std::vector<std::uint8_t> out = {'V', 'O', 'L', 'I', VERSION,
+        static_cast<std::uint8_t>(loadAddress), static_cast<std::uint8_t>(startAddress), 0};
+    put16(out, length);
+    put16(out, 0);
+    put32(out, checksum(loadAddress, startAddress, program.data(), length));
+    out.insert(out.end(), program.begin(), program.end());
+    return out;
+}
+
+ProgramImage ImageFormat::decode(const std::uint8_t* data, std::size_t size, std::size_t& used)
+{
+    if (size < HEADER_SIZE || std::memcmp(data, "VOLI", 4) != 0 || data[4] != VERSION)
+    {
+        throw std::runtime_error("Not a Vole program image");
+    }
+    ProgramImage image;
+    image.loadAddress = data[5];
+    image.startAddress = data[6];
+    image.length = static_cast<int>(get16(data + 8));
+    image.bytes = data + HEADER_SIZE;
+    if (image.loadAddress + image.length > 256 || size - HEADER_SIZE < static_cast<std::size_t>(image.length))
+    {
+        throw std::runtime_error("Program image is truncated or too long");
+    }
+    if (get32(data + 12) != checksum(image.loadAddress, image.startAddress, image.bytes, image.length))
+    {
+        throw std::runtime_error("Program image checksum mismatch");
+    }
+    used = HEADER_SIZE + image.length;
+    return image;
+}
+
+std::vector<std::uint8_t> ImageFormat::fromText(const std::string& fileName, const std::string& startMem)
+{
+    int address = ALU::HexToDec(startMem) & 0xFF;
+    return encode(Machine::parseProgram(fileName), address, address);
+}
+
+void ImageFormat::writeArchive(const std::string& fileName, const std::vector<std::pair<std::string, std::vector<std::uint8_t>>>& images)
+{
+    std::vector<std::uint8_t> out = {'V', 'O', 'L', 'A', VERSION, 0, 0, 0};
+    put32(out, static_cast<std::uint32_t>(images.size()));
+    for (const auto& entry : images)
+    {
+        std::size_t nameLength = std::min<std::size_t>(entry.first.size(), 0xFFFF);
+        put16(out, static_cast<std::uint32_t>(nameLength));
+        out.insert(out.end(), entry.first.begin(), entry.first.begin() + nameLength);
+        out.insert(out.end(), entry.second.begin(), entry.second.end());
+    }
+
+    std::ofstream fout{fileName, std::ios::binary};
+    if (!fout.is_open())
+    {
+        throw std::runtime_error("Failed to open " + fileName);
+    }
+    fout.write(reinterpret_cast<const char*>(out.data()), out.size());
+}
+
+ImageArchive::ImageArchive(const std::string& fileName) : data(nullptr), size(0)
+{
+#if VOLE_IMAGE_MMAP
+    int fd = open(fileName.c_str(), O_RDONLY);
+    if (fd < 0)
+    {
+        throw std::runtime_error("Failed to open " + fileName);
+    }
+    struct stat info;
+    if (fstat(fd, &info) == 0 && info.st_size > 0)
+    {
+        void* mapped = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (mapped != MAP_FAILED)
+        {
+            data = static_cast<std::uint8_t*>(mapped);
+            size = info.st_size;
+        }
+    }
+    close(fd);
+#endif
+    if (data == nullptr)
+    {
+        std::ifstream fin{fileName, std::ios::binary};
+        if (!fin.is_open())
+        {
+            throw std::runtime_error("Failed to open " + fileName);
+        }
+        fallback.assign(std::istreambuf_iterator<char>(fin), std::istreambuf_iterator<char>());
+        size = fallback.size();
+    }
+    const std::uint8_t* bytes = data != nullptr ? data : fallback.data();
+
+    try
+    {
+        std::size_t used = 0;
+        if (size >= 4 && std::memcmp(bytes, "VOLI", 4) == 0)
+        {
+            images.push_back(ImageFormat::decode(bytes, size, used));
+            images.back().name = fileName;
+            return;
+        }
+        if (size < ImageFormat::ARCHIVE_HEADER_SIZE || std::memcmp(bytes, "VOLA", 4) != 0 || bytes[4] != ImageFormat::VERSION)
+        {
+            throw std::runtime_error(fileName + " is not a Vole image or archive");
+        }
+        std::size_t count = get32(bytes + 8);
+        std::size_t offset = ImageFormat::ARCHIVE_HEADER_SIZE;
+        // The count is untrusted, every entry takes at least its 2 byte name length
+        if (count > (size - offset) / 2)
+        {
+            throw std::runtime_error(fileName + " is truncated");
+        }
+        images.reserve(count);
+        for (std::size_t i = 0; i < count; ++i)
+        {
+            if (size - offset < 2 || size - offset - 2 < get16(bytes + offset))
+            {
+                throw std::runtime_error(fileName + " is truncated");
+            }
+            std::size_t nameLength = get16(bytes + offset);
+            std::string name(reinterpret_cast<const char*>(bytes + offset + 2), nameLength);
+            offset += 2 + nameLength;
+            images.push_back(ImageFormat::decode(bytes + offset, size - offset, used));
+            images.back().name = std::move(name);
+            offset += used;
+        }
+    }
+    catch (...)
+    {
+#if VOLE_IMAGE_MMAP
+        if (data != nullptr)
+        {
+            munmap(data, size);
+        }
+#endif
+        throw;
+    }
+}
+
+ImageArchive::~ImageArchive()
+{
+#if VOLE_IMAGE_MMAP
+    if (data != nullptr)
+    {
+        munmap(data, size);
+    }
+#endif
+}
+
+bool ImageArchive::isImageFile(const std::string& fileName)
+{
+    std::ifstream fin{fileName, std::ios::binary};
+    char magic[4] = {};
+    fin.read(magic, 4);
+    return fin && (std::memcmp(magic, "VOLI", 4) == 0 || std::memcmp(magic, "VOLA", 4) == 0);
+}
+
+void ImageArchive::load(std::size_t index, Machine& machine) const
+{
+    const ProgramImage& image = images[index];
+    machine.loadBytes(image.bytes, image.length, image.loadAddress, image.startAddress);
+}
+
+int ImageFormat::main(const std::vector<std::string>& args)
+{
+    try
+    {
+        if (args.size() >= 3 && args[0] == "--convert")
+        {
+            std::vector<std::uint8_t> image = fromText(args[1], args.size() > 3 ? args[3] : "10");
+            std::ofstream fout{args[2], std::ios::binary};
+            if (!fout.is_open())
+            {
+                throw std::runtime_error("Failed to open " + args[2]);
+            }
+            fout.write(reinterpret_cast<const char*>(image.data()), image.size());
+            return 0;
+        }
+        if (args.size() >= 3 && args[0] == "--pack")
+        {
+            std::vector<std::pair<std::string, std::vector<std::uint8_t>>> images;
+            for (std::size_t i = 2; i < args.size(); ++i)
+            {
+                std::string path = args[i];
+                std::string startMem = "10";
+                std::size_t at = path.rfind('@');
+                if (at != std::string::npos && path.size() - at == 3
+                    && std::isxdigit(static_cast<unsigned char>(path[at + 1])) && std::isxdigit(static_cast<unsigned char>(path[at + 2])))
+                {
+                    startMem = path.substr(at + 1);
+                    path = path.substr(0, at);
+                }
+                if (ImageArchive::isImageFile(path))
+                {
+                    ImageArchive archive(path);
+                    for (std::size_t j = 0; j < archive.count(); ++j)
+                    {
+                        const ProgramImage& image = archive[j];
+                        images.push_back({image.name, encode(std::vector<std::uint8_t>(image.bytes, image.bytes + image.length),
+                                                             image.loadAddress, image.startAddress)});
+                    }
+                }
+                else
+                {
+                    images.push_back({path, fromText(path, startMem)});
+                }
+            }
+            writeArchive(args[1], images);
+            return 0;
+        }
+    }
+    catch (const std::exception& e)
+    {
+        std::cerr << e.what() << '\n';
+        return 1;
+    }
+    std::cerr << "Usage: simulator --convert program.txt image.vimg [XY]\n"
+              << "       simulator --pack archive.vola program.txt[@XY]|image.vimg|archive.vola...\n";
+    return 2;
+}
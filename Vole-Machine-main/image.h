@@ -0,0 +1,95 @@
+#pragma once
+
+#include "class_T4.h"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/**
+ * @brief A binary program image, `bytes` points into the file it was read from
+ */
+struct ProgramImage
+{
+    std::string name;
+    int loadAddress;
+    int startAddress;
+    const std::uint8_t* bytes;
+    int length;
+};
+
+/**
+ * @brief Binary program images and archives of them. All numbers are little endian.
+ *
+ *        Image:   "VOLI", version, load address, start address, 0, u16 length, u16 0,
+ *                 u32 checksum, then `length` program bytes
+ *        Archive: "VOLA", version, 0, 0, 0, u32 count, then per image a u16 name length,
+ *                 the name and the image
+ */
+class ImageFormat
+{
+public:
+    static const std::uint8_t VERSION = 1;
+    static const std::size_t HEADER_SIZE = 16;
+    static const std::size_t ARCHIVE_HEADER_SIZE = 12;
+
+    /**
+     * @brief FNV-1a over the load address, start address and program bytes
+     */
+    static std::uint32_t checksum(int loadAddress, int startAddress, const std::uint8_t* bytes, int length);
+
+    static std::vector<std::uint8_t> encode(const std::vector<std::uint8_t>& program, int loadAddress, int startAddress);
+
+    /**
+     * @brief Reads the image at the start of `data` and checks its header and checksum
+     * @param size The number of bytes available at `data`
+     * @param used Set to the number of bytes the image takes
+     */
+    static ProgramImage decode(const std::uint8_t* data, std::size_t size, std::size_t& used);
+
+    /**
+     * @brief Converts a text program as read by `Machine::loadProgram` into an image
+     */
+    static std::vector<std::uint8_t> fromText(const std::string& fileName, const std::string& startMem);
+
+    /**
+     * @brief Packs named images into one archive file
+     */
+    static void writeArchive(const std::string& fileName, const std::vector<std::pair<std::string, std::vector<std::uint8_t>>>& images);
+
+    /**
+     * @brief Entry point of `--convert` and `--pack`, `args` starts with the option
+     * @return The process exit code
+     */
+    static int main(const std::vector<std::string>& args);
+};
+
+/**
+ * @brief A memory-mapped image or archive file. The images stay valid while the archive is alive
+ */
+class ImageArchive
+{
+private:
+    std::uint8_t* data;
+    std::size_t size;
+    std::vector<std::uint8_t> fallback;
+    std::vector<ProgramImage> images;
+
+public:
+    explicit ImageArchive(const std::string& fileName);
+    ~ImageArchive();
+    ImageArchive(const ImageArchive&) = delete;
+    ImageArchive& operator=(const ImageArchive&) = delete;
+
+    /**
+     * @brief Whether the file starts with the magic of an image or an archive
+     */
+    static bool isImageFile(const std::string& fileName);
+
+    std::size_t count() const { return images.size(); }
+    const ProgramImage& operator[](std::size_t index) const { return images[index]; }
+
+    /**
+     * @brief Resets `machine` and copies the image at `index` straight into its memory
+     */
+    void load(std::size_t index, Machine& machine) const;
+};
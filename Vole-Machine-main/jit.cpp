@@ -0,0 +1,478 @@
+#include "jit.h"
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <exception>
+#include <initializer_list>
+
+#if defined(__x86_64__) && defined(__unix__)
+#include <sys/mman.h>
+#define VOLE_JIT_X86_64 1
+#else
+#define VOLE_JIT_X86_64 0
+#endif
+
+static_assert(sizeof(DecodedInstruction) == 4 && offsetof(DecodedInstruction, opcode) == 0,
+              "Translated stores reset decoded slots by writing the first byte of slot * 4");
+
+// Layout of the value returned by a translated block
+static const std::uint32_t HALTED = 1u << 24;
+static const std::uint32_t CODE_WRITTEN = 1u << 25;
+
+static std::uint32_t exitValue(int pc, int storeAddress = 0, std::uint32_t flags = 0)
+{
+    return static_cast<std::uint32_t>(pc) | (storeAddress << 16) | flags;
+}
+
+enum HostRegister { RAX = 0, RCX = 1, RDX = 2, RSI = 6, RDI = 7, R8 = 8, R9 = 9, R10 = 10, R11 = 11 };
+
+/**
+ * @brief Appends x86-64 instructions, every memory operand is `[base + disp32]`
+ */
+class Emitter
+{
+public:
+    std::vector<std::uint8_t> code;
+
+    void bytes(std::initializer_list<std::uint8_t> list)
+    {
+        code.insert(code.end(), list);
+    }
+
+    void imm32(std::uint32_t value)
+    {
+        for (int i = 0; i < 4; ++i)
+        {
+            code.push_back(static_cast<std::uint8_t>(value >> (8 * i)));
+        }
+    }
+
+    void memory(std::initializer_list<std::uint8_t> opcode, int reg, int base, std::int32_t disp, bool wide = false)
+    {
+        std::uint8_t rex = 0x40 | (wide ? 8 : 0) | ((reg & 8) ? 4 : 0) | ((base & 8) ? 1 : 0);
+        if (rex != 0x40)
+        {
+            code.push_back(rex);
+        }
+        bytes(opcode);
+        code.push_back(static_cast<std::uint8_t>(0x80 | ((reg & 7) << 3) | (base & 7)));
+        imm32(static_cast<std::uint32_t>(disp));
+    }
+
+    void loadPointer(int reg, int offset) { memory({0x8B}, reg, RDI, offset, true); }
+    void loadByte(int reg, int base, int disp) { memory({0x0F, 0xB6}, reg, base, disp); }
+    void storeAL(int base, int disp) { memory({0x88}, RAX, base, disp); }
+    void storeImm(int base, int disp, std::uint8_t value) { memory({0xC6}, 0, base, disp); code.push_back(value); }
+
+    /**
+     * @brief Adds `count` to the executed counter in rdx, stores it and returns `value` (20 bytes)
+     */
+    void exit(int count, std::uint32_t value)
+    {
+        bytes({0x48, 0x81, 0xC2});
+        imm32(count);
+        memory({0x89}, RDX, RDI, offsetof(JitContext, executed), true);
+        code.push_back(0xB8);
+        imm32(value);
+        code.push_back(0xC3);
+    }
+
+    /**
+     * @brief Exits unless the flags satisfy `skip`, a short jcc opcode
+     */
+    void exitUnless(std::uint8_t skip, int count, std::uint32_t value)
+    {
+        bytes({skip, 20});
+        exit(count, value);
+    }
+
+    /**
+     * @brief Jumps back to `target` when another `length` instructions fit in the limit, exits with
+     *        the PC at `pc` otherwise (41 bytes)
+     */
+    void loop(int count, int length, std::size_t target, int pc)
+    {
+        bytes({0x48, 0x81, 0xC2});
+        imm32(count);
+        bytes({0x48, 0x8D, 0x82});
+        imm32(length);
+        memory({0x3B}, RAX, RDI, offsetof(JitContext, limit), true);
+        bytes({0x77, 5});
+        code.push_back(0xE9);
+        imm32(static_cast<std::uint32_t>(target - (code.size() + 4)));
+        memory({0x89}, RDX, RDI, offsetof(JitContext, executed), true);
+        code.push_back(0xB8);
+        imm32(exitValue(pc, 0));
+        code.push_back(0xC3);
+    }
+
+    void loopUnless(std::uint8_t skip, int count, int length, std::size_t target, int pc)
+    {
+        bytes({skip, 41});
+        loop(count, length, target, pc);
+    }
+};
+
+static const std::uint8_t JE = 0x74;
+static const std::uint8_t JNE = 0x75;
+static const std::uint8_t JAE = 0x73;
+
+JIT::JIT(Machine& machine) : machine(machine), blocks{}, codeMap{}, rewrites{}, buffer(nullptr), used(0)
+{
+    context.registers = machine.cpu.reg.registers;
+    context.cells = machine.memory.cells;
+    context.decoded = machine.memory.decoded;
+    context.floatSums = &ALU::floatSums[0][0];
+    context.codeMap = codeMap;
+#if VOLE_JIT_X86_64
+    void* mapped = mmap(nullptr, BUFFER_SIZE, PROT_READ | PROT_WRITE | PROT_EXEC, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (mapped != MAP_FAILED)
+    {
+        buffer = static_cast<std::uint8_t*>(mapped);
+    }
+#endif
+}
+
+JIT::~JIT()
+{
+#if VOLE_JIT_X86_64
+    if (buffer != nullptr)
+    {
+        munmap(buffer, BUFFER_SIZE);
+    }
+#endif
+}
+
+void JIT::translate(int start)
+{
+    Emitter out;
+    out.loadPointer(RSI, offsetof(JitContext, registers));
+    out.loadPointer(R8, offsetof(JitContext, cells));
+    out.loadPointer(R9, offsetof(JitContext, decoded));
+    out.loadPointer(R10, offsetof(JitContext, floatSums));
+    out.loadPointer(R11, offsetof(JitContext, codeMap));
+    out.bytes({0x31, 0xD2});
+    std::size_t top = out.code.size();
+
+    // The block runs up to an unconditional jump or a halt, conditional jumps leave it when taken
+    const std::uint8_t* cells = machine.memory.cells;
+    int length = 0;
+    for (int pc = start; length < MAX_BLOCK && pc + 2 <= 255 && rewrites[start] < MAX_REWRITES; pc += 2)
+    {
+        int opcode = cells[pc] >> 4;
+        if (opcode == 0x0 || opcode >= 0xE || (opcode == 0x3 && cells[pc + 1] == 0))
+        {
+            break;
+        }
+        ++length;
+        if (opcode == 0xC || (opcode == 0xB && (cells[pc] & 0xF) == 0))
+        {
+            break;
+        }
+    }
+
+    int pc = start;
+    int count = 0;
+    bool ended = false;
+    while (count < length)
+    {
+        int opcode = cells[pc] >> 4;
+        int R = cells[pc] & 0xF;
+        int XY = cells[pc + 1];
+        int S = XY >> 4;
+        int T = XY & 0xF;
+        ++count;
+        int next = pc + 2;
+        switch (opcode)
+        {
+        case 0x1:
+            out.loadByte(RAX, R8, XY);
+            out.storeAL(RSI, R);
+            break;
+        case 0x2:
+            out.storeImm(RSI, R, static_cast<std::uint8_t>(XY));
+            break;
+        case 0x3:
+            out.loadByte(RAX, RSI, R);
+            out.storeAL(R8, XY);
+            out.storeImm(R9, XY * 4, Memory::UNDECODED);
+            out.storeImm(R9, (XY - 1) * 4, Memory::UNDECODED);
+            out.memory({0x80}, 7, R11, XY);
+            out.code.push_back(0);
+            out.exitUnless(JE, count, exitValue(next, XY, CODE_WRITTEN));
+            break;
+        case 0x4:
+            out.loadByte(RAX, RSI, S);
+            out.storeAL(RSI, T);
+            break;
+        case 0x5:
+        case 0x7:
+        case 0x8:
+        case 0x9:
+        {
+            // add, or, and, xor al with the byte operand
+            static const std::uint8_t ops[] = {0x02, 0, 0x0A, 0x22, 0x32};
+            out.loadByte(RAX, RSI, S);
+            out.memory({ops[opcode - 5]}, RAX, RSI, T);
+            out.storeAL(RSI, R);
+            break;
+        }
+        case 0x6:
+            out.loadByte(RAX, RSI, S);
+            out.bytes({0xC1, 0xE0, 0x08});
+            out.loadByte(RCX, RSI, T);
+            out.bytes({0x09, 0xC8});
+            out.bytes({0x41, 0x0F, 0xB6, 0x04, 0x02});
+            out.storeAL(RSI, R);
+            break;
+        case 0xA:
+            if (T & 7)
+            {
+                out.memory({0xC0}, 1, RSI, R);
+                out.code.push_back(static_cast<std::uint8_t>(T & 7));
+            }
+            break;
+        case 0xB:
+        case 0xD:
+            if (opcode == 0xB && R == 0)
+            {
+                if (XY == start)
+                {
+                    out.loop(count, length, top, XY);
+                }
+                else
+                {
+                    out.exit(count, exitValue(XY));
+                }
+                ended = true;
+            }
+            else if (R != 0)
+            {
+                out.loadByte(RAX, RSI, opcode == 0xB ? R : 0);
+                out.memory({0x3A}, RAX, RSI, opcode == 0xB ? 0 : R);
+                if (XY == start)
+                {
+                    out.loopUnless(opcode == 0xB ? JNE : JAE, count, length, top, XY);
+                }
+                else
+                {
+                    out.exitUnless(opcode == 0xB ? JNE : JAE, count, exitValue(XY));
+                }
+            }
+            break;
+        case 0xC:
+            out.exit(count, exitValue(next, 0, HALTED));
+            ended = true;
+            break;
+        }
+        pc = next;
+    }
+    if (!ended)
+    {
+        out.exit(count, exitValue(pc));
+    }
+
+    Block& block = blocks[start];
+    block.valid = true;
+    block.length = count;
+    block.end = pc;
+    block.source.assign(cells + start, cells + pc);
+    block.code = nullptr;
+    if (count == 0)
+    {
+        // Remember the instruction that was refused so a rewrite of it is noticed by revalidate
+        block.source.assign(cells + start, cells + std::min(start + 2, 256));
+        return;
+    }
+    if (used + out.code.size() > BUFFER_SIZE)
+    {
+        flush();
+        blocks[start].valid = true;
+    }
+    std::memcpy(buffer + used, out.code.data(), out.code.size());
+    block.code = reinterpret_cast<BlockCode>(buffer + used);
+    used += out.code.size();
+    for (int i = start; i < pc; ++i)
+    {
+        codeMap[i] = 1;
+    }
+}
+
+void JIT::invalidate(int address)
+{
+    for (int start = 0; start < 256; ++start)
+    {
+        if (blocks[start].valid && start <= address && address < std::max(blocks[start].end, start + 2))
+        {
+            blocks[start].valid = false;
+            if (rewrites[start] < MAX_REWRITES)
+            {
+                ++rewrites[start];
+            }
+        }
+    }
+    std::memset(codeMap, 0, sizeof(codeMap));
+    for (int start = 0; start < 256; ++start)
+    {
+        if (blocks[start].valid && blocks[start].length > 0)
+        {
+            std::memset(codeMap + start, 1, blocks[start].end - start);
+        }
+    }
+}
+
+void JIT::flush()
+{
+    for (Block& block : blocks)
+    {
+        block.valid = false;
+    }
+    std::memset(codeMap, 0, sizeof(codeMap));
+    std::memset(rewrites, 0, sizeof(rewrites));
+    used = 0;
+}
+
+void JIT::revalidate()
+{
+    const std::uint8_t* cells = machine.memory.cells;
+    for (int start = 0; start < 256; ++start)
+    {
+        Block& block = blocks[start];
+        if (block.valid && std::memcmp(block.source.data(), cells + start, block.source.size()) != 0)
+        {
+            invalidate(start);
+        }
+    }
+}
+
+long long JIT::runBlock(long long limit)
+{
+    int pc = machine.cpu.getPC();
+    if (buffer != nullptr && !machine.memory.hasTraps() && !machine.memory.hasDevices() && pc >= 0 && pc <= 255)
+    {
+        if (!blocks[pc].valid)
+        {
+            translate(pc);
+        }
+        const Block& block = blocks[pc];
+        if (block.length > 0 && block.length <= limit)
+        {
+            context.limit = limit;
+            std::uint32_t result = block.code(&context);
+            machine.cpu.setPC(result & 0xFF);
+            if (result & HALTED)
+            {
+                machine.cpu.isHalt = true;
+            }
+            if (result & CODE_WRITTEN)
+            {
+                invalidate((result >> 16) & 0xFF);
+            }
+            return context.executed;
+        }
+    }
+
+    bool store = pc >= 0 && pc + 1 <= 255 && (machine.memory.getCell(pc) >> 4) == 0x3;
+    int target = store ? machine.memory.getCell(pc + 1) : 0;
+    machine.cpu.runInstruction(machine.memory);
+    if (store && codeMap[target])
+    {
+        invalidate(target);
+    }
+    return 1;
+}
+
+void JIT::run(long long maxSteps, long long& steps)
+{
+    revalidate();
+    while (steps < maxSteps && !machine.cpu.isHalt)
+    {
+        steps += runBlock(maxSteps - steps);
+    }
+}
+
+static std::string describeDivergence(const Machine& jit, const Machine& interpreter)
+{
+    if (jit.cpu.getPC() != interpreter.cpu.getPC())
+    {
+        return "PC: JIT " + ALU::DecToHex(jit.cpu.getPC()) + ", interpreter " + ALU::DecToHex(interpreter.cpu.getPC());
+    }
+    if (jit.cpu.isHalt != interpreter.cpu.isHalt)
+    {
+        return std::string("halt flag: JIT ") + (jit.cpu.isHalt ? "set" : "clear") + ", interpreter "
+            + (interpreter.cpu.isHalt ? "set" : "clear");
+    }
+    for (int i = 0; i < 16; ++i)
+    {
+        if (jit.cpu.reg.getValue(i) != interpreter.cpu.reg.getValue(i))
+        {
+            return "register " + std::to_string(i) + ": JIT " + ALU::DecToHex(jit.cpu.reg.getValue(i))
+                + ", interpreter " + ALU::DecToHex(interpreter.cpu.reg.getValue(i));
+        }
+    }
+    for (int i = 0; i < 256; ++i)
+    {
+        if (jit.memory.getCell(i) != interpreter.memory.getCell(i))
+        {
+            return "cell " + ALU::DecToHex(i) + ": JIT " + ALU::DecToHex(jit.memory.getCell(i))
+                + ", interpreter " + ALU::DecToHex(interpreter.memory.getCell(i));
+        }
+    }
+    if (jit.memory.screen.total() != interpreter.memory.screen.total()
+        || jit.memory.screen.ascii() != interpreter.memory.screen.ascii())
+    {
+        return "screen: JIT \"" + jit.memory.screen.hex() + "\", interpreter \"" + interpreter.memory.screen.hex() + "\"";
+    }
+    return "";
+}
+
+std::string JIT::verify(const Machine& start, long long maxSteps)
+{
+    Machine jitMachine = start;
+    Machine interpreter = start;
+    JIT jit(jitMachine);
+    long long steps = 0;
+    while (steps < maxSteps && !jitMachine.cpu.isHalt)
+    {
+        int pc = jitMachine.cpu.getPC();
+        long long count = 1;
+        std::string jitError;
+        std::string interpreterError;
+        try
+        {
+            count = jit.runBlock(maxSteps - steps);
+        }
+        catch (const std::exception& e)
+        {
+            jitError = e.what();
+        }
+        try
+        {
+            for (long long i = 0; i < count && !interpreter.cpu.isHalt; ++i)
+            {
+                interpreter.cpu.runInstruction(interpreter.memory);
+            }
+        }
+        catch (const std::exception& e)
+        {
+            interpreterError = e.what();
+        }
+
+        std::string where = "after step " + std::to_string(steps + count) + " (block at " + ALU::DecToHex(pc) + "): ";
+        if (jitError != interpreterError)
+        {
+            return where + "fault: JIT \"" + jitError + "\", interpreter \"" + interpreterError + "\"";
+        }
+        std::string difference = describeDivergence(jitMachine, interpreter);
+        if (!difference.empty())
+        {
+            return where + difference;
+        }
+        if (!jitError.empty())
+        {
+            break;
+        }
+        steps += count;
+    }
+    return "";
+}
@@ -0,0 +1,95 @@
+#pragma once
+
+#include "class_T4.h"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/**
+ * @brief The byte arrays of a machine handed to translated code
+ */
+struct JitContext
+{
+    std::uint8_t* registers;
+    std::uint8_t* cells;
+    DecodedInstruction* decoded;
+    const std::uint8_t* floatSums;
+    const std::uint8_t* codeMap;
+    std::int64_t limit;
+    std::int64_t executed;
+};
+
+/**
+ * @brief Translates blocks of Vole code into x86-64 code and runs them on one machine. A block
+ *        ends after a `C` or an unconditional `B0XY`, taken conditional `B`/`D` jumps leave it
+ *        early and a jump back to its own start loops inside the translated code. Instructions that cannot be translated (screen stores,
+ *        unknown opcodes, the last cell) are run by the interpreter, and so is code that keeps
+ *        rewriting itself and every machine with breakpoints or watchpoints set
+ */
+class JIT
+{
+private:
+    typedef std::uint32_t (*BlockCode)(JitContext* context);
+
+    struct Block
+    {
+        bool valid;
+        int length;
+        int end;
+        std::vector<std::uint8_t> source;
+        BlockCode code;
+    };
+
+    static const int MAX_BLOCK = 64;
+    static const int MAX_REWRITES = 4;
+    static const std::size_t BUFFER_SIZE = 1 << 20;
+
+    Machine& machine;
+    JitContext context;
+    Block blocks[256];
+    std::uint8_t codeMap[256];
+    std::uint8_t rewrites[256];
+    std::uint8_t* buffer;
+    std::size_t used;
+
+    void translate(int start);
+    void invalidate(int address);
+    void flush();
+
+    /**
+     * @brief Drops the blocks whose cells were changed behind the JIT's back since the last run
+     */
+    void revalidate();
+
+public:
+    explicit JIT(Machine& machine);
+    ~JIT();
+    JIT(const JIT&) = delete;
+    JIT& operator=(const JIT&) = delete;
+
+    /**
+     * @brief Whether translated code can run on this host, if not every step is interpreted
+     */
+    bool available() const { return buffer != nullptr; }
+
+    /**
+     * @brief Runs one translated block, or one instruction through the interpreter when the block
+     *        at the PC is empty or longer than `limit`
+     * @return The number of instructions executed
+     */
+    long long runBlock(long long limit);
+
+    /**
+     * @brief Runs the machine until it halts or `maxSteps` instructions were executed. Faults of
+     *        the interpreter propagate as exceptions
+     * @param steps The instruction counter, increased as instructions execute
+     */
+    void run(long long maxSteps, long long& steps);
+
+    /**
+     * @brief Runs a copy of `start` on the JIT and another copy on the interpreter, comparing their
+     *        state after every block
+     * @return A description of the first divergence, empty if none occurred in `maxSteps` instructions
+     */
+    static std::string verify(const Machine& start, long long maxSteps);
+};
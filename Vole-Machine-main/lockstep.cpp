@@ -0,0 +1,414 @@
+#include "lockstep.h"
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+
+typedef __m256i Vec;
+static const int WIDTH = 32;
+
+static inline Vec load(const std::uint8_t* p) { return _mm256_load_si256(reinterpret_cast<const Vec*>(p)); }
+static inline void store(std::uint8_t* p, Vec v) { _mm256_store_si256(reinterpret_cast<Vec*>(p), v); }
+static inline Vec splat(std::uint8_t value) { return _mm256_set1_epi8(static_cast<char>(value)); }
+static inline Vec add(Vec a, Vec b) { return _mm256_add_epi8(a, b); }
+static inline Vec bitOr(Vec a, Vec b) { return _mm256_or_si256(a, b); }
+static inline Vec bitAnd(Vec a, Vec b) { return _mm256_and_si256(a, b); }
+static inline Vec bitXor(Vec a, Vec b) { return _mm256_xor_si256(a, b); }
+static inline Vec equal(Vec a, Vec b) { return _mm256_cmpeq_epi8(a, b); }
+static inline Vec select(Vec mask, Vec yes, Vec no) { return _mm256_blendv_epi8(no, yes, mask); }
+
+/**
+ * @brief 0xFF in the lanes where `a < b` as unsigned bytes
+ */
+static inline Vec less(Vec a, Vec b) { return bitXor(equal(_mm256_max_epu8(a, b), a), splat(0xFF)); }
+
+static inline Vec shiftRight(Vec v, int n) { return _mm256_srl_epi16(v, _mm_cvtsi32_si128(n)); }
+static inline Vec shiftLeft(Vec v, int n) { return _mm256_sll_epi16(v, _mm_cvtsi32_si128(n)); }
+
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+
+typedef __m128i Vec;
+static const int WIDTH = 16;
+
+static inline Vec load(const std::uint8_t* p) { return _mm_load_si128(reinterpret_cast<const Vec*>(p)); }
+static inline void store(std::uint8_t* p, Vec v) { _mm_store_si128(reinterpret_cast<Vec*>(p), v); }
+static inline Vec splat(std::uint8_t value) { return _mm_set1_epi8(static_cast<char>(value)); }
+static inline Vec add(Vec a, Vec b) { return _mm_add_epi8(a, b); }
+static inline Vec bitOr(Vec a, Vec b) { return _mm_or_si128(a, b); }
+static inline Vec bitAnd(Vec a, Vec b) { return _mm_and_si128(a, b); }
+static inline Vec bitXor(Vec a, Vec b) { return _mm_xor_si128(a, b); }
+static inline Vec equal(Vec a, Vec b) { return _mm_cmpeq_epi8(a, b); }
+static inline Vec select(Vec mask, Vec yes, Vec no) { return _mm_or_si128(_mm_and_si128(mask, yes), _mm_andnot_si128(mask, no)); }
+static inline Vec less(Vec a, Vec b) { return bitXor(equal(_mm_max_epu8(a, b), a), splat(0xFF)); }
+static inline Vec shiftRight(Vec v, int n) { return _mm_srl_epi16(v, _mm_cvtsi32_si128(n)); }
+static inline Vec shiftLeft(Vec v, int n) { return _mm_sll_epi16(v, _mm_cvtsi32_si128(n)); }
+
+#else
+
+typedef std::uint8_t Vec;
+static const int WIDTH = 1;
+
+static inline Vec load(const std::uint8_t* p) { return *p; }
+static inline void store(std::uint8_t* p, Vec v) { *p = v; }
+static inline Vec splat(std::uint8_t value) { return value; }
+static inline Vec add(Vec a, Vec b) { return static_cast<Vec>(a + b); }
+static inline Vec bitOr(Vec a, Vec b) { return a | b; }
+static inline Vec bitAnd(Vec a, Vec b) { return a & b; }
+static inline Vec bitXor(Vec a, Vec b) { return a ^ b; }
+static inline Vec equal(Vec a, Vec b) { return a == b ? 0xFF : 0; }
+static inline Vec select(Vec mask, Vec yes, Vec no) { return static_cast<Vec>((mask & yes) | (~mask & no)); }
+static inline Vec less(Vec a, Vec b) { return a < b ? 0xFF : 0; }
+static inline Vec shiftRight(Vec v, int n) { return static_cast<Vec>(v >> n); }
+static inline Vec shiftLeft(Vec v, int n) { return static_cast<Vec>(v << n); }
+
+#endif
+
+/**
+ * @brief Rotates every byte right by `n` bits, 0 < n < 8. The shifts work on 16-bit units, so the
+ *        bits crossing into the neighbouring byte are masked off
+ */
+static inline Vec rotate(Vec v, int n)
+{
+    return bitOr(bitAnd(shiftRight(v, n), splat(0xFF >> n)), bitAnd(shiftLeft(v, 8 - n), splat(static_cast<std::uint8_t>(0xFF << (8 - n)))));
+}
+
+/**
+ * @brief `row = mask ? op(a, b) : row` over all lanes
+ */
+template <typename Op>
+static inline void blend(std::uint8_t* row, const std::uint8_t* mask, const std::uint8_t* a, const std::uint8_t* b, Op op)
+{
+    for (int i = 0; i < Lockstep::LANES; i += WIDTH)
+    {
+        store(row + i, select(load(mask + i), op(load(a + i), load(b + i)), load(row + i)));
+    }
+}
+
+/**
+ * @brief `row = mask ? value : row` over all lanes
+ */
+static inline void fill(std::uint8_t* row, const std::uint8_t* mask, std::uint8_t value)
+{
+    Vec v = splat(value);
+    for (int i = 0; i < Lockstep::LANES; i += WIDTH)
+    {
+        store(row + i, select(load(mask + i), v, load(row + i)));
+    }
+}
+
+/**
+ * @brief `out = mask & test(a, b)` over all lanes
+ */
+template <typename Test>
+static inline void narrow(std::uint8_t* out, const std::uint8_t* mask, const std::uint8_t* a, const std::uint8_t* b, Test test)
+{
+    for (int i = 0; i < Lockstep::LANES; i += WIDTH)
+    {
+        store(out + i, bitAnd(load(mask + i), test(load(a + i), load(b + i))));
+    }
+}
+
+/**
+ * @brief `mask = mask & (row == value)` over all lanes
+ */
+static inline void narrow(std::uint8_t* mask, const std::uint8_t* row, std::uint8_t value)
+{
+    Vec v = splat(value);
+    for (int i = 0; i < Lockstep::LANES; i += WIDTH)
+    {
+        store(mask + i, bitAnd(load(mask + i), equal(load(row + i), v)));
+    }
+}
+
+Lockstep::Lockstep(const std::vector<Machine>& machines) : lanes(static_cast<int>(machines.size()))
+{
+    if (lanes < 1 || lanes > LANES)
+    {
+        throw std::out_of_range("Lockstep needs between 1 and 64 machines");
+    }
+    for (const Machine& machine : machines)
+    {
+        if (machine.memory.hasDevices())
+        {
+            throw std::invalid_argument("Lockstep only runs machines without devices");
+        }
+    }
+    for (int lane = 0; lane < LANES; ++lane)
+    {
+        const Machine& machine = machines[lane < lanes ? lane : 0];
+        const std::uint8_t* memory = machine.memory.cells;
+        const std::uint8_t* values = machine.cpu.reg.registers;
+        for (int i = 0; i < 256; ++i)
+        {
+            cells[i][lane] = memory[i];
+        }
+        for (int i = 0; i < 16; ++i)
+        {
+            registers[i][lane] = values[i];
+        }
+        pcs[lane] = static_cast<std::uint8_t>(machine.cpu.getPC());
+        alive[lane] = lane < lanes && !machine.cpu.isHalt ? 0xFF : 0;
+        status[lane] = alive[lane] ? RUNNING : HALTED;
+        steps[lane] = 0;
+        pending[lane] = 0;
+    }
+    for (int lane = 0; lane < lanes; ++lane)
+    {
+        const Screen& screen = machines[lane].memory.screen;
+        if (screen.total() != 0 || screen.getSink())
+        {
+            screens[lane] = screen;
+        }
+    }
+}
+
+void Lockstep::fault(const std::uint8_t* mask, const char* message)
+{
+    for (int lane = 0; lane < LANES; ++lane)
+    {
+        if (mask[lane])
+        {
+            alive[lane] = 0;
+            status[lane] = FAULTED;
+            faults[lane] = message;
+        }
+    }
+}
+
+void Lockstep::execute(const std::uint8_t* mask, int pc, std::uint8_t hi, std::uint8_t lo)
+{
+    int op = hi >> 4;
+    std::uint8_t* r = registers[hi & 0xF];
+    std::uint8_t* s = registers[lo >> 4];
+    std::uint8_t* t = registers[lo & 0xF];
+    std::uint8_t* cell = cells[lo];
+    alignas(32) std::uint8_t scratch[LANES];
+
+    auto copy = [](Vec x, Vec) { return x; };
+    fill(pcs, mask, static_cast<std::uint8_t>(pc + 2));
+
+    switch (op)
+    {
+    case 0x1:
+        blend(r, mask, cell, cell, copy);
+        break;
+    case 0x2:
+        fill(r, mask, lo);
+        break;
+    case 0x3:
+        blend(cell, mask, r, r, copy);
+        if (lo == 0)
+        {
+            for (int lane = 0; lane < LANES; ++lane)
+            {
+                if (mask[lane])
+                {
+                    screens[lane].put(r[lane]);
+                }
+            }
+        }
+        break;
+    case 0x4:
+        blend(t, mask, s, s, copy);
+        break;
+    case 0x5:
+        blend(r, mask, s, t, add);
+        break;
+    case 0x6:
+        for (int lane = 0; lane < LANES; ++lane)
+        {
+            scratch[lane] = ALU::addFloat(s[lane], t[lane]);
+        }
+        blend(r, mask, scratch, scratch, copy);
+        break;
+    case 0x7:
+        blend(r, mask, s, t, bitOr);
+        break;
+    case 0x8:
+        blend(r, mask, s, t, bitAnd);
+        break;
+    case 0x9:
+        blend(r, mask, s, t, bitXor);
+        break;
+    case 0xA:
+        if (lo & 7)
+        {
+            int n = lo & 7;
+            blend(r, mask, r, r, [n](Vec x, Vec) { return rotate(x, n); });
+        }
+        break;
+    case 0xB:
+    case 0xD:
+        if (op == 0xB)
+        {
+            narrow(scratch, mask, r, registers[0], equal);
+        }
+        else
+        {
+            narrow(scratch, mask, registers[0], r, less);
+        }
+        fill(pcs, scratch, lo);
+        break;
+    case 0xC:
+        for (int lane = 0; lane < LANES; ++lane)
+        {
+            if (mask[lane])
+            {
+                alive[lane] = 0;
+                status[lane] = HALTED;
+            }
+        }
+        break;
+    default:
+        fault(mask, RunStatus::describe(RunStatus::BAD_OPCODE));
+        return;
+    }
+    Vec one = splat(1);
+    for (int i = 0; i < LANES; i += WIDTH)
+    {
+        store(pending + i, add(load(pending + i), bitAnd(load(mask + i), one)));
+    }
+}
+
+void Lockstep::settle()
+{
+    for (int lane = 0; lane < LANES; ++lane)
+    {
+        steps[lane] += pending[lane];
+        pending[lane] = 0;
+    }
+}
+
+void Lockstep::run(long long maxSteps)
+{
+    alignas(32) std::uint8_t mask[LANES];
+    for (long long issued = 0;; ++issued)
+    {
+        // No lane can have used up the budget before that many steps were issued
+        if (issued >= maxSteps || issued % 255 == 0)
+        {
+            settle();
+        }
+        if (issued >= maxSteps)
+        {
+            for (int lane = 0; lane < LANES; ++lane)
+            {
+                if (alive[lane] && steps[lane] >= maxSteps)
+                {
+                    alive[lane] = 0;
+                    status[lane] = BUDGET;
+                }
+            }
+        }
+        std::uint8_t running = 0;
+        std::uint8_t pc = 0xFF;
+        for (int lane = 0; lane < LANES; ++lane)
+        {
+            running |= alive[lane];
+            pc = std::min<std::uint8_t>(pc, pcs[lane] | static_cast<std::uint8_t>(~alive[lane]));
+        }
+        if (!running)
+        {
+            settle();
+            return;
+        }
+
+        std::memcpy(mask, alive, LANES);
+        narrow(mask, pcs, pc);
+        if (pc + 2 > 255)
+        {
+            fault(mask, RunStatus::describe(RunStatus::PC_OVERFLOW));
+            continue;
+        }
+
+        int first = 0;
+        while (!mask[first])
+        {
+            ++first;
+        }
+        std::uint8_t hi = cells[pc][first];
+        std::uint8_t lo = cells[pc + 1][first];
+        narrow(mask, cells[pc], hi);
+        narrow(mask, cells[pc + 1], lo);
+        execute(mask, pc, hi, lo);
+    }
+}
+
+Machine Lockstep::machine(int lane) const
+{
+    if (lane < 0 || lane >= lanes)
+    {
+        throw std::out_of_range("Lane is out of range");
+    }
+    std::uint8_t memory[256];
+    for (int i = 0; i < 256; ++i)
+    {
+        memory[i] = cells[i][lane];
+    }
+    Machine machine;
+    machine.loadBytes(memory, 256, 0, pcs[lane]);
+    for (int i = 0; i < 16; ++i)
+    {
+        machine.cpu.reg.setValue(i, registers[i][lane]);
+    }
+    machine.cpu.isHalt = status[lane] == HALTED;
+    machine.memory.screen = screens[lane];
+    return machine;
+}
+
+std::string Lockstep::verify(const Machine& start, long long maxSteps)
+{
+    std::vector<Machine> machines(LANES, start);
+    for (int lane = 1; lane < LANES; ++lane)
+    {
+        for (int i = 1; i < 16; ++i)
+        {
+            machines[lane].cpu.reg.setValue(i, static_cast<std::uint8_t>(start.cpu.reg.getValue(i) + lane * (i + 1)));
+        }
+    }
+    Lockstep lockstep(machines);
+    lockstep.run(maxSteps);
+
+    for (int lane = 0; lane < LANES; ++lane)
+    {
+        Machine& machine = machines[lane];
+        Status expected = machine.cpu.isHalt ? HALTED : BUDGET;
+        std::string fault;
+        long long executed = 0;
+        try
+        {
+            while (!machine.cpu.isHalt && executed < maxSteps)
+            {
+                machine.cpu.runInstruction(machine.memory);
+                ++executed;
+            }
+            expected = machine.cpu.isHalt ? HALTED : BUDGET;
+        }
+        catch (const std::exception& e)
+        {
+            expected = FAULTED;
+            fault = e.what();
+        }
+
+        Machine result = lockstep.machine(lane);
+        std::string where = "lane " + std::to_string(lane) + " ";
+        if (lockstep.laneStatus(lane) != expected || lockstep.laneFault(lane) != fault)
+        {
+            return where + "status: lockstep " + std::to_string(lockstep.laneStatus(lane)) + " " + lockstep.laneFault(lane)
+                + ", interpreter " + std::to_string(expected) + " " + fault;
+        }
+        if (lockstep.laneSteps(lane) != executed)
+        {
+            return where + "steps: lockstep " + std::to_string(lockstep.laneSteps(lane)) + ", interpreter " + std::to_string(executed);
+        }
+        if (result.snapshot() != machine.snapshot())
+        {
+            return where + "state differs at PC " + ALU::DecToHex(machine.cpu.getPC()) + ", lockstep PC "
+                + ALU::DecToHex(result.cpu.getPC());
+        }
+    }
+    return "";
+}
@@ -0,0 +1,87 @@
+#pragma once
+
+#include "class_T4.h"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/**
+ * @brief Runs up to `LANES` machines side by side, one byte per lane. Cell j of every lane is
+ *        stored contiguously and so is register k, so an instruction is executed for all lanes
+ *        with a few vector operations (AVX2 when compiled with it, otherwise SSE2 or plain loops).
+ *
+ *        Each step executes the instruction at the lowest PC of the running lanes, for every lane
+ *        that is at that PC and holds the same instruction there. Lanes that diverged on `B`/`D` or
+ *        rewrote their code differently simply wait, and run again as soon as they hold the lowest PC
+ */
+class Lockstep
+{
+public:
+    static const int LANES = 64;
+
+    enum Status : std::uint8_t
+    {
+        RUNNING,
+        HALTED,
+        BUDGET,
+        FAULTED
+    };
+
+private:
+    alignas(32) std::uint8_t cells[256][LANES];
+    alignas(32) std::uint8_t registers[16][LANES];
+    alignas(32) std::uint8_t pcs[LANES];
+    alignas(32) std::uint8_t alive[LANES];
+    alignas(32) std::uint8_t pending[LANES];
+    long long steps[LANES];
+    Status status[LANES];
+    std::string faults[LANES];
+    Screen screens[LANES];
+    int lanes;
+
+    /**
+     * @brief Stops the lanes selected by `mask` with `message`
+     */
+    void fault(const std::uint8_t* mask, const char* message);
+
+    /**
+     * @brief Adds the step counts kept per lane in `pending`, which wrap after 255 steps, to `steps`
+     */
+    void settle();
+
+    /**
+     * @brief Executes the instruction `hi lo` at `pc` for the lanes selected by `mask`
+     */
+    void execute(const std::uint8_t* mask, int pc, std::uint8_t hi, std::uint8_t lo);
+
+public:
+    /**
+     * @brief Copies one machine into each lane, there must be between 1 and `LANES` of them. A PC
+     *        beyond the last cell is taken modulo 256
+     * @throws std::invalid_argument if a machine has devices mapped
+     */
+    explicit Lockstep(const std::vector<Machine>& machines);
+
+    /**
+     * @brief Steps all lanes until every one of them halted, faulted or executed `maxSteps` instructions
+     */
+    void run(long long maxSteps);
+
+    int count() const { return lanes; }
+
+    /**
+     * @brief The state of `lane` as a machine of its own
+     */
+    Machine machine(int lane) const;
+
+    Status laneStatus(int lane) const { return status[lane]; }
+    const std::string& laneFault(int lane) const { return faults[lane]; }
+    long long laneSteps(int lane) const { return steps[lane]; }
+
+    /**
+     * @brief Runs `LANES` copies of `start` whose registers differ per lane in lockstep and each one
+     *        on its own through `CPU::runInstruction`, then compares them
+     * @return A description of the first difference, empty if all lanes match
+     */
+    static std::string verify(const Machine& start, long long maxSteps);
+};
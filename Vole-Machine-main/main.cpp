@@ -1,10 +1,227 @@
-#include"class_T4.h"
-
-using namespace std;
-
-int main(){
-    VoleMain run;
-    Memory mem;
-    Register reg;
-    run.init(run.machine.memory, run.machine.cpu.reg);
-}
\ No newline at end of file
+#include"class_T4.h"
+#include"batch.h"
+#include"devices.h"
+#include"explorer.h"
+#include"fuzzer.h"
+#include"image.h"
+#include"jit.h"
+#include"lockstep.h"
+#include"multicore.h"
+#include"profiler.h"
+#include"regress.h"
+#include"scheduler.h"
+#include"server.h"
+#include"trace.h"
+#include<iostream>
+#include<memory>
+#include<string>
+#include<vector>
+
+using namespace std;
+
+int main(int argc, char* argv[]){
+    vector<string> args(argv + 1, argv + argc);
+    if (!args.empty() && args[0] == "--batch")
+    {
+        return BatchRunner::main(vector<string>(args.begin() + 1, args.end()));
+    }
+    if (!args.empty() && args[0] == "--regress")
+    {
+        return Regression::main(vector<string>(args.begin() + 1, args.end()));
+    }
+    if (!args.empty() && args[0] == "--serve")
+    {
+        return JobServer::main(vector<string>(args.begin() + 1, args.end()));
+    }
+    if (!args.empty() && args[0] == "--submit")
+    {
+        return JobServer::submit(vector<string>(args.begin() + 1, args.end()));
+    }
+    if (!args.empty() && args[0] == "--scheduler")
+    {
+        return Scheduler::main(vector<string>(args.begin() + 1, args.end()));
+    }
+    if (!args.empty() && args[0] == "--explore")
+    {
+        return Explorer::main(vector<string>(args.begin() + 1, args.end()));
+    }
+    if (!args.empty() && args[0] == "--fuzz")
+    {
+        return Fuzzer::main(vector<string>(args.begin() + 1, args.end()));
+    }
+    if (!args.empty() && args[0] == "--run")
+    {
+        return DeviceRunner::main(vector<string>(args.begin() + 1, args.end()));
+    }
+    if (!args.empty() && args[0] == "--multicore")
+    {
+        return MultiCore::main(vector<string>(args.begin() + 1, args.end()));
+    }
+    if (!args.empty() && (args[0] == "--convert" || args[0] == "--pack"))
+    {
+        return ImageFormat::main(args);
+    }
+    if (!args.empty() && args[0] == "--trace")
+    {
+        if (args.size() < 3)
+        {
+            cerr << "Usage: simulator --trace trace.vtr program [XY] [steps]\n";
+            return 2;
+        }
+        Machine machine;
+        try
+        {
+            machine.loadProgram(args[2], args.size() > 3 ? args[3] : "10");
+            TraceRecorder recorder(args[1], machine);
+            try
+            {
+                recorder.run(machine, args.size() > 4 ? stoll(args[4]) : 1000000);
+            }
+            catch (const exception& e)
+            {
+                cerr << e.what() << '\n';
+            }
+            recorder.finish();
+            cout << "Recorded " << recorder.count() << " steps\n";
+        }
+        catch (const exception& e)
+        {
+            cerr << e.what() << '\n';
+            return 1;
+        }
+        return 0;
+    }
+    if (!args.empty() && args[0] == "--profile")
+    {
+        if (args.size() < 2)
+        {
+            cerr << "Usage: simulator --profile program [XY] [steps]\n";
+            return 2;
+        }
+        Machine machine;
+        Profiler profiler;
+        try
+        {
+            machine.loadProgram(args[1], args.size() > 2 ? args[2] : "10");
+            profiler.run(machine, args.size() > 3 ? stoll(args[3]) : 1000000);
+        }
+        catch (const exception& e)
+        {
+            cerr << e.what() << '\n';
+        }
+        profiler.report(cout, machine);
+        return 0;
+    }
+    if (!args.empty() && args[0] == "--lockstep-verify")
+    {
+        if (args.size() < 2)
+        {
+            cerr << "Usage: simulator --lockstep-verify program [XY] [steps]\n";
+            return 2;
+        }
+        Machine machine;
+        try
+        {
+            machine.loadProgram(args[1], args.size() > 2 ? args[2] : "10");
+        }
+        catch (const exception& e)
+        {
+            cerr << e.what() << '\n';
+            return 1;
+        }
+        string difference = Lockstep::verify(machine, args.size() > 3 ? stoll(args[3]) : 1000000);
+        if (!difference.empty())
+        {
+            cout << "Difference in " << difference << '\n';
+            return 1;
+        }
+        cout << "Lockstep and interpreter agree on all " << Lockstep::LANES << " lanes\n";
+        return 0;
+    }
+    if (!args.empty() && args[0] == "--jit-verify")
+    {
+        if (args.size() < 2)
+        {
+            cerr << "Usage: simulator --jit-verify program [XY] [steps]\n";
+            return 2;
+        }
+        Machine machine;
+        try
+        {
+            machine.loadProgram(args[1], args.size() > 2 ? args[2] : "10");
+        }
+        catch (const exception& e)
+        {
+            cerr << e.what() << '\n';
+            return 1;
+        }
+        string divergence = JIT::verify(machine, args.size() > 3 ? stoll(args[3]) : 1000000);
+        if (!divergence.empty())
+        {
+            cout << "First divergence " << divergence << '\n';
+            return 1;
+        }
+        cout << "JIT and interpreter agree\n";
+        return 0;
+    }
+    if (!args.empty() && args[0] == "--extended")
+    {
+        if (args.size() < 2)
+        {
+            cerr << "Usage: simulator --extended program [XXXX] [steps]\n";
+            return 2;
+        }
+        unique_ptr<ExtendedMachine> machine(new ExtendedMachine());
+        long long steps = 0;
+        try
+        {
+            machine->loadProgram(args[1], args.size() > 2 ? args[2] : "0010");
+            long long maxSteps = args.size() > 3 ? stoll(args[3]) : 1000000;
+            RunStatus::Code code = machine->cpu.run(machine->memory, maxSteps, steps);
+            if (code != RunStatus::HALTED && code != RunStatus::BUDGET)
+            {
+                cerr << RunStatus::describe(code) << '\n';
+            }
+        }
+        catch (const exception& e)
+        {
+            cerr << e.what() << '\n';
+        }
+        cout << "Steps: " << steps << "  PC: " << ALU::DecToHex(machine->cpu.getPC() >> 8)
+             << ALU::DecToHex(machine->cpu.getPC()) << (machine->cpu.isHalt ? "  halted" : "") << "\n=== Registers ===\n";
+        for (int i = 0; i < 16; ++i)
+        {
+            cout << ALU::DecToHex(machine->cpu.reg.getValue(i)) << ((i + 1) % 4 == 0 ? "\n" : "  ");
+        }
+        cout << "=== Screen ===\n" << "ASCII: " << machine->memory.screen.ascii() << '\n';
+        return 0;
+    }
+    VoleMain run;
+    for (size_t i = 0; i + 1 < args.size(); i += 2)
+    {
+        try
+        {
+            if (args[i] == "--steps")
+            {
+                run.maxSteps = stoll(args[i + 1]);
+                continue;
+            }
+            if (args[i] == "--timeout")
+            {
+                run.timeout = stod(args[i + 1]);
+                continue;
+            }
+            if (args[i] == "--checkpoint")
+            {
+                run.checkpointInterval = stoll(args[i + 1]);
+                continue;
+            }
+        }
+        catch (const exception&)
+        {
+        }
+        cerr << "Usage: simulator [--steps n] [--timeout seconds] [--checkpoint n]\n";
+        return 2;
+    }
+    run.init(run.machine.memory, run.machine.cpu.reg);
+}
@@ -0,0 +1,447 @@
+#include "multicore.h"
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+
+MultiCore::MultiCore(const Machine& machine, int count) : screenWritten(0), startScreen(machine.memory.screen)
+{
+    if (count < 1 || count > MAX_CORES)
+    {
+        throw std::out_of_range("MultiCore needs between 1 and 64 cores");
+    }
+    if (machine.memory.hasDevices())
+    {
+        throw std::invalid_argument("MultiCore only runs machines without devices");
+    }
+    for (int i = 0; i < 256; ++i)
+    {
+        cells[i].store(machine.memory.getCell(i), std::memory_order_relaxed);
+    }
+    for (std::size_t i = 0; i < Screen::CAPACITY; ++i)
+    {
+        screenRing[i].store(0, std::memory_order_relaxed);
+    }
+    Core core;
+    for (int i = 0; i < 16; ++i)
+    {
+        core.registers[i] = machine.cpu.reg.getValue(i);
+    }
+    core.pc = machine.cpu.getPC() & 0xFF;
+    core.steps = 0;
+    core.status = machine.cpu.isHalt ? RunStatus::HALTED : RunStatus::RUNNING;
+    cores.assign(count, core);
+}
+
+MultiCore::Core& MultiCore::at(int core)
+{
+    if (core < 0 || core >= count())
+    {
+        throw std::out_of_range("Core is out of range");
+    }
+    return cores[core];
+}
+
+const MultiCore::Core& MultiCore::at(int core) const
+{
+    if (core < 0 || core >= count())
+    {
+        throw std::out_of_range("Core is out of range");
+    }
+    return cores[core];
+}
+
+void MultiCore::setPC(int core, int pc)
+{
+    if (pc < 0 || pc > 255)
+    {
+        throw std::out_of_range("Memory address is out of range");
+    }
+    at(core).pc = pc;
+}
+
+void MultiCore::setRegister(int core, int reg, std::uint8_t value)
+{
+    if (reg < 0 || reg > 15)
+    {
+        throw std::out_of_range("Register index is out of range");
+    }
+    at(core).registers[reg] = value;
+}
+
+void MultiCore::put(std::uint8_t value)
+{
+    std::uint64_t ticket = screenWritten.fetch_add(1, std::memory_order_relaxed);
+    std::uint64_t entry = (ticket + 1) << 8 | value;
+    std::atomic<std::uint64_t>& slot = screenRing[ticket % Screen::CAPACITY];
+    std::uint64_t old = slot.load(std::memory_order_relaxed);
+    while (old < entry && !slot.compare_exchange_weak(old, entry, std::memory_order_relaxed))
+    {
+    }
+}
+
+RunStatus::Code MultiCore::step(Core& core)
+{
+    int pc = core.pc;
+    if (pc + 2 > 255)
+    {
+        return RunStatus::PC_OVERFLOW;
+    }
+    std::uint8_t hi = cells[pc].load(std::memory_order_relaxed);
+    std::uint8_t lo = cells[pc + 1].load(std::memory_order_relaxed);
+    core.pc = pc + 2;
+
+    std::uint8_t* reg = core.registers;
+    int r = hi & 0xF;
+    int x = lo >> 4;
+    int y = lo & 0xF;
+    switch (hi >> 4)
+    {
+    case 0x1:
+        reg[r] = cells[lo].load();
+        break;
+    case 0x2:
+        reg[r] = lo;
+        break;
+    case 0x3:
+        cells[lo].store(reg[r]);
+        if (lo == 0)
+        {
+            put(reg[r]);
+        }
+        break;
+    case 0x4:
+        reg[y] = reg[x];
+        break;
+    case 0x5:
+        reg[r] = ALU::addInt(reg[x], reg[y]);
+        break;
+    case 0x6:
+        reg[r] = ALU::addFloat(reg[x], reg[y]);
+        break;
+    case 0x7:
+        reg[r] = ALU::orBits(reg[x], reg[y]);
+        break;
+    case 0x8:
+        reg[r] = ALU::andBits(reg[x], reg[y]);
+        break;
+    case 0x9:
+        reg[r] = ALU::xorBits(reg[x], reg[y]);
+        break;
+    case 0xA:
+        reg[r] = ALU::rotateRight(reg[r], y);
+        break;
+    case 0xB:
+        if (reg[0] == reg[r])
+        {
+            core.pc = lo;
+        }
+        break;
+    case 0xC:
+        return RunStatus::HALTED;
+    case 0xD:
+        if (reg[0] < reg[r])
+        {
+            core.pc = lo;
+        }
+        break;
+    default:
+        return RunStatus::BAD_OPCODE;
+    }
+    return RunStatus::RUNNING;
+}
+
+void MultiCore::runCore(Core& core, long long limit)
+{
+    while (core.status == RunStatus::RUNNING && core.steps < limit)
+    {
+        RunStatus::Code code = step(core);
+        if (code == RunStatus::RUNNING || code == RunStatus::HALTED)
+        {
+            ++core.steps;
+        }
+        core.status = code;
+    }
+}
+
+void MultiCore::run(long long maxSteps)
+{
+    for (Core& core : cores)
+    {
+        if (core.status == RunStatus::BUDGET)
+        {
+            core.status = RunStatus::RUNNING;
+        }
+    }
+    std::vector<std::thread> threads;
+    for (std::size_t i = 1; i < cores.size(); ++i)
+    {
+        threads.emplace_back([this, i, maxSteps] { runCore(cores[i], maxSteps); });
+    }
+    runCore(cores[0], maxSteps);
+    for (std::thread& thread : threads)
+    {
+        thread.join();
+    }
+    for (Core& core : cores)
+    {
+        if (core.status == RunStatus::RUNNING)
+        {
+            core.status = RunStatus::BUDGET;
+        }
+    }
+}
+
+void MultiCore::runScheduled(long long maxSteps, std::uint32_t seed, int quantum, std::vector<Slice>* schedule)
+{
+    std::mt19937 random(seed);
+    std::vector<int> live;
+    for (int i = 0; i < count(); ++i)
+    {
+        if (cores[i].status == RunStatus::BUDGET)
+        {
+            cores[i].status = RunStatus::RUNNING;
+        }
+        if (cores[i].status == RunStatus::RUNNING && cores[i].steps < maxSteps)
+        {
+            live.push_back(i);
+        }
+    }
+    quantum = std::max(quantum, 1);
+    while (!live.empty())
+    {
+        std::size_t pick = random() % live.size();
+        Core& core = cores[live[pick]];
+        long long before = core.steps;
+        runCore(core, std::min(maxSteps, before + 1 + static_cast<long long>(random() % quantum)));
+        if (schedule && core.steps > before)
+        {
+            schedule->push_back(Slice{live[pick], core.steps - before});
+        }
+        if (core.status != RunStatus::RUNNING || core.steps >= maxSteps)
+        {
+            live.erase(live.begin() + pick);
+        }
+    }
+    for (Core& core : cores)
+    {
+        if (core.status == RunStatus::RUNNING)
+        {
+            core.status = RunStatus::BUDGET;
+        }
+    }
+}
+
+void MultiCore::replay(const std::vector<Slice>& schedule)
+{
+    for (const Slice& slice : schedule)
+    {
+        Core& core = at(slice.core);
+        if (core.status == RunStatus::BUDGET)
+        {
+            core.status = RunStatus::RUNNING;
+        }
+        runCore(core, core.steps + slice.steps);
+    }
+}
+
+Machine MultiCore::machine(int core) const
+{
+    const Core& state = at(core);
+    std::uint8_t memory[256];
+    for (int i = 0; i < 256; ++i)
+    {
+        memory[i] = cells[i].load();
+    }
+    Machine machine;
+    machine.loadBytes(memory, 256, 0, state.pc);
+    for (int i = 0; i < 16; ++i)
+    {
+        machine.cpu.reg.setValue(i, state.registers[i]);
+    }
+    machine.cpu.isHalt = state.status == RunStatus::HALTED;
+
+    std::string kept = startScreen.ascii();
+    std::uint64_t written = screenWritten.load();
+    std::uint64_t first = written < Screen::CAPACITY ? 0 : written - Screen::CAPACITY;
+    for (std::uint64_t i = first; i < written; ++i)
+    {
+        kept += char(screenRing[i % Screen::CAPACITY].load() & 0xFF);
+    }
+    std::size_t skip = kept.size() > Screen::CAPACITY ? kept.size() - Screen::CAPACITY : 0;
+    machine.memory.screen = startScreen;
+    machine.memory.screen.assign(reinterpret_cast<const std::uint8_t*>(kept.data()) + skip, kept.size() - skip,
+                                 startScreen.total() + written);
+    return machine;
+}
+
+void MultiCore::writeSchedule(const std::string& fileName, const std::vector<Slice>& schedule)
+{
+    std::ofstream fout(fileName);
+    for (const Slice& slice : schedule)
+    {
+        fout << slice.core << ' ' << slice.steps << '\n';
+    }
+    if (!fout)
+    {
+        throw std::runtime_error("Failed to write " + fileName);
+    }
+}
+
+std::vector<MultiCore::Slice> MultiCore::readSchedule(const std::string& fileName)
+{
+    std::ifstream fin(fileName);
+    if (!fin)
+    {
+        throw std::runtime_error("Failed to open " + fileName);
+    }
+    std::vector<Slice> schedule;
+    std::string line;
+    int number = 0;
+    while (std::getline(fin, line))
+    {
+        ++number;
+        if (line.find_first_not_of(" \t\r") == std::string::npos)
+        {
+            continue;
+        }
+        std::istringstream in(line);
+        Slice slice;
+        std::string rest;
+        if (!(in >> slice.core >> slice.steps) || (in >> rest) || slice.core < 0 || slice.core >= MAX_CORES || slice.steps < 0)
+        {
+            throw std::runtime_error(fileName + ":" + std::to_string(number) + ": expected \"core steps\"");
+        }
+        schedule.push_back(slice);
+    }
+    return schedule;
+}
+
+int MultiCore::main(const std::vector<std::string>& args)
+{
+    std::vector<std::string> positional;
+    bool scheduled = false;
+    std::uint32_t seed = 0;
+    int quantum = 16;
+    std::string scheduleFile;
+    std::string replayFile;
+    try
+    {
+        for (std::size_t i = 0; i < args.size(); ++i)
+        {
+            const std::string& arg = args[i];
+            bool hasValue = i + 1 < args.size();
+            if (arg == "--seed" && hasValue)
+            {
+                scheduled = true;
+                seed = static_cast<std::uint32_t>(std::stoul(args[++i]));
+            }
+            else if (arg == "--quantum" && hasValue)
+            {
+                quantum = std::stoi(args[++i]);
+            }
+            else if (arg == "--schedule" && hasValue)
+            {
+                scheduleFile = args[++i];
+            }
+            else if (arg == "--replay" && hasValue)
+            {
+                replayFile = args[++i];
+            }
+            else
+            {
+                positional.push_back(arg);
+            }
+        }
+    }
+    catch (const std::exception&)
+    {
+        std::cerr << "Invalid number argument\n";
+        return 2;
+    }
+    if (positional.empty() || positional.size() > 4 || (!scheduleFile.empty() && !scheduled)
+        || (scheduled && !replayFile.empty()))
+    {
+        std::cerr << "Usage: simulator --multicore [--seed n [--quantum q] [--schedule file] | --replay file] "
+                     "program [XY] [cores] [steps]\n";
+        return 2;
+    }
+
+    Machine loaded;
+    int cores = 0;
+    long long maxSteps = 0;
+    try
+    {
+        loaded.loadProgram(positional[0], positional.size() > 1 ? positional[1] : "10");
+        cores = positional.size() > 2 ? std::stoi(positional[2]) : static_cast<int>(std::thread::hardware_concurrency());
+        maxSteps = positional.size() > 3 ? std::stoll(positional[3]) : 1000000;
+        cores = cores < 1 ? 1 : cores > MAX_CORES ? MAX_CORES : cores;
+    }
+    catch (const std::exception& e)
+    {
+        std::cerr << e.what() << '\n';
+        return 1;
+    }
+
+    MultiCore multiCore(loaded, cores);
+    for (int i = 0; i < cores; ++i)
+    {
+        multiCore.setRegister(i, 0xF, static_cast<std::uint8_t>(i));
+    }
+    auto start = std::chrono::steady_clock::now();
+    try
+    {
+        if (!replayFile.empty())
+        {
+            multiCore.replay(readSchedule(replayFile));
+        }
+        else if (scheduled)
+        {
+            std::vector<Slice> schedule;
+            multiCore.runScheduled(maxSteps, seed, quantum, scheduleFile.empty() ? nullptr : &schedule);
+            if (!scheduleFile.empty())
+            {
+                writeSchedule(scheduleFile, schedule);
+                std::cout << "Wrote " << schedule.size() << " slices to " << scheduleFile << '\n';
+            }
+        }
+        else
+        {
+            multiCore.run(maxSteps);
+        }
+    }
+    catch (const std::exception& e)
+    {
+        std::cerr << e.what() << '\n';
+        return 1;
+    }
+    double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    long long total = 0;
+    bool faulted = false;
+    for (int i = 0; i < cores; ++i)
+    {
+        Machine machine = multiCore.machine(i);
+        RunStatus::Code status = multiCore.coreStatus(i);
+        total += multiCore.coreSteps(i);
+        faulted = faulted || status == RunStatus::BAD_OPCODE || status == RunStatus::PC_OVERFLOW;
+        std::cout << "Core " << i << ": " << RunStatus::describe(status) << "  Steps: " << multiCore.coreSteps(i)
+                  << "  PC: " << ALU::DecToHex(machine.cpu.getPC()) << "\n";
+        for (int r = 0; r < 16; ++r)
+        {
+            std::cout << ALU::DecToHex(machine.cpu.reg.getValue(r)) << (r == 15 ? "\n" : " ");
+        }
+    }
+    Machine shared = multiCore.machine(0);
+    std::cout << "Ran " << total << " instructions in " << elapsed << " s\n=== Memory ===\n";
+    for (int i = 0; i < 256; ++i)
+    {
+        std::cout << ALU::DecToHex(shared.memory.getCell(i)) << ((i + 1) % 16 == 0 ? "\n" : "  ");
+    }
+    std::cout << "=== Screen ===\n" << "ASCII: " << shared.memory.screen.ascii() << '\n';
+    return faulted ? 1 : 0;
+}
@@ -0,0 +1,140 @@
+#pragma once
+
+#include "class_T4.h"
+#include "screen.h"
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/**
+ * @brief Several Vole cores sharing one 256-cell memory. Every core has its own registers and
+ *        PC and runs the classic instruction set on a host thread of its own.
+ *
+ *        Memory model: every `1RXY` load and `3RXY` store is a sequentially consistent atomic
+ *        access of one cell, so all cores agree on a single order of their loads and stores, as
+ *        in the textbook model that algorithms such as Peterson's lock assume. Instruction
+ *        fetches are relaxed loads, code written by another core is seen eventually. A store to
+ *        cell 0 also goes to one screen shared by all cores, bytes of different cores appear in
+ *        the order they claimed a slot of it.
+ *
+ *        Threaded runs interleave as the host happens to schedule them. For a run that can be
+ *        repeated, `runScheduled` interleaves the cores on the calling thread in slices chosen
+ *        by a seeded generator, and `replay` follows a schedule recorded by it or written by hand.
+ *
+ *        The cores are not `CPU` objects: the CPU handlers work on a `Memory`, whose predecoded
+ *        slots, ports and screen are not safe to share between threads. `step` therefore decodes
+ *        the classic instruction set itself, with the `ALU` kernels for the arithmetic, as the
+ *        JIT, `Lockstep` and `TraceReader` do. A change to the instruction set has to be made
+ *        there too, and `--regress --engine multicore` checks this copy against the others
+ */
+class MultiCore
+{
+public:
+    static const int MAX_CORES = 64;
+
+    /**
+     * @brief `steps` instructions of `core` run without another core in between
+     */
+    struct Slice
+    {
+        int core;
+        long long steps;
+    };
+
+private:
+    struct alignas(64) Core
+    {
+        std::uint8_t registers[16];
+        int pc;
+        long long steps;
+        RunStatus::Code status;
+    };
+
+    std::atomic<std::uint8_t> cells[256];
+    std::vector<Core> cores;
+
+    /**
+     * @brief The shared screen. A byte claims slot `n` with a ticket from `screenWritten` and
+     *        stores `(n + 1) << 8 | byte` there unless a later ticket got there first, so the
+     *        ring ends up holding the newest bytes without a lock
+     */
+    std::atomic<std::uint64_t> screenWritten;
+    std::atomic<std::uint64_t> screenRing[Screen::CAPACITY];
+    Screen startScreen;
+
+    void put(std::uint8_t value);
+
+    /**
+     * @brief Executes one instruction of `core`, halts count as a step and faults do not
+     */
+    RunStatus::Code step(Core& core);
+
+    /**
+     * @brief Steps `core` until it stops or executed `limit` instructions in total
+     */
+    void runCore(Core& core, long long limit);
+
+    Core& at(int core);
+    const Core& at(int core) const;
+
+public:
+    /**
+     * @brief Copies the memory and screen of `machine` into the shared memory and its registers and
+     *        PC into each of `count` cores, there must be between 1 and `MAX_CORES` of them
+     * @throws std::invalid_argument if `machine` has devices mapped
+     */
+    MultiCore(const Machine& machine, int count);
+    MultiCore(const MultiCore&) = delete;
+    MultiCore& operator=(const MultiCore&) = delete;
+
+    int count() const { return static_cast<int>(cores.size()); }
+
+    void setPC(int core, int pc);
+    void setRegister(int core, int reg, std::uint8_t value);
+
+    /**
+     * @brief Runs every core on a host thread of its own, the calling thread taking core 0, until
+     *        each one halted, faulted or executed `maxSteps` instructions. Cores stopped by the
+     *        budget carry on in the next run
+     */
+    void run(long long maxSteps);
+
+    /**
+     * @brief Runs the cores one slice at a time on the calling thread, picking the core and a slice
+     *        of 1 to `quantum` steps with a generator seeded by `seed`, until every core stopped
+     *        or executed `maxSteps` instructions. The same arguments give the same run
+     * @param schedule Receives the slices that ran, if given
+     */
+    void runScheduled(long long maxSteps, std::uint32_t seed, int quantum, std::vector<Slice>* schedule = nullptr);
+
+    /**
+     * @brief Runs the slices of `schedule` in order, a slice ends early if its core stops and is
+     *        skipped if it stopped already
+     */
+    void replay(const std::vector<Slice>& schedule);
+
+    /**
+     * @brief The shared memory and screen with the registers and PC of `core`
+     */
+    Machine machine(int core) const;
+
+    RunStatus::Code coreStatus(int core) const { return at(core).status; }
+    long long coreSteps(int core) const { return at(core).steps; }
+
+    /**
+     * @brief Writes one "core steps" line per slice
+     */
+    static void writeSchedule(const std::string& fileName, const std::vector<Slice>& schedule);
+
+    /**
+     * @throws std::runtime_error if the file cannot be read or a line is not "core steps"
+     */
+    static std::vector<Slice> readSchedule(const std::string& fileName);
+
+    /**
+     * @brief Entry point of `--multicore`, parses the command line arguments following it
+     * @return The process exit code
+     */
+    static int main(const std::vector<std::string>& args);
+};
@@ -0,0 +1,142 @@
+#include "profiler.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <iomanip>
+#include <string>
+#include <vector>
+
+static const char* const opcodeNames[16] = {
+    "unknown", "load memory", "load value", "store", "move", "add int", "add float", "or",
+    "and", "xor", "rotate", "jump equal", "halt", "jump greater", "unknown", "unknown",
+};
+
+Profiler::Profiler() : instructions(0), cycles(0)
+{
+    std::memset(opcodes, 0, sizeof(opcodes));
+    std::memset(executed, 0, sizeof(executed));
+    std::memset(pcCycles, 0, sizeof(pcCycles));
+    std::memset(taken, 0, sizeof(taken));
+    std::memset(notTaken, 0, sizeof(notTaken));
+    std::memset(backEdges, 0, sizeof(backEdges));
+    std::memset(backTargets, 0, sizeof(backTargets));
+    std::memset(reads, 0, sizeof(reads));
+    std::memset(writes, 0, sizeof(writes));
+}
+
+void Profiler::run(Machine& machine, long long maxSteps)
+{
+    for (long long i = 0; i < maxSteps && !machine.cpu.isHalt; ++i)
+    {
+        step(machine);
+    }
+}
+
+static std::string percent(std::uint64_t part, std::uint64_t whole)
+{
+    char text[16];
+    std::snprintf(text, sizeof(text), "%5.1f%%", whole ? 100.0 * part / whole : 0.0);
+    return text;
+}
+
+static std::string instructionAt(const Machine& machine, int pc)
+{
+    return ALU::DecToHex(machine.memory.getCell(pc)) + ALU::DecToHex(machine.memory.getCell(pc + 1));
+}
+
+void Profiler::report(std::ostream& out, const Machine& machine, int rows) const
+{
+    out << "=== Profile ===\n" << "Instructions: " << instructions << "  Cycles: " << cycles << '\n';
+
+    out << "\n=== Opcodes ===\n";
+    for (int op = 0; op < 16; ++op)
+    {
+        if (opcodes[op])
+        {
+            out << std::hex << std::uppercase << op << std::dec << "  " << std::left << std::setw(14) << opcodeNames[op]
+                << std::right << std::setw(14) << opcodes[op] << "  " << percent(opcodes[op], instructions) << '\n';
+        }
+    }
+
+    std::vector<int> pcs;
+    for (int pc = 0; pc < 256; ++pc)
+    {
+        if (executed[pc])
+        {
+            pcs.push_back(pc);
+        }
+    }
+    std::stable_sort(pcs.begin(), pcs.end(), [this](int a, int b) { return pcCycles[a] > pcCycles[b]; });
+    out << "\n=== Hot spots ===\n" << "PC  Instr           Count    Cycles\n";
+    for (std::size_t i = 0; i < pcs.size() && i < static_cast<std::size_t>(rows); ++i)
+    {
+        int pc = pcs[i];
+        out << ALU::DecToHex(pc) << "  " << instructionAt(machine, pc) << std::setw(15) << executed[pc]
+            << "  " << percent(pcCycles[pc], cycles) << '\n';
+    }
+
+    out << "\n=== Jumps ===\n" << "PC  Instr           Taken       Not taken\n";
+    for (int pc : pcs)
+    {
+        if (taken[pc] || notTaken[pc])
+        {
+            out << ALU::DecToHex(pc) << "  " << instructionAt(machine, pc) << std::setw(15) << taken[pc]
+                << std::setw(16) << notTaken[pc] << '\n';
+        }
+    }
+
+    std::vector<int> cells;
+    for (int cell = 0; cell < 256; ++cell)
+    {
+        if (reads[cell] || writes[cell])
+        {
+            cells.push_back(cell);
+        }
+    }
+    std::stable_sort(cells.begin(), cells.end(), [this](int a, int b) { return reads[a] + writes[a] > reads[b] + writes[b]; });
+    out << "\n=== Memory ===\n" << "Cell          Reads          Writes\n";
+    for (std::size_t i = 0; i < cells.size() && i < static_cast<std::size_t>(rows); ++i)
+    {
+        int cell = cells[i];
+        out << ALU::DecToHex(cell) << "  " << std::setw(15) << reads[cell] << std::setw(16) << writes[cell] << '\n';
+    }
+
+    struct Loop
+    {
+        int start;
+        int end;
+        std::uint64_t iterations;
+        std::uint64_t cycles;
+    };
+    std::vector<Loop> loops;
+    for (int pc = 0; pc < 256; ++pc)
+    {
+        if (backEdges[pc])
+        {
+            Loop loop = {backTargets[pc], pc + 1, backEdges[pc], 0};
+            for (int i = loop.start; i <= loop.end; ++i)
+            {
+                loop.cycles += pcCycles[i];
+            }
+            loops.push_back(loop);
+        }
+    }
+    std::sort(loops.begin(), loops.end(), [](const Loop& a, const Loop& b)
+    {
+        return a.start != b.start ? a.start < b.start : a.end > b.end;
+    });
+    out << "\n=== Loops ===\n";
+    std::vector<int> enclosing;
+    for (const Loop& loop : loops)
+    {
+        while (!enclosing.empty() && enclosing.back() < loop.end)
+        {
+            enclosing.pop_back();
+        }
+        int bar = cycles ? static_cast<int>(20 * loop.cycles / cycles) : 0;
+        out << std::string(2 * enclosing.size(), ' ') << ALU::DecToHex(loop.start) << '-' << ALU::DecToHex(loop.end)
+            << "  " << std::string(bar, '#') << std::string(20 - bar, '.') << "  " << percent(loop.cycles, cycles)
+            << "  iterations " << loop.iterations << '\n';
+        enclosing.push_back(loop.end);
+    }
+}
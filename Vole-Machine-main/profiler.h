@@ -0,0 +1,96 @@
+#pragma once
+
+#include "class_T4.h"
+#include <cstdint>
+#include <ostream>
+
+/**
+ * @brief Runs a machine on the interpreter and counts what it does: executions per opcode and per
+ *        PC, taken and not taken `B`/`D` jumps, data reads and writes per cell and cycles. A
+ *        machine that is not run through a profiler pays nothing for it
+ *
+ *        Cycles follow a simple model: fetching takes one cycle, executing one more and every data
+ *        access to memory one more, so `1RXY` and `3RXY` take 3 cycles and the others 2
+ */
+class Profiler
+{
+public:
+    static constexpr std::uint8_t CYCLES[16] = {2, 3, 2, 3, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2};
+
+private:
+    std::uint64_t instructions;
+    std::uint64_t cycles;
+    std::uint64_t opcodes[16];
+    std::uint64_t executed[256];
+    std::uint64_t pcCycles[256];
+    std::uint64_t taken[256];
+    std::uint64_t notTaken[256];
+    std::uint64_t backEdges[256];
+    std::uint8_t backTargets[256];
+    std::uint64_t reads[256];
+    std::uint64_t writes[256];
+
+public:
+    Profiler();
+
+    /**
+     * @brief Runs one instruction of `machine` and counts it, a faulting instruction is not counted
+     */
+    void step(Machine& machine)
+    {
+        int pc = machine.cpu.programCounter;
+        if (pc < 0 || pc > 253)
+        {
+            machine.cpu.runInstruction(machine.memory);
+            return;
+        }
+        const std::uint8_t* registers = machine.cpu.reg.registers;
+        std::uint8_t hi = machine.memory.cells[pc];
+        std::uint8_t lo = machine.memory.cells[pc + 1];
+        int op = hi >> 4;
+        bool jump = (op == 0xB && registers[hi & 0xF] == registers[0])
+                 || (op == 0xD && registers[0] < registers[hi & 0xF]);
+
+        machine.cpu.runInstruction(machine.memory);
+
+        ++instructions;
+        cycles += CYCLES[op];
+        ++opcodes[op];
+        ++executed[pc];
+        pcCycles[pc] += CYCLES[op];
+        if (op == 0x1)
+        {
+            ++reads[lo];
+        }
+        else if (op == 0x3)
+        {
+            ++writes[lo];
+        }
+        else if (op == 0xB || op == 0xD)
+        {
+            ++(jump ? taken : notTaken)[pc];
+            if (jump && lo <= pc)
+            {
+                ++backEdges[pc];
+                backTargets[pc] = lo;
+            }
+        }
+    }
+
+    /**
+     * @brief Steps until the machine halts or `maxSteps` instructions were counted. Faults propagate
+     *        as exceptions, the counts up to them are kept
+     */
+    void run(Machine& machine, long long maxSteps);
+
+    std::uint64_t instructionCount() const { return instructions; }
+    std::uint64_t cycleCount() const { return cycles; }
+
+    /**
+     * @brief Prints the opcode mix, the hottest PCs, the jumps, the busiest cells and the loops,
+     *        formed by backward jumps, nested by the code they span
+     * @param machine The profiled machine, its memory gives the instructions at the listed PCs
+     * @param rows The number of rows of each table
+     */
+    void report(std::ostream& out, const Machine& machine, int rows = 16) const;
+};
@@ -0,0 +1,500 @@
+#include "regress.h"
+#include "jit.h"
+#include "lockstep.h"
+#include "multicore.h"
+#include "profiler.h"
+#include "scheduler.h"
+#include "supervisor.h"
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <stdexcept>
+#include <thread>
+
+static void runDecode(RegressionOutcome* outcomes, int count, long long maxSteps)
+{
+    for (int i = 0; i < count; ++i)
+    {
+        Machine& machine = outcomes[i].machine;
+        try
+        {
+            while (outcomes[i].steps < maxSteps && !machine.cpu.isHalt)
+            {
+                machine.cpu.fetch(machine.memory);
+                machine.cpu.decode(machine.memory, machine.cpu.reg);
+                ++outcomes[i].steps;
+            }
+        }
+        catch (const std::exception& e)
+        {
+            outcomes[i].error = e.what();
+        }
+    }
+}
+
+static void runInterpreter(RegressionOutcome* outcomes, int count, long long maxSteps)
+{
+    for (int i = 0; i < count; ++i)
+    {
+        Machine& machine = outcomes[i].machine;
+        try
+        {
+            while (outcomes[i].steps < maxSteps && !machine.cpu.isHalt)
+            {
+                machine.cpu.runInstruction(machine.memory);
+                ++outcomes[i].steps;
+            }
+        }
+        catch (const std::exception& e)
+        {
+            outcomes[i].error = e.what();
+        }
+    }
+}
+
+static void runExecute(RegressionOutcome* outcomes, int count, long long maxSteps)
+{
+    for (int i = 0; i < count; ++i)
+    {
+        Machine& machine = outcomes[i].machine;
+        RunStatus::Code code = machine.cpu.run(machine.memory, maxSteps, outcomes[i].steps);
+        if (code != RunStatus::HALTED && code != RunStatus::BUDGET)
+        {
+            outcomes[i].error = RunStatus::describe(code);
+        }
+    }
+}
+
+static void runJit(RegressionOutcome* outcomes, int count, long long maxSteps)
+{
+    for (int i = 0; i < count; ++i)
+    {
+        JIT jit(outcomes[i].machine);
+        try
+        {
+            jit.run(maxSteps, outcomes[i].steps);
+        }
+        catch (const std::exception& e)
+        {
+            outcomes[i].error = e.what();
+        }
+    }
+}
+
+static void runLockstep(RegressionOutcome* outcomes, int count, long long maxSteps)
+{
+    std::vector<Machine> machines;
+    for (int i = 0; i < count; ++i)
+    {
+        machines.push_back(outcomes[i].machine);
+    }
+    Lockstep lockstep(machines);
+    lockstep.run(maxSteps);
+    for (int i = 0; i < count; ++i)
+    {
+        outcomes[i].machine = lockstep.machine(i);
+        outcomes[i].error = lockstep.laneFault(i);
+        outcomes[i].steps = lockstep.laneSteps(i);
+    }
+}
+
+static void runMultiCore(RegressionOutcome* outcomes, int count, long long maxSteps)
+{
+    for (int i = 0; i < count; ++i)
+    {
+        MultiCore multiCore(outcomes[i].machine, 1);
+        multiCore.run(maxSteps);
+        RunStatus::Code code = multiCore.coreStatus(0);
+        outcomes[i].machine = multiCore.machine(0);
+        outcomes[i].steps = multiCore.coreSteps(0);
+        if (code != RunStatus::HALTED && code != RunStatus::BUDGET)
+        {
+            outcomes[i].error = RunStatus::describe(code);
+        }
+    }
+}
+
+static void runProfiler(RegressionOutcome* outcomes, int count, long long maxSteps)
+{
+    for (int i = 0; i < count; ++i)
+    {
+        Profiler profiler;
+        try
+        {
+            profiler.run(outcomes[i].machine, maxSteps);
+        }
+        catch (const std::exception& e)
+        {
+            outcomes[i].error = e.what();
+        }
+        outcomes[i].steps = static_cast<long long>(profiler.instructionCount());
+    }
+}
+
+/**
+ * @brief Runs the machines as tasks of one worker in quanta of an odd size, so every program is
+ *        suspended and resumed in the middle of its loops
+ */
+static void runScheduler(RegressionOutcome* outcomes, int count, long long maxSteps)
+{
+    Scheduler scheduler(1, 97);
+    for (int i = 0; i < count; ++i)
+    {
+        RegressionOutcome& outcome = outcomes[i];
+        scheduler.submit(outcome.machine, 0, maxSteps, [&outcome](Scheduler::Id, Machine& machine, RunStatus::Code code, long long steps) {
+            outcome.machine = machine;
+            outcome.steps = steps;
+            if (code != RunStatus::HALTED && code != RunStatus::BUDGET)
+            {
+                outcome.error = RunStatus::describe(code);
+            }
+        });
+    }
+    scheduler.wait();
+}
+
+static void runSupervisor(RegressionOutcome* outcomes, int count, long long maxSteps)
+{
+    for (int i = 0; i < count; ++i)
+    {
+        Supervisor::Result result = Supervisor(maxSteps, 0, false).run(outcomes[i].machine);
+        outcomes[i].error = result.error;
+        outcomes[i].steps = result.steps;
+    }
+}
+
+Regression::Engine Regression::engine(const std::string& name)
+{
+    static const std::pair<const char*, Engine> engines[] = {
+        {"decode", runDecode},     {"interpreter", runInterpreter}, {"execute", runExecute},
+        {"jit", runJit},           {"lockstep", runLockstep},       {"profiler", runProfiler},
+        {"multicore", runMultiCore}, {"scheduler", runScheduler},     {"supervisor", runSupervisor},
+    };
+    for (const auto& entry : engines)
+    {
+        if (name == entry.first)
+        {
+            return entry.second;
+        }
+    }
+    return nullptr;
+}
+
+std::string Regression::difference(const RegressionOutcome& left, const RegressionOutcome& right,
+                                   const std::string& leftName, const std::string& rightName)
+{
+    const Machine& a = left.machine;
+    const Machine& b = right.machine;
+    auto describe = [&](const std::string& what, const std::string& x, const std::string& y)
+    {
+        return what + ": " + leftName + " " + x + ", " + rightName + " " + y;
+    };
+    if (left.error != right.error)
+    {
+        return describe("fault", "\"" + left.error + "\"", "\"" + right.error + "\"");
+    }
+    if (a.cpu.getPC() != b.cpu.getPC())
+    {
+        return describe("PC", ALU::DecToHex(a.cpu.getPC()), ALU::DecToHex(b.cpu.getPC()));
+    }
+    if (a.cpu.isHalt != b.cpu.isHalt)
+    {
+        return describe("halt flag", a.cpu.isHalt ? "set" : "clear", b.cpu.isHalt ? "set" : "clear");
+    }
+    for (int i = 0; i < Register::COUNT; ++i)
+    {
+        if (a.cpu.reg.getValue(i) != b.cpu.reg.getValue(i))
+        {
+            return describe("register " + std::to_string(i), ALU::DecToHex(a.cpu.reg.getValue(i)),
+                            ALU::DecToHex(b.cpu.reg.getValue(i)));
+        }
+    }
+    for (int i = 0; i < Memory::CELLS; ++i)
+    {
+        if (a.memory.getCell(i) != b.memory.getCell(i))
+        {
+            return describe("cell " + ALU::DecToHex(i), ALU::DecToHex(a.memory.getCell(i)),
+                            ALU::DecToHex(b.memory.getCell(i)));
+        }
+    }
+    if (a.memory.screen.total() != b.memory.screen.total())
+    {
+        return describe("screen bytes written", std::to_string(a.memory.screen.total()),
+                        std::to_string(b.memory.screen.total()));
+    }
+    if (a.memory.screen.ascii() != b.memory.screen.ascii())
+    {
+        return describe("screen", "\"" + a.memory.screen.hex() + "\"", "\"" + b.memory.screen.hex() + "\"");
+    }
+    if (left.steps != right.steps)
+    {
+        return describe("steps", std::to_string(left.steps), std::to_string(right.steps));
+    }
+    return "";
+}
+
+std::vector<std::uint8_t> Regression::encodeGolden(const RegressionOutcome& outcome)
+{
+    std::vector<std::uint8_t> data = {'V', 'O', 'L', 'G', 1, 0, 0, 0};
+    for (int shift = 0; shift < 64; shift += 8)
+    {
+        data.push_back(static_cast<std::uint8_t>(static_cast<std::uint64_t>(outcome.steps) >> shift));
+    }
+    for (int shift = 0; shift < 32; shift += 8)
+    {
+        data.push_back(static_cast<std::uint8_t>(outcome.error.size() >> shift));
+    }
+    data.insert(data.end(), outcome.error.begin(), outcome.error.end());
+    std::vector<std::uint8_t> state = outcome.machine.snapshot();
+    data.insert(data.end(), state.begin(), state.end());
+    return data;
+}
+
+RegressionOutcome Regression::decodeGolden(const std::vector<std::uint8_t>& data)
+{
+    const std::size_t header = 8 + 8 + 4;
+    if (data.size() < header || std::memcmp(data.data(), "VOLG", 4) != 0 || data[4] != 1)
+    {
+        throw std::runtime_error("Not a golden file");
+    }
+    RegressionOutcome outcome;
+    std::uint64_t steps = 0;
+    for (int i = 7; i >= 0; --i)
+    {
+        steps = (steps << 8) | data[8 + i];
+    }
+    std::size_t errorLength = 0;
+    for (int i = 3; i >= 0; --i)
+    {
+        errorLength = (errorLength << 8) | data[16 + i];
+    }
+    if (data.size() - header < errorLength)
+    {
+        throw std::runtime_error("Golden file is truncated");
+    }
+    outcome.steps = static_cast<long long>(steps);
+    outcome.error.assign(data.begin() + header, data.begin() + header + errorLength);
+    outcome.machine.restore(data.data() + header + errorLength, data.size() - header - errorLength);
+    return outcome;
+}
+
+/**
+ * @brief Runs `engine` on copies of the loaded machines in `starts`, in groups of up to
+ *        `Lockstep::LANES` spread over `threads` threads. Machines that failed to load are skipped
+ */
+static std::vector<RegressionOutcome> runCorpus(Regression::Engine engine, const std::vector<RegressionOutcome>& starts,
+                                                const std::vector<bool>& loaded, long long maxSteps, int threads)
+{
+    std::vector<RegressionOutcome> outcomes = starts;
+    std::vector<std::size_t> indexes;
+    for (std::size_t i = 0; i < starts.size(); ++i)
+    {
+        if (loaded[i])
+        {
+            indexes.push_back(i);
+        }
+    }
+    const std::size_t groups = (indexes.size() + Lockstep::LANES - 1) / Lockstep::LANES;
+    std::atomic<std::size_t> next{0};
+    auto worker = [&]()
+    {
+        std::vector<RegressionOutcome> group;
+        for (std::size_t g = next++; g < groups; g = next++)
+        {
+            std::size_t first = g * Lockstep::LANES;
+            std::size_t last = std::min(first + Lockstep::LANES, indexes.size());
+            group.clear();
+            for (std::size_t i = first; i < last; ++i)
+            {
+                group.push_back(outcomes[indexes[i]]);
+            }
+            engine(group.data(), static_cast<int>(group.size()), maxSteps);
+            for (std::size_t i = first; i < last; ++i)
+            {
+                outcomes[indexes[i]] = group[i - first];
+            }
+        }
+    };
+
+    int count = std::max(1, std::min<int>(threads, static_cast<int>(groups)));
+    std::vector<std::thread> pool;
+    for (int i = 1; i < count; ++i)
+    {
+        pool.emplace_back(worker);
+    }
+    worker();
+    for (std::thread& t : pool)
+    {
+        t.join();
+    }
+    return outcomes;
+}
+
+static std::string goldenPath(const BatchJob& job)
+{
+    return job.fileName + ".golden";
+}
+
+static bool endsWith(const std::string& text, const std::string& suffix)
+{
+    return text.size() >= suffix.size() && text.compare(text.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+int Regression::main(const std::vector<std::string>& args)
+{
+    int threads = static_cast<int>(std::thread::hardware_concurrency());
+    long long maxSteps = 1000000;
+    std::string startMem = "10";
+    std::string engineName = "decode";
+    std::string otherName;
+    bool record = false;
+    std::vector<std::string> paths;
+
+    try
+    {
+        for (std::size_t i = 0; i < args.size(); ++i)
+        {
+            const std::string& arg = args[i];
+            bool hasValue = i + 1 < args.size();
+            if ((arg == "-j" || arg == "--threads") && hasValue)
+            {
+                threads = std::stoi(args[++i]);
+            }
+            else if (arg == "--steps" && hasValue)
+            {
+                maxSteps = std::stoll(args[++i]);
+            }
+            else if (arg == "--start" && hasValue)
+            {
+                startMem = args[++i];
+                for (char& c : startMem)
+                {
+                    c = std::toupper(static_cast<unsigned char>(c));
+                }
+            }
+            else if (arg == "--engine" && hasValue)
+            {
+                engineName = args[++i];
+            }
+            else if (arg == "--diff" && hasValue)
+            {
+                otherName = args[++i];
+            }
+            else if (arg == "--record")
+            {
+                record = true;
+            }
+            else
+            {
+                paths.push_back(arg);
+            }
+        }
+    }
+    catch (const std::exception&)
+    {
+        std::cerr << "Invalid number argument\n";
+        return 2;
+    }
+
+    Engine engine = Regression::engine(engineName);
+    Engine other = otherName.empty() ? nullptr : Regression::engine(otherName);
+    if (paths.empty() || !BatchRunner::isHexByte(startMem) || !engine || (!otherName.empty() && !other) || (record && other))
+    {
+        std::cerr << "Usage: simulator --regress [-j threads] [--steps n] [--start XY] [--engine name] [--record | --diff name] path[@XY]...\n"
+                  << "Engines: decode, interpreter, execute, jit, lockstep, multicore, profiler, scheduler, supervisor\n";
+        return 2;
+    }
+
+    std::vector<BatchJob> jobs;
+    for (const std::string& path : paths)
+    {
+        BatchRunner::collect(path, startMem, jobs);
+    }
+    jobs.erase(std::remove_if(jobs.begin(), jobs.end(), [](const BatchJob& job) { return endsWith(job.fileName, ".golden"); }),
+               jobs.end());
+
+    std::vector<RegressionOutcome> starts(jobs.size());
+    std::vector<bool> loaded(jobs.size(), false);
+    int mismatches = 0;
+    for (std::size_t i = 0; i < jobs.size(); ++i)
+    {
+        starts[i].steps = 0;
+        try
+        {
+            BatchRunner::load(jobs[i], starts[i].machine);
+            loaded[i] = true;
+        }
+        catch (const std::exception& e)
+        {
+            std::cout << jobs[i].fileName << ": cannot load: " << e.what() << '\n';
+            ++mismatches;
+        }
+    }
+
+    std::vector<RegressionOutcome> results = runCorpus(engine, starts, loaded, maxSteps, threads);
+    std::vector<RegressionOutcome> others;
+    if (other)
+    {
+        others = runCorpus(other, starts, loaded, maxSteps, threads);
+    }
+
+    for (std::size_t i = 0; i < jobs.size(); ++i)
+    {
+        if (!loaded[i])
+        {
+            continue;
+        }
+        std::string path = goldenPath(jobs[i]);
+        std::string difference;
+        try
+        {
+            if (record)
+            {
+                std::vector<std::uint8_t> data = encodeGolden(results[i]);
+                std::ofstream fout(path, std::ios::binary);
+                if (!fout.write(reinterpret_cast<const char*>(data.data()), data.size()))
+                {
+                    throw std::runtime_error("Failed to write " + path);
+                }
+                continue;
+            }
+            if (other)
+            {
+                difference = Regression::difference(results[i], others[i], engineName, otherName);
+            }
+            else
+            {
+                std::ifstream fin(path, std::ios::binary);
+                if (!fin.is_open())
+                {
+                    throw std::runtime_error("no golden file " + path);
+                }
+                std::vector<std::uint8_t> data((std::istreambuf_iterator<char>(fin)), std::istreambuf_iterator<char>());
+                difference = Regression::difference(decodeGolden(data), results[i], "golden", engineName);
+            }
+        }
+        catch (const std::exception& e)
+        {
+            difference = e.what();
+        }
+        if (!difference.empty())
+        {
+            std::cout << jobs[i].fileName << ": " << difference << '\n';
+            ++mismatches;
+        }
+    }
+
+    if (record)
+    {
+        std::cout << "Recorded " << jobs.size() - mismatches << " golden files, " << mismatches << " programs failed\n";
+    }
+    else
+    {
+        std::cout << jobs.size() << " programs, " << mismatches << " mismatches\n";
+    }
+    return mismatches ? 1 : 0;
+}
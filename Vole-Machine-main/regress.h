@@ -0,0 +1,61 @@
+#pragma once
+
+#include "batch.h"
+#include "class_T4.h"
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+/**
+ * @brief How one program ended on one engine
+ */
+struct RegressionOutcome
+{
+    Machine machine;
+    std::string error;
+    long long steps;
+};
+
+/**
+ * @brief Runs a corpus of programs on one execution engine and checks every final state against
+ *        a golden file recorded earlier, or against a second engine run on the same corpus.
+ *
+ *        The golden file of a program is its file name followed by ".golden" (for images of an
+ *        archive, the image name relative to the working directory): "VOLG", version, 0, 0, 0,
+ *        u64 steps, u32 fault length, the fault message, then a `Machine::snapshot` blob
+ */
+class Regression
+{
+public:
+    /**
+     * @brief Runs `count` loaded machines until they halt, fault or executed `maxSteps` instructions
+     */
+    typedef void (*Engine)(RegressionOutcome* outcomes, int count, long long maxSteps);
+
+    /**
+     * @brief The engines by name: "decode" (`CPU::fetch` and `CPU::decode`), "interpreter"
+     *        (`CPU::runInstruction`), "execute" (`CPU::run`, no exceptions), "jit", "lockstep",
+     *        "multicore" (one core of `MultiCore`), "profiler", "scheduler" (time-sliced by
+     *        `Scheduler`) and "supervisor"
+     * @return nullptr for an unknown name
+     */
+    static Engine engine(const std::string& name);
+
+    /**
+     * @brief The first difference between two outcomes: fault, PC, halt flag, register, cell,
+     *        screen or step count, empty if they are the same
+     * @param leftName,rightName The labels of the two sides in the description
+     */
+    static std::string difference(const RegressionOutcome& left, const RegressionOutcome& right,
+                                  const std::string& leftName, const std::string& rightName);
+
+    static std::vector<std::uint8_t> encodeGolden(const RegressionOutcome& outcome);
+    static RegressionOutcome decodeGolden(const std::vector<std::uint8_t>& data);
+
+    /**
+     * @brief Entry point of `--regress`, parses the command line arguments following it
+     * @return 0 if every program matched, 1 on a mismatch, 2 on a usage error
+     */
+    static int main(const std::vector<std::string>& args);
+};
@@ -0,0 +1,365 @@
+#include "scheduler.h"
+#include "batch.h"
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <stdexcept>
+
+Scheduler::Scheduler(int threads, long long quantum)
+    : quantum(quantum > 0 ? quantum : 1), nextId(1), nextWorker(0), queuedCount(0), activeCount(0), stopping(false)
+{
+    threads = std::max(1, threads);
+    for (int i = 0; i < threads; ++i)
+    {
+        workers.emplace_back(new Worker());
+    }
+    for (int i = 0; i < threads; ++i)
+    {
+        this->threads.emplace_back(&Scheduler::workLoop, this, static_cast<std::size_t>(i));
+    }
+}
+
+Scheduler::~Scheduler()
+{
+    {
+        std::lock_guard<std::mutex> lock(idleLock);
+        stopping = true;
+    }
+    wake.notify_all();
+    for (std::thread& thread : threads)
+    {
+        thread.join();
+    }
+}
+
+void Scheduler::enqueue(std::size_t worker, Task* task)
+{
+    {
+        std::lock_guard<std::mutex> lock(workers[worker]->lock);
+        workers[worker]->queues[task->priority].push_back(task);
+    }
+    {
+        std::lock_guard<std::mutex> lock(idleLock);
+        ++queuedCount;
+    }
+    wake.notify_one();
+}
+
+Scheduler::Task* Scheduler::take(std::size_t self)
+{
+    Task* task = nullptr;
+    {
+        Worker& own = *workers[self];
+        std::lock_guard<std::mutex> lock(own.lock);
+        for (int priority = PRIORITIES - 1; priority >= 0 && !task; --priority)
+        {
+            if (!own.queues[priority].empty())
+            {
+                task = own.queues[priority].front();
+                own.queues[priority].pop_front();
+            }
+        }
+    }
+    for (std::size_t i = 1; i < workers.size() && !task; ++i)
+    {
+        Worker& victim = *workers[(self + i) % workers.size()];
+        std::lock_guard<std::mutex> lock(victim.lock);
+        for (int priority = PRIORITIES - 1; priority >= 0 && !task; --priority)
+        {
+            if (!victim.queues[priority].empty())
+            {
+                task = victim.queues[priority].back();
+                victim.queues[priority].pop_back();
+            }
+        }
+    }
+    if (task)
+    {
+        std::lock_guard<std::mutex> lock(idleLock);
+        --queuedCount;
+    }
+    return task;
+}
+
+void Scheduler::deactivate()
+{
+    std::lock_guard<std::mutex> lock(idleLock);
+    if (--activeCount == 0)
+    {
+        idle.notify_all();
+    }
+}
+
+void Scheduler::workLoop(std::size_t self)
+{
+    while (!stopping)
+    {
+        Task* task = take(self);
+        if (!task)
+        {
+            std::unique_lock<std::mutex> lock(idleLock);
+            wake.wait(lock, [this] { return stopping || queuedCount > 0; });
+            continue;
+        }
+
+        bool runs = false;
+        {
+            std::lock_guard<std::mutex> lock(taskLock);
+            task->queued = false;
+            if (task->cancelled)
+            {
+                tasks.erase(task->id);
+            }
+            else if (!task->suspended)
+            {
+                task->running = runs = true;
+            }
+        }
+        if (!runs)
+        {
+            deactivate();
+            continue;
+        }
+
+        Machine& machine = task->machine;
+        RunStatus::Code code = machine.cpu.run(machine.memory, std::min(task->budget, task->steps + quantum), task->steps);
+        bool ended = code != RunStatus::BUDGET || task->steps >= task->budget;
+
+        std::unique_lock<std::mutex> lock(taskLock);
+        task->running = false;
+        if (ended || task->cancelled)
+        {
+            std::unique_ptr<Task> owned = std::move(tasks[task->id]);
+            tasks.erase(task->id);
+            lock.unlock();
+            parked.notify_all();
+            if (!owned->cancelled && owned->done)
+            {
+                owned->done(owned->id, owned->machine, code, owned->steps);
+            }
+            deactivate();
+        }
+        else if (task->suspended)
+        {
+            lock.unlock();
+            parked.notify_all();
+            deactivate();
+        }
+        else
+        {
+            task->queued = true;
+            lock.unlock();
+            enqueue(self, task);
+        }
+    }
+}
+
+Scheduler::Id Scheduler::submit(Machine machine, int priority, long long budget, Callback done)
+{
+    if (priority < 0 || priority >= PRIORITIES)
+    {
+        throw std::out_of_range("Priority is out of range");
+    }
+    Task* task;
+    std::size_t worker;
+    {
+        std::lock_guard<std::mutex> lock(taskLock);
+        Id id = nextId++;
+        std::unique_ptr<Task> created(new Task{id, std::move(machine), priority, budget, 0, std::move(done), true, false, false, false});
+        task = created.get();
+        tasks.emplace(id, std::move(created));
+        worker = nextWorker++ % workers.size();
+    }
+    {
+        std::lock_guard<std::mutex> lock(idleLock);
+        ++activeCount;
+    }
+    Id id = task->id;
+    enqueue(worker, task);
+    return id;
+}
+
+bool Scheduler::suspend(Id id)
+{
+    std::unique_lock<std::mutex> lock(taskLock);
+    auto found = tasks.find(id);
+    if (found == tasks.end())
+    {
+        return false;
+    }
+    found->second->suspended = true;
+    parked.wait(lock, [this, id] {
+        auto task = tasks.find(id);
+        return task == tasks.end() || !task->second->running;
+    });
+    return tasks.count(id) != 0;
+}
+
+bool Scheduler::resume(Id id)
+{
+    Task* task;
+    std::size_t worker;
+    {
+        std::lock_guard<std::mutex> lock(taskLock);
+        auto found = tasks.find(id);
+        if (found == tasks.end() || found->second->cancelled)
+        {
+            return false;
+        }
+        task = found->second.get();
+        task->suspended = false;
+        if (task->queued || task->running)
+        {
+            return true;
+        }
+        task->queued = true;
+        worker = nextWorker++ % workers.size();
+    }
+    {
+        std::lock_guard<std::mutex> lock(idleLock);
+        ++activeCount;
+    }
+    enqueue(worker, task);
+    return true;
+}
+
+bool Scheduler::cancel(Id id)
+{
+    std::lock_guard<std::mutex> lock(taskLock);
+    auto found = tasks.find(id);
+    if (found == tasks.end())
+    {
+        return false;
+    }
+    found->second->cancelled = true;
+    if (!found->second->queued && !found->second->running)
+    {
+        tasks.erase(found);
+    }
+    return true;
+}
+
+bool Scheduler::access(Id id, const std::function<void(Machine&)>& visit)
+{
+    std::lock_guard<std::mutex> lock(taskLock);
+    auto found = tasks.find(id);
+    if (found == tasks.end() || !found->second->suspended || found->second->running)
+    {
+        return false;
+    }
+    visit(found->second->machine);
+    return true;
+}
+
+void Scheduler::wait()
+{
+    std::unique_lock<std::mutex> lock(idleLock);
+    idle.wait(lock, [this] { return activeCount == 0; });
+}
+
+std::size_t Scheduler::resident() const
+{
+    std::lock_guard<std::mutex> lock(taskLock);
+    return tasks.size();
+}
+
+int Scheduler::main(const std::vector<std::string>& args)
+{
+    int threads = static_cast<int>(std::thread::hardware_concurrency());
+    long long quantum = 10000;
+    long long maxSteps = 1000000;
+    int copies = 1;
+    std::string startMem = "10";
+    std::vector<std::string> paths;
+    try
+    {
+        for (std::size_t i = 0; i < args.size(); ++i)
+        {
+            const std::string& arg = args[i];
+            bool hasValue = i + 1 < args.size();
+            if ((arg == "-j" || arg == "--threads") && hasValue)
+            {
+                threads = std::stoi(args[++i]);
+            }
+            else if (arg == "--quantum" && hasValue)
+            {
+                quantum = std::stoll(args[++i]);
+            }
+            else if (arg == "--steps" && hasValue)
+            {
+                maxSteps = std::stoll(args[++i]);
+            }
+            else if (arg == "--copies" && hasValue)
+            {
+                copies = std::stoi(args[++i]);
+            }
+            else if (arg == "--start" && hasValue)
+            {
+                startMem = args[++i];
+            }
+            else
+            {
+                paths.push_back(arg);
+            }
+        }
+    }
+    catch (const std::exception&)
+    {
+        std::cerr << "Invalid number argument\n";
+        return 2;
+    }
+    if (paths.empty() || copies < 1 || !BatchRunner::isHexByte(startMem))
+    {
+        std::cerr << "Usage: simulator --scheduler [-j threads] [--quantum n] [--steps n] [--copies n] [--start XY] path[@XY]...\n";
+        return 2;
+    }
+
+    std::vector<BatchJob> jobs;
+    for (const std::string& path : paths)
+    {
+        BatchRunner::collect(path, startMem, jobs);
+    }
+
+    std::mutex countLock;
+    long long counts[5] = {};
+    long long totalSteps = 0;
+    bool failed = false;
+    auto start = std::chrono::steady_clock::now();
+    {
+        Scheduler scheduler(threads, quantum);
+        for (const BatchJob& job : jobs)
+        {
+            Machine machine;
+            try
+            {
+                BatchRunner::load(job, machine);
+            }
+            catch (const std::exception& e)
+            {
+                std::cout << job.fileName << ": cannot load: " << e.what() << '\n';
+                failed = true;
+                continue;
+            }
+            std::string name = job.fileName;
+            for (int copy = 0; copy < copies; ++copy)
+            {
+                scheduler.submit(machine, 0, maxSteps, [&, name, copy](Id, Machine&, RunStatus::Code code, long long steps) {
+                    std::lock_guard<std::mutex> lock(countLock);
+                    ++counts[code];
+                    totalSteps += steps;
+                    if (copies == 1)
+                    {
+                        std::cout << name << ": " << RunStatus::describe(code) << " after " << steps << " steps\n";
+                    }
+                });
+            }
+        }
+        scheduler.wait();
+    }
+    double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    std::cout << "Halted: " << counts[RunStatus::HALTED] << "  Faulted: " << counts[RunStatus::BAD_OPCODE] + counts[RunStatus::PC_OVERFLOW]
+              << "  Budget: " << counts[RunStatus::BUDGET] << '\n'
+              << "Ran " << totalSteps << " instructions in " << elapsed << " s\n";
+    return failed ? 1 : 0;
+}
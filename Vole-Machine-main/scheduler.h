@@ -0,0 +1,159 @@
+#pragma once
+
+#include "class_T4.h"
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * @brief Keeps many machines resident and time-slices them over a pool of worker threads.
+ *
+ *        A task runs `CPU::run` for one quantum of instructions, then goes to the back of its
+ *        worker's queue for its priority, so every machine stops between two instructions and
+ *        its whole state stays in the `Machine`. Each worker takes the front task of its highest
+ *        non-empty priority and, when it has none, steals the back task of the highest priority
+ *        of another worker, so a lower priority only runs while no higher one is waiting there.
+ *
+ *        A task ends when it halts, faults or uses up its budget. Its callback then runs on the
+ *        worker thread with the final machine, and the task is dropped
+ */
+class Scheduler
+{
+public:
+    typedef std::uint64_t Id;
+    static const int PRIORITIES = 4;
+
+    /**
+     * @brief Called once per task when it ended with `code`, `HALTED` for a `C` or a debugger stop,
+     *        `BUDGET` when its budget is used up, or a fault
+     */
+    typedef std::function<void(Id id, Machine& machine, RunStatus::Code code, long long steps)> Callback;
+
+private:
+    struct Task
+    {
+        Id id;
+        Machine machine;
+        int priority;
+        long long budget;
+        long long steps;
+        Callback done;
+        bool queued;
+        bool running;
+        bool suspended;
+        bool cancelled;
+    };
+
+    struct alignas(64) Worker
+    {
+        std::mutex lock;
+        std::deque<Task*> queues[PRIORITIES];
+    };
+
+    long long quantum;
+    std::vector<std::unique_ptr<Worker>> workers;
+    std::vector<std::thread> threads;
+
+    /**
+     * @brief Guards `tasks` and the flags of every task. A task is erased only by the worker that
+     *        holds it, or by `cancel` while it is neither queued nor running
+     */
+    mutable std::mutex taskLock;
+    std::unordered_map<Id, std::unique_ptr<Task>> tasks;
+    std::condition_variable parked;
+    Id nextId;
+    std::size_t nextWorker;
+
+    std::mutex idleLock;
+    std::condition_variable wake;
+    std::condition_variable idle;
+    long long queuedCount;
+    long long activeCount;
+    std::atomic<bool> stopping;
+
+    /**
+     * @brief Puts `task` at the back of the queue of `worker` for its priority, `task->queued` must be set
+     */
+    void enqueue(std::size_t worker, Task* task);
+
+    /**
+     * @brief Takes a task off the queues of `self`, or steals one, nullptr if there is none
+     */
+    Task* take(std::size_t self);
+
+    void workLoop(std::size_t self);
+
+    /**
+     * @brief A task left the queues and will not run again until resumed
+     */
+    void deactivate();
+
+public:
+    /**
+     * @param threads The number of workers, at least 1
+     * @param quantum The instructions a task runs before the next task gets its turn
+     */
+    Scheduler(int threads, long long quantum);
+
+    /**
+     * @brief Stops the workers, tasks that did not end are dropped without their callbacks
+     */
+    ~Scheduler();
+    Scheduler(const Scheduler&) = delete;
+    Scheduler& operator=(const Scheduler&) = delete;
+
+    /**
+     * @brief Makes `machine` resident and queues it
+     * @param priority 0 (lowest) to `PRIORITIES - 1`
+     * @param budget The instructions the task may execute in total
+     * @param done Called when the task ends, may be empty
+     * @throws std::out_of_range if the priority is out of range
+     */
+    Id submit(Machine machine, int priority, long long budget, Callback done);
+
+    /**
+     * @brief Takes the task off the queues, letting it finish its current quantum first
+     * @return False if there is no such task, or it ended
+     */
+    bool suspend(Id id);
+
+    /**
+     * @brief Queues a suspended task again
+     */
+    bool resume(Id id);
+
+    /**
+     * @brief Drops the task without calling its callback, after its current quantum
+     */
+    bool cancel(Id id);
+
+    /**
+     * @brief Calls `visit` with the machine of a suspended task, which may change it
+     * @return False if the task is not suspended
+     */
+    bool access(Id id, const std::function<void(Machine&)>& visit);
+
+    /**
+     * @brief Blocks until no task is queued or running, suspended tasks stay resident
+     */
+    void wait();
+
+    /**
+     * @brief The number of tasks that did not end yet, suspended ones included
+     */
+    std::size_t resident() const;
+
+    /**
+     * @brief Entry point of `--scheduler`, parses the command line arguments following it
+     * @return The process exit code
+     */
+    static int main(const std::vector<std::string>& args);
+};
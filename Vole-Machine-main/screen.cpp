@@ -0,0 +1,147 @@
+#include "screen.h"
+#include "class_T4.h"
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <unistd.h>
+#else
+#include <io.h>
+#endif
+
+void FdSink::flush()
+{
+    std::size_t done = 0;
+    while (done < buffer.size())
+    {
+        auto count = ::write(fd, buffer.data() + done, static_cast<unsigned>(buffer.size() - done));
+        if (count <= 0)
+        {
+            break;
+        }
+        done += count;
+    }
+    buffer.clear();
+}
+
+ThreadedSink::ThreadedSink(std::shared_ptr<ScreenSink> target) : target(std::move(target)), stopping(false)
+{
+    block.reserve(BLOCK_SIZE);
+    writer = std::thread(&ThreadedSink::writeLoop, this);
+}
+
+ThreadedSink::~ThreadedSink()
+{
+    flush();
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        stopping = true;
+    }
+    ready.notify_all();
+    writer.join();
+}
+
+void ThreadedSink::put(std::uint8_t value)
+{
+    block.push_back(value);
+    if (block.size() == BLOCK_SIZE)
+    {
+        {
+            std::unique_lock<std::mutex> guard(lock);
+            notFull.wait(guard, [this] { return queue.size() < MAX_QUEUED; });
+            queue.push_back(std::move(block));
+        }
+        ready.notify_all();
+        block = std::vector<std::uint8_t>();
+        block.reserve(BLOCK_SIZE);
+    }
+}
+
+void ThreadedSink::flush()
+{
+    std::unique_lock<std::mutex> guard(lock);
+    if (!block.empty())
+    {
+        queue.push_back(std::move(block));
+        block = std::vector<std::uint8_t>();
+        block.reserve(BLOCK_SIZE);
+    }
+    ready.notify_all();
+    ready.wait(guard, [this] { return queue.empty(); });
+    target->flush();
+}
+
+void ThreadedSink::writeLoop()
+{
+    std::unique_lock<std::mutex> guard(lock);
+    while (true)
+    {
+        ready.wait(guard, [this] { return stopping || !queue.empty(); });
+        if (queue.empty())
+        {
+            return;
+        }
+        std::vector<std::uint8_t> next = std::move(queue.front());
+        guard.unlock();
+        for (std::uint8_t value : next)
+        {
+            target->put(value);
+        }
+        guard.lock();
+        queue.pop_front();
+        notFull.notify_one();
+        if (queue.empty())
+        {
+            ready.notify_all();
+        }
+    }
+}
+
+std::string Screen::ascii() const
+{
+    std::uint64_t kept = written < CAPACITY ? written : CAPACITY;
+    std::string text;
+    text.reserve(kept);
+    for (std::uint64_t i = written - kept; i < written; ++i)
+    {
+        text += char(ring[i % CAPACITY]);
+    }
+    return text;
+}
+
+void Screen::appendKept(std::vector<std::uint8_t>& out) const
+{
+    std::uint64_t kept = written < CAPACITY ? written : CAPACITY;
+    std::size_t first = static_cast<std::size_t>((written - kept) % CAPACITY);
+    std::size_t wrapped = first + kept > CAPACITY ? first + kept - CAPACITY : 0;
+    out.insert(out.end(), ring + first, ring + first + (kept - wrapped));
+    out.insert(out.end(), ring, ring + wrapped);
+}
+
+std::string Screen::hex() const
+{
+    std::string text;
+    for (char c : ascii())
+    {
+        text += ALU::DecToHex(static_cast<std::uint8_t>(c)) + ' ';
+    }
+    return text;
+}
+
+void Screen::assign(const std::uint8_t* data, std::size_t length)
+{
+    written = 0;
+    for (std::size_t i = 0; i < length; ++i)
+    {
+        ring[written % CAPACITY] = data[i];
+        ++written;
+    }
+}
+
+void Screen::assign(const std::uint8_t* data, std::size_t length, std::uint64_t total)
+{
+    written = total > length ? total - length : 0;
+    for (std::size_t i = 0; i < length; ++i)
+    {
+        ring[written % CAPACITY] = data[i];
+        ++written;
+    }
+}
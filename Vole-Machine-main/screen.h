@@ -0,0 +1,194 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/**
+ * @brief Receives every byte written to a screen. Sinks are not synchronized, machines running
+ *        on different threads need sinks of their own
+ */
+class ScreenSink
+{
+public:
+    virtual ~ScreenSink() {}
+    virtual void put(std::uint8_t value) = 0;
+
+    /**
+     * @brief Hands buffered bytes on to their destination
+     */
+    virtual void flush() {}
+};
+
+/**
+ * @brief Drops all output, only the screen's own window is kept
+ */
+class DiscardSink : public ScreenSink
+{
+public:
+    void put(std::uint8_t) override {}
+};
+
+/**
+ * @brief Keeps the complete output in memory
+ */
+class MemorySink : public ScreenSink
+{
+public:
+    std::string output;
+    void put(std::uint8_t value) override { output += char(value); }
+};
+
+/**
+ * @brief Writes the output to a file descriptor in blocks of `BUFFER_SIZE` bytes
+ */
+class FdSink : public ScreenSink
+{
+private:
+    static const std::size_t BUFFER_SIZE = 4096;
+    int fd;
+    std::vector<std::uint8_t> buffer;
+
+public:
+    explicit FdSink(int fd) : fd(fd) { buffer.reserve(BUFFER_SIZE); }
+    ~FdSink() override { flush(); }
+    FdSink(const FdSink&) = delete;
+    FdSink& operator=(const FdSink&) = delete;
+
+    void put(std::uint8_t value) override
+    {
+        buffer.push_back(value);
+        if (buffer.size() == BUFFER_SIZE)
+        {
+            flush();
+        }
+    }
+    void flush() override;
+};
+
+/**
+ * @brief Collects the output in blocks and passes full blocks to `target` on a background thread,
+ *        so the machine does not wait for the destination while it keeps up. At most
+ *        `MAX_QUEUED` blocks wait for the writer: when a slow destination falls that far behind,
+ *        `put` blocks until the writer has taken one, so memory stays bounded and no output is lost
+ */
+class ThreadedSink : public ScreenSink
+{
+private:
+    static const std::size_t BLOCK_SIZE = 4096;
+    static const std::size_t MAX_QUEUED = 4;
+    std::shared_ptr<ScreenSink> target;
+    std::vector<std::uint8_t> block;
+    std::deque<std::vector<std::uint8_t>> queue;
+    std::mutex lock;
+    std::condition_variable ready;
+    std::condition_variable notFull;
+    bool stopping;
+    std::thread writer;
+
+    void writeLoop();
+
+public:
+    explicit ThreadedSink(std::shared_ptr<ScreenSink> target);
+    ~ThreadedSink() override;
+    ThreadedSink(const ThreadedSink&) = delete;
+    ThreadedSink& operator=(const ThreadedSink&) = delete;
+
+    void put(std::uint8_t value) override;
+
+    /**
+     * @brief Queues the partial block and waits until the writer has passed everything to `target`
+     */
+    void flush() override;
+};
+
+/**
+ * @brief The output device behind cell 0. It remembers the last `CAPACITY` bytes in a ring buffer
+ *        for display and forwards every byte to an optional sink
+ */
+class Screen
+{
+public:
+    static const std::size_t CAPACITY = 1024;
+
+private:
+    std::uint8_t ring[CAPACITY];
+    std::uint64_t written;
+    std::shared_ptr<ScreenSink> sink;
+
+public:
+    Screen() : written(0) {}
+
+    void put(std::uint8_t value)
+    {
+        ring[written % CAPACITY] = value;
+        ++written;
+        if (sink)
+        {
+            sink->put(value);
+        }
+    }
+
+    /**
+     * @brief The kept byte the next `put` pushes out of the window, meaningful once `CAPACITY`
+     *        bytes were written
+     */
+    std::uint8_t oldest() const { return ring[written % CAPACITY]; }
+
+    /**
+     * @brief Takes back the last `put`, `pushedOut` being what `oldest` gave before it. The sink
+     *        keeps what it received
+     */
+    void unput(std::uint8_t pushedOut)
+    {
+        --written;
+        ring[written % CAPACITY] = pushedOut;
+    }
+
+    /**
+     * @brief Sets the sink receiving all further output, copies of the screen share it
+     */
+    void setSink(std::shared_ptr<ScreenSink> newSink) { sink = std::move(newSink); }
+    const std::shared_ptr<ScreenSink>& getSink() const { return sink; }
+
+    /**
+     * @brief The number of bytes written since the last `clear`, including those no longer kept
+     */
+    std::uint64_t total() const { return written; }
+
+    /**
+     * @brief The kept bytes, oldest first
+     */
+    std::string ascii() const;
+
+    /**
+     * @brief Appends the kept bytes to `out`, oldest first
+     */
+    void appendKept(std::vector<std::uint8_t>& out) const;
+
+    /**
+     * @brief The kept bytes as two hex digits and a space each, rendered on every call
+     */
+    std::string hex() const;
+
+    /**
+     * @brief Replaces the kept bytes with `length` bytes at `data` without passing them to the sink
+     */
+    void assign(const std::uint8_t* data, std::size_t length);
+
+    /**
+     * @brief Like `assign`, the `length` bytes at `data` being the last of `total` bytes written
+     */
+    void assign(const std::uint8_t* data, std::size_t length, std::uint64_t total);
+
+    /**
+     * @brief Forgets the kept bytes, the sink is left alone
+     */
+    void clear() { written = 0; }
+};
@@ -0,0 +1,654 @@
+#include "server.h"
+#include "image.h"
+#include <algorithm>
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <stdexcept>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+#define VOLE_SERVER 1
+#else
+#define VOLE_SERVER 0
+#endif
+
+static void put32(std::vector<std::uint8_t>& out, std::uint32_t value)
+{
+    for (int shift = 0; shift < 32; shift += 8)
+    {
+        out.push_back(static_cast<std::uint8_t>(value >> shift));
+    }
+}
+
+static void put64(std::vector<std::uint8_t>& out, std::uint64_t value)
+{
+    put32(out, static_cast<std::uint32_t>(value));
+    put32(out, static_cast<std::uint32_t>(value >> 32));
+}
+
+static std::uint32_t get32(const std::uint8_t* p)
+{
+    return p[0] | (p[1] << 8) | (p[2] << 16) | (static_cast<std::uint32_t>(p[3]) << 24);
+}
+
+static std::uint64_t get64(const std::uint8_t* p)
+{
+    return get32(p) | (static_cast<std::uint64_t>(get32(p + 4)) << 32);
+}
+
+#if VOLE_SERVER
+
+/**
+ * @brief Reads exactly `size` bytes
+ * @return False if the stream ended or failed first
+ */
+static bool readFully(int fd, std::uint8_t* data, std::size_t size)
+{
+    while (size > 0)
+    {
+        ssize_t got = ::read(fd, data, size);
+        if (got <= 0)
+        {
+            if (got < 0 && errno == EINTR)
+            {
+                continue;
+            }
+            return false;
+        }
+        data += got;
+        size -= static_cast<std::size_t>(got);
+    }
+    return true;
+}
+
+static bool writeFully(int fd, const std::uint8_t* data, std::size_t size)
+{
+    while (size > 0)
+    {
+        ssize_t sent = ::write(fd, data, size);
+        if (sent <= 0)
+        {
+            if (sent < 0 && errno == EINTR)
+            {
+                continue;
+            }
+            return false;
+        }
+        data += sent;
+        size -= static_cast<std::size_t>(sent);
+    }
+    return true;
+}
+
+static sockaddr_un socketAddress(const std::string& path)
+{
+    sockaddr_un address{};
+    if (path.empty() || path.size() >= sizeof(address.sun_path))
+    {
+        throw std::runtime_error("Socket path is empty or too long");
+    }
+    address.sun_family = AF_UNIX;
+    std::memcpy(address.sun_path, path.c_str(), path.size() + 1);
+    return address;
+}
+
+JobServer::Connection::~Connection()
+{
+    ::close(fd);
+}
+
+#else
+
+static bool readFully(int, std::uint8_t*, std::size_t)
+{
+    throw std::runtime_error("Unix domain sockets are not available on this platform");
+}
+
+JobServer::Connection::~Connection() {}
+
+#endif
+
+JobServer::JobServer(const std::string& path, int threads, std::size_t queueLimit, double timeout)
+    : path(path), threads(std::max(1, threads)), queueLimit(std::max<std::size_t>(1, queueLimit)),
+      timeout(timeout), listenFd(-1), stopping(false), closed(false), activeReaders(0)
+{
+}
+
+JobServer::~JobServer()
+{
+#if VOLE_SERVER
+    if (listenFd >= 0)
+    {
+        ::close(listenFd);
+        ::unlink(path.c_str());
+    }
+#endif
+}
+
+std::vector<std::uint8_t> JobServer::encodeRequest(std::uint32_t id, const std::vector<std::uint8_t>& image,
+                                                   long long maxSteps, int startAddress,
+                                                   const std::vector<std::uint8_t>& state)
+{
+    std::uint8_t flags = (state.empty() ? 0 : HAS_STATE) | (startAddress < 0 ? 0 : HAS_START);
+    std::vector<std::uint8_t> out = {'V', 'O', 'L', 'J', VERSION, flags, 0, 0};
+    put32(out, id);
+    put32(out, startAddress < 0 ? 0 : static_cast<std::uint32_t>(startAddress & 0xFFFF));
+    put64(out, static_cast<std::uint64_t>(maxSteps));
+    put32(out, static_cast<std::uint32_t>(image.size()));
+    out.insert(out.end(), image.begin(), image.end());
+    if (!state.empty())
+    {
+        put32(out, static_cast<std::uint32_t>(state.size()));
+        out.insert(out.end(), state.begin(), state.end());
+    }
+    return out;
+}
+
+JobRequest JobServer::decodeRequest(const std::vector<std::uint8_t>& data)
+{
+    if (data.size() < HEADER_SIZE || std::memcmp(data.data(), "VOLJ", 4) != 0)
+    {
+        throw std::runtime_error("Not a Vole job request");
+    }
+    if (data[4] != VERSION)
+    {
+        throw std::runtime_error("Unsupported job request version");
+    }
+    JobRequest request;
+    std::uint8_t flags = data[5];
+    request.id = get32(data.data() + 8);
+    request.startAddress = (flags & HAS_START) ? static_cast<int>(get32(data.data() + 12) & 0xFFFF) : -1;
+    request.maxSteps = static_cast<long long>(get64(data.data() + 16));
+    request.imageSize = get32(data.data() + 24);
+    request.image = data.data() + HEADER_SIZE;
+    request.state = nullptr;
+    request.stateSize = 0;
+    std::size_t end = HEADER_SIZE + request.imageSize;
+    if (request.maxSteps < 0 || request.imageSize > MAX_PART || data.size() < end)
+    {
+        throw std::runtime_error("Job request is truncated or too large");
+    }
+    if (flags & HAS_STATE)
+    {
+        if (data.size() < end + 4)
+        {
+            throw std::runtime_error("Job request is truncated or too large");
+        }
+        request.stateSize = get32(data.data() + end);
+        request.state = data.data() + end + 4;
+        end += 4 + request.stateSize;
+        if (request.stateSize > MAX_PART || data.size() < end)
+        {
+            throw std::runtime_error("Job request is truncated or too large");
+        }
+    }
+    if (data.size() != end)
+    {
+        throw std::runtime_error("Job request has trailing bytes");
+    }
+    return request;
+}
+
+void JobServer::encodeResponse(const JobResponse& response, std::vector<std::uint8_t>& out)
+{
+    const std::uint8_t header[] = {'V', 'O', 'L', 'R', VERSION, response.reason, 0, 0};
+    out.insert(out.end(), std::begin(header), std::end(header));
+    put32(out, response.id);
+    put64(out, static_cast<std::uint64_t>(response.steps));
+    put32(out, static_cast<std::uint32_t>(response.error.size()));
+    out.insert(out.end(), response.error.begin(), response.error.end());
+    put32(out, static_cast<std::uint32_t>(response.output.size()));
+    out.insert(out.end(), response.output.begin(), response.output.end());
+    put32(out, static_cast<std::uint32_t>(response.snapshot.size()));
+    out.insert(out.end(), response.snapshot.begin(), response.snapshot.end());
+}
+
+bool JobServer::readResponse(int fd, JobResponse& response)
+{
+    std::uint8_t header[24];
+    if (!readFully(fd, header, sizeof(header)))
+    {
+        return false;
+    }
+    if (std::memcmp(header, "VOLR", 4) != 0 || header[4] != VERSION || header[5] > Supervisor::FAULT)
+    {
+        throw std::runtime_error("Not a Vole job response");
+    }
+    response.reason = static_cast<Supervisor::StopReason>(header[5]);
+    response.id = get32(header + 8);
+    response.steps = static_cast<long long>(get64(header + 12));
+    auto readPart = [fd](std::uint32_t size, std::uint8_t* data)
+    {
+        if (!readFully(fd, data, size))
+        {
+            throw std::runtime_error("Job response is truncated");
+        }
+    };
+    std::uint32_t size = get32(header + 20);
+    response.error.resize(size);
+    readPart(size, reinterpret_cast<std::uint8_t*>(&response.error[0]));
+    std::uint8_t length[4];
+    readPart(4, length);
+    response.output.resize(get32(length));
+    readPart(get32(length), reinterpret_cast<std::uint8_t*>(&response.output[0]));
+    readPart(4, length);
+    response.snapshot.resize(get32(length));
+    readPart(get32(length), response.snapshot.data());
+    return true;
+}
+
+void JobServer::runJob(Worker& worker, const std::vector<std::uint8_t>& request) const
+{
+    JobResponse& response = worker.response;
+    response.id = get32(request.data() + 8);
+    response.reason = Supervisor::FAULT;
+    response.steps = 0;
+    response.error.clear();
+    response.output.clear();
+    response.snapshot.clear();
+    worker.sink->output.clear();
+    try
+    {
+        JobRequest job = decodeRequest(request);
+        std::size_t used = 0;
+        ProgramImage image = ImageFormat::decode(job.image, job.imageSize, used);
+        if (used != job.imageSize)
+        {
+            throw std::runtime_error("Job request has trailing bytes");
+        }
+        int start = job.startAddress < 0 ? image.startAddress : job.startAddress;
+        Machine& machine = worker.machine;
+        if (job.state)
+        {
+            machine.restore(job.state, job.stateSize);
+            machine.memory.load(image.loadAddress, image.bytes, image.length);
+            machine.cpu.setPC(start);
+            machine.cpu.isHalt = false;
+        }
+        else
+        {
+            machine.loadBytes(image.bytes, image.length, image.loadAddress, start);
+        }
+        Supervisor::Result result = Supervisor(job.maxSteps, timeout).run(machine);
+        response.reason = result.reason;
+        response.steps = result.steps;
+        response.error = result.error;
+        response.output = worker.sink->output;
+        machine.snapshot(response.snapshot);
+    }
+    catch (const std::exception& e)
+    {
+        response.error = e.what();
+    }
+}
+
+#if VOLE_SERVER
+
+void JobServer::readLoop(std::shared_ptr<Connection> connection)
+{
+    const int fd = connection->fd;
+    std::uint8_t header[HEADER_SIZE];
+    while (readFully(fd, header, HEADER_SIZE) && std::memcmp(header, "VOLJ", 4) == 0)
+    {
+        std::uint32_t imageSize = get32(header + 24);
+        if (imageSize > MAX_PART)
+        {
+            break;
+        }
+        Job job{connection, std::vector<std::uint8_t>(header, header + HEADER_SIZE)};
+        job.request.resize(HEADER_SIZE + imageSize);
+        if (!readFully(fd, job.request.data() + HEADER_SIZE, imageSize))
+        {
+            break;
+        }
+        if (header[5] & HAS_STATE)
+        {
+            std::uint8_t length[4];
+            if (!readFully(fd, length, 4) || get32(length) > MAX_PART)
+            {
+                break;
+            }
+            job.request.insert(job.request.end(), length, length + 4);
+            std::size_t at = job.request.size();
+            job.request.resize(at + get32(length));
+            if (!readFully(fd, job.request.data() + at, get32(length)))
+            {
+                break;
+            }
+        }
+
+        std::unique_lock<std::mutex> hold(queueLock);
+        notFull.wait(hold, [this] { return queue.size() < queueLimit || closed; });
+        if (closed)
+        {
+            break;
+        }
+        queue.push_back(std::move(job));
+        hold.unlock();
+        notEmpty.notify_one();
+    }
+    ::shutdown(fd, SHUT_RD);
+
+    std::lock_guard<std::mutex> hold(connectionLock);
+    --activeReaders;
+    readersDone.notify_all();
+}
+
+void JobServer::workLoop()
+{
+    Worker worker;
+    worker.sink = std::make_shared<MemorySink>();
+    worker.machine.memory.screen.setSink(worker.sink);
+    for (;;)
+    {
+        Job job;
+        {
+            std::unique_lock<std::mutex> hold(queueLock);
+            notEmpty.wait(hold, [this] { return !queue.empty() || closed; });
+            if (queue.empty())
+            {
+                return;
+            }
+            job = std::move(queue.front());
+            queue.pop_front();
+        }
+        notFull.notify_one();
+
+        bool cached = false;
+        if (cache)
+        {
+            worker.key.assign(job.request.begin(), job.request.end());
+            std::memset(worker.key.data() + 8, 0, 4);
+            cached = cache->get(worker.key, worker.encoded);
+            if (cached)
+            {
+                std::memcpy(worker.encoded.data() + 8, job.request.data() + 8, 4);
+            }
+        }
+        if (!cached)
+        {
+            runJob(worker, job.request);
+            worker.encoded.clear();
+            encodeResponse(worker.response, worker.encoded);
+            if (cache && !worker.response.snapshot.empty() && worker.response.reason != Supervisor::TIMEOUT)
+            {
+                cache->put(worker.key, worker.encoded);
+            }
+        }
+        std::lock_guard<std::mutex> hold(job.connection->writeLock);
+        if (!writeFully(job.connection->fd, worker.encoded.data(), worker.encoded.size()))
+        {
+            ::shutdown(job.connection->fd, SHUT_RDWR);
+        }
+    }
+}
+
+void JobServer::serve()
+{
+    sockaddr_un address = socketAddress(path);
+    listenFd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listenFd < 0)
+    {
+        throw std::runtime_error("Failed to create a socket");
+    }
+    ::unlink(path.c_str());
+    if (::bind(listenFd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0 || ::listen(listenFd, 64) != 0)
+    {
+        ::close(listenFd);
+        listenFd = -1;
+        throw std::runtime_error("Failed to listen on " + path);
+    }
+
+    std::vector<std::thread> pool;
+    for (int i = 0; i < threads; ++i)
+    {
+        pool.emplace_back(&JobServer::workLoop, this);
+    }
+    while (!stopping)
+    {
+        pollfd ready{listenFd, POLLIN, 0};
+        if (::poll(&ready, 1, 200) <= 0)
+        {
+            continue;
+        }
+        int fd = ::accept(listenFd, nullptr, nullptr);
+        if (fd < 0)
+        {
+            continue;
+        }
+        // A client that stops reading must not hold a worker forever
+        timeval sendTimeout{10, 0};
+        ::setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &sendTimeout, sizeof(sendTimeout));
+        auto connection = std::make_shared<Connection>(fd);
+        std::lock_guard<std::mutex> hold(connectionLock);
+        connections.erase(std::remove_if(connections.begin(), connections.end(),
+                                         [](const std::weak_ptr<Connection>& c) { return c.expired(); }),
+                          connections.end());
+        connections.push_back(connection);
+        ++activeReaders;
+        std::thread(&JobServer::readLoop, this, connection).detach();
+    }
+
+    ::close(listenFd);
+    listenFd = -1;
+    ::unlink(path.c_str());
+    {
+        std::unique_lock<std::mutex> hold(connectionLock);
+        for (const auto& entry : connections)
+        {
+            if (auto connection = entry.lock())
+            {
+                ::shutdown(connection->fd, SHUT_RD);
+            }
+        }
+        readersDone.wait(hold, [this] { return activeReaders == 0; });
+    }
+    {
+        std::lock_guard<std::mutex> hold(queueLock);
+        closed = true;
+    }
+    notEmpty.notify_all();
+    notFull.notify_all();
+    for (std::thread& worker : pool)
+    {
+        worker.join();
+    }
+}
+
+#else
+
+void JobServer::readLoop(std::shared_ptr<Connection>) {}
+void JobServer::workLoop() {}
+
+void JobServer::serve()
+{
+    throw std::runtime_error("Unix domain sockets are not available on this platform");
+}
+
+#endif
+
+static JobServer* runningServer = nullptr;
+
+static void stopServer(int)
+{
+    if (runningServer)
+    {
+        runningServer->stop();
+    }
+}
+
+int JobServer::main(const std::vector<std::string>& args)
+{
+    int threads = static_cast<int>(std::thread::hardware_concurrency());
+    std::size_t queueLimit = 0;
+    double timeout = 10;
+    std::size_t cacheMegabytes = 0;
+    std::string cacheDirectory;
+    std::string socketPath;
+    try
+    {
+        for (std::size_t i = 0; i < args.size(); ++i)
+        {
+            const std::string& arg = args[i];
+            bool hasValue = i + 1 < args.size();
+            if ((arg == "-j" || arg == "--threads") && hasValue)
+            {
+                threads = std::stoi(args[++i]);
+            }
+            else if (arg == "--queue" && hasValue)
+            {
+                queueLimit = std::stoul(args[++i]);
+            }
+            else if (arg == "--timeout" && hasValue)
+            {
+                timeout = std::stod(args[++i]);
+            }
+            else if (arg == "--cache" && hasValue)
+            {
+                cacheMegabytes = std::stoul(args[++i]);
+            }
+            else if (arg == "--cache-dir" && hasValue)
+            {
+                cacheDirectory = args[++i];
+            }
+            else if (socketPath.empty())
+            {
+                socketPath = arg;
+            }
+            else
+            {
+                socketPath.clear();
+                break;
+            }
+        }
+    }
+    catch (const std::exception&)
+    {
+        std::cerr << "Invalid number argument\n";
+        return 2;
+    }
+    if (socketPath.empty())
+    {
+        std::cerr << "Usage: simulator --serve [-j threads] [--queue n] [--timeout s] [--cache MB] [--cache-dir dir] socket\n";
+        return 2;
+    }
+
+    JobServer server(socketPath, threads, queueLimit ? queueLimit : 4 * std::max(1, threads), timeout);
+    std::shared_ptr<ResultCache> cache;
+    if (cacheMegabytes || !cacheDirectory.empty())
+    {
+        try
+        {
+            cache = std::make_shared<ResultCache>((cacheMegabytes ? cacheMegabytes : 64) << 20, cacheDirectory);
+            server.setCache(cache);
+        }
+        catch (const std::exception& e)
+        {
+            std::cerr << e.what() << '\n';
+            return 1;
+        }
+    }
+    runningServer = &server;
+    std::signal(SIGINT, stopServer);
+    std::signal(SIGTERM, stopServer);
+#if VOLE_SERVER
+    std::signal(SIGPIPE, SIG_IGN);
+#endif
+    try
+    {
+        std::cerr << "Serving on " << socketPath << '\n';
+        server.serve();
+        if (cache)
+        {
+            ResultCache::Stats stats = cache->stats();
+            std::cerr << "Cache: " << stats.memoryHits << " hits in memory, " << stats.diskHits << " on disk, "
+                      << stats.misses << " misses\n";
+        }
+    }
+    catch (const std::exception& e)
+    {
+        std::cerr << e.what() << '\n';
+        runningServer = nullptr;
+        return 1;
+    }
+    runningServer = nullptr;
+    return 0;
+}
+
+int JobServer::submit(const std::vector<std::string>& args)
+{
+    if (args.size() < 2)
+    {
+        std::cerr << "Usage: simulator --submit socket program [XY] [steps]\n";
+        return 2;
+    }
+#if VOLE_SERVER
+    JobResponse response;
+    try
+    {
+        std::vector<std::uint8_t> image;
+        if (ImageArchive::isImageFile(args[1]))
+        {
+            std::ifstream fin{args[1], std::ios::binary};
+            image.assign(std::istreambuf_iterator<char>(fin), std::istreambuf_iterator<char>());
+        }
+        else
+        {
+            image = ImageFormat::fromText(args[1], args.size() > 2 ? args[2] : "10");
+        }
+        std::vector<std::uint8_t> request = encodeRequest(1, image, args.size() > 3 ? std::stoll(args[3]) : 1000000);
+
+        sockaddr_un address = socketAddress(args[0]);
+        int fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+        if (fd < 0 || ::connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0)
+        {
+            if (fd >= 0)
+            {
+                ::close(fd);
+            }
+            throw std::runtime_error("Failed to connect to " + args[0]);
+        }
+        std::signal(SIGPIPE, SIG_IGN);
+        bool answered = writeFully(fd, request.data(), request.size()) && readResponse(fd, response);
+        ::close(fd);
+        if (!answered)
+        {
+            throw std::runtime_error("The server closed the connection");
+        }
+    }
+    catch (const std::exception& e)
+    {
+        std::cerr << e.what() << '\n';
+        return 1;
+    }
+
+    std::cout << "Status: " << Supervisor::reasonName(response.reason) << "  Steps: " << response.steps << '\n';
+    if (!response.error.empty())
+    {
+        std::cout << "Error: " << response.error << '\n';
+    }
+    if (!response.snapshot.empty())
+    {
+        Machine machine;
+        machine.restore(response.snapshot);
+        std::cout << "PC: " << ALU::DecToHex(machine.cpu.getPC()) << "\n=== Registers ===\n";
+        for (int i = 0; i < 16; ++i)
+        {
+            std::cout << ALU::DecToHex(machine.cpu.reg.getValue(i)) << ((i + 1) % 4 == 0 ? "\n" : "  ");
+        }
+    }
+    std::cout << "=== Screen ===\n" << "ASCII: " << response.output << '\n';
+    return response.reason == Supervisor::FAULT ? 1 : 0;
+#else
+    std::cerr << "Unix domain sockets are not available on this platform\n";
+    return 1;
+#endif
+}
@@ -0,0 +1,207 @@
+#pragma once
+
+#include "cache.h"
+#include "class_T4.h"
+#include "screen.h"
+#include "supervisor.h"
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/**
+ * @brief What a job request asks for, `image` and `state` pointing into the request bytes
+ */
+struct JobRequest
+{
+    std::uint32_t id;
+    long long maxSteps;
+
+    /**
+     * @brief The PC to start at, -1 for the start address of the image
+     */
+    int startAddress;
+    const std::uint8_t* image;
+    std::size_t imageSize;
+    const std::uint8_t* state;
+    std::size_t stateSize;
+};
+
+/**
+ * @brief How a job ended, as sent back to the client
+ */
+struct JobResponse
+{
+    std::uint32_t id;
+    Supervisor::StopReason reason;
+    long long steps;
+    std::string error;
+
+    /**
+     * @brief Every byte the job wrote to the screen, not only the bytes the screen keeps
+     */
+    std::string output;
+    std::vector<std::uint8_t> snapshot;
+};
+
+/**
+ * @brief A daemon running Vole programs for clients of a Unix domain socket.
+ *
+ *        Every connection has a reader thread that frames requests and puts them on one bounded
+ *        queue. When the queue is full the reader blocks, so it stops reading the socket and the
+ *        client is held back by the socket buffer. Worker threads take jobs off the queue and run
+ *        them through `Supervisor` on a machine and screen sink of their own that are reused for
+ *        every job, then write the response to the job's connection. A client may send several
+ *        requests without waiting, responses carry the request id and can come in any order.
+ *
+ *        All numbers are little endian.
+ *        Request:  "VOLJ", version, flags (1 initial state, 2 start address), 0, 0, u32 id,
+ *                  u16 start address, u16 0, u64 instruction budget, u32 image length, a program
+ *                  image as written by `ImageFormat::encode`, then with flag 1 a u32 length and a
+ *                  `Machine::snapshot` blob. The machine is restored from the snapshot, or reset
+ *                  without one, then the image is copied in and the PC set to the start address
+ *        Response: "VOLR", version, `Supervisor::StopReason`, 0, 0, u32 id, u64 steps, u32 error
+ *                  length, the error, u32 output length, the screen output, u32 snapshot length,
+ *                  the final `Machine::snapshot`
+ *        A request that cannot be decoded gets a `FAULT` response without a snapshot. A stream
+ *        that does not start with the request magic is closed
+ */
+class JobServer
+{
+public:
+    static const std::uint8_t VERSION = 1;
+    static const std::uint8_t HAS_STATE = 1;
+    static const std::uint8_t HAS_START = 2;
+    static const std::size_t HEADER_SIZE = 28;
+
+    /**
+     * @brief The largest image or state a request may carry
+     */
+    static const std::uint32_t MAX_PART = 1 << 20;
+
+private:
+    struct Connection
+    {
+        int fd;
+        std::mutex writeLock;
+        explicit Connection(int fd) : fd(fd) {}
+        ~Connection();
+    };
+
+    struct Job
+    {
+        std::shared_ptr<Connection> connection;
+        std::vector<std::uint8_t> request;
+    };
+
+    /**
+     * @brief The machine, sink and buffer a worker reuses for all of its jobs
+     */
+    struct Worker
+    {
+        Machine machine;
+        std::shared_ptr<MemorySink> sink;
+        JobResponse response;
+        std::vector<std::uint8_t> encoded;
+        std::vector<std::uint8_t> key;
+    };
+
+    std::string path;
+    int threads;
+    std::size_t queueLimit;
+    double timeout;
+    int listenFd;
+    std::atomic<bool> stopping;
+    std::shared_ptr<ResultCache> cache;
+
+    std::deque<Job> queue;
+    bool closed;
+    std::mutex queueLock;
+    std::condition_variable notEmpty;
+    std::condition_variable notFull;
+
+    std::mutex connectionLock;
+    std::vector<std::weak_ptr<Connection>> connections;
+    int activeReaders;
+    std::condition_variable readersDone;
+
+    /**
+     * @brief Frames requests of `connection` onto the queue until the client hangs up
+     */
+    void readLoop(std::shared_ptr<Connection> connection);
+    void workLoop();
+
+    /**
+     * @brief Runs one request on `worker`, leaving the result in `worker.response`
+     */
+    void runJob(Worker& worker, const std::vector<std::uint8_t>& request) const;
+
+public:
+    /**
+     * @param path The socket file, replaced if it exists
+     * @param threads The number of workers
+     * @param queueLimit The number of requests waiting for a worker before readers block
+     * @param timeout The wall-clock limit of each job in seconds, 0 for none
+     */
+    JobServer(const std::string& path, int threads, std::size_t queueLimit, double timeout);
+    ~JobServer();
+    JobServer(const JobServer&) = delete;
+    JobServer& operator=(const JobServer&) = delete;
+
+    /**
+     * @brief Binds the socket and serves until `stop`, then finishes the queued jobs
+     * @throws std::runtime_error if the socket cannot be set up
+     */
+    void serve();
+
+    /**
+     * @brief Answers repeated requests from `cache`, set before `serve`. The key is the request
+     *        without its id and the value the encoded response, runs stopped by the timeout and
+     *        requests that cannot be decoded are not cached
+     */
+    void setCache(std::shared_ptr<ResultCache> resultCache) { cache = std::move(resultCache); }
+
+    /**
+     * @brief Makes `serve` return within a fraction of a second, safe to call from a signal handler
+     */
+    void stop() { stopping = true; }
+
+    static std::vector<std::uint8_t> encodeRequest(std::uint32_t id, const std::vector<std::uint8_t>& image,
+                                                   long long maxSteps, int startAddress = -1,
+                                                   const std::vector<std::uint8_t>& state = {});
+
+    /**
+     * @brief Reads a whole request
+     * @throws std::runtime_error if it is malformed
+     */
+    static JobRequest decodeRequest(const std::vector<std::uint8_t>& data);
+
+    /**
+     * @brief Appends the encoded `response` to `out`
+     */
+    static void encodeResponse(const JobResponse& response, std::vector<std::uint8_t>& out);
+
+    /**
+     * @brief Reads a response from a socket
+     * @return False if the server closed the connection
+     * @throws std::runtime_error if it is malformed
+     */
+    static bool readResponse(int fd, JobResponse& response);
+
+    /**
+     * @brief Entry point of `--serve`, parses the command line arguments following it
+     * @return The process exit code
+     */
+    static int main(const std::vector<std::string>& args);
+
+    /**
+     * @brief Entry point of `--submit`, runs one program on a server and prints the result
+     * @return The process exit code
+     */
+    static int submit(const std::vector<std::string>& args);
+};
@@ -0,0 +1,106 @@
+#include "supervisor.h"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+
+Supervisor::Result Supervisor::run(Machine& machine) const
+{
+    Result result{BUDGET, 0, "", -1};
+    const std::uint8_t* registers = machine.cpu.reg.registers;
+    const std::uint8_t* cells = machine.memory.cells;
+    std::uint8_t savedRegisters[Register::COUNT];
+    std::uint8_t savedCells[Memory::CELLS];
+    int savedPc = -1;
+    long long savedStep = 0;
+    long long power = 1;
+    long long distance = 0;
+    long long steps = 0;
+    const auto start = std::chrono::steady_clock::now();
+
+    const bool checkLoops = detectLoops && !machine.memory.hasDevices();
+    bool running = !machine.cpu.isHalt;
+    if (!running)
+    {
+        result.reason = HALTED;
+    }
+    while (running && steps < maxSteps)
+    {
+        const long long limit = std::min(steps + CLOCK_INTERVAL, maxSteps);
+        while (steps < limit)
+        {
+            int pc = machine.cpu.getPC();
+            RunStatus::Code code = machine.cpu.execute(machine.memory);
+            if (code != RunStatus::RUNNING)
+            {
+                if (code == RunStatus::HALTED)
+                {
+                    steps += machine.cpu.getPC() != pc;
+                    result.reason = HALTED;
+                }
+                else
+                {
+                    result.reason = FAULT;
+                    result.error = RunStatus::describe(code);
+                }
+                running = false;
+                break;
+            }
+            ++steps;
+            if (!checkLoops || machine.cpu.getPC() > pc)
+            {
+                continue;
+            }
+            int target = machine.cpu.getPC();
+            if (target == savedPc && std::memcmp(registers, savedRegisters, sizeof(savedRegisters)) == 0
+                && std::memcmp(cells, savedCells, sizeof(savedCells)) == 0)
+            {
+                result.reason = LOOP;
+                result.loopStart = savedStep;
+                running = false;
+                break;
+            }
+            if (++distance == power)
+            {
+                savedPc = target;
+                savedStep = steps;
+                std::memcpy(savedRegisters, registers, sizeof(savedRegisters));
+                std::memcpy(savedCells, cells, sizeof(savedCells));
+                power *= 2;
+                distance = 0;
+            }
+        }
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        if (running && timeout > 0 && elapsed.count() >= timeout)
+        {
+            result.reason = TIMEOUT;
+            running = false;
+        }
+    }
+    result.steps = steps;
+    return result;
+}
+
+const char* Supervisor::reasonName(StopReason reason)
+{
+    static const char* const names[] = {"halted", "budget", "timeout", "loop", "error"};
+    return names[reason];
+}
+
+std::string Supervisor::describe(const Result& result)
+{
+    std::string steps = std::to_string(result.steps);
+    switch (result.reason)
+    {
+    case HALTED:
+        return "Halted after " + steps + " steps";
+    case BUDGET:
+        return "Stopped at the budget of " + steps + " steps";
+    case TIMEOUT:
+        return "Timed out after " + steps + " steps";
+    case LOOP:
+        return "Stopped after " + steps + " steps, the machine is back in its state after step "
+            + std::to_string(result.loopStart) + " and loops forever";
+    default:
+        return "Faulted after " + steps + " steps: " + result.error;
+    }
+}
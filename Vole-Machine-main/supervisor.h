@@ -0,0 +1,73 @@
+#pragma once
+
+#include "class_T4.h"
+#include <cstdint>
+#include <string>
+
+/**
+ * @brief Runs a machine on the interpreter until it halts, faults, uses up an instruction budget
+ *        or a wall-clock timeout, or provably loops forever.
+ *
+ *        A loop is proven by meeting the exact same PC, registers and cells twice: the machine is
+ *        deterministic, so it would repeat the steps in between forever. States are only compared
+ *        after backward jumps, against one saved state that is replaced after 1, 2, 4, ... backward
+ *        jumps (Brent's cycle detection), so every loop is found within a few times its length and
+ *        most comparisons stop at the registers. Machines with devices mapped are not checked for
+ *        loops, a device may answer the same load differently each time
+ */
+class Supervisor
+{
+public:
+    enum StopReason : std::uint8_t
+    {
+        HALTED,
+        BUDGET,
+        TIMEOUT,
+        LOOP,
+        FAULT
+    };
+
+    struct Result
+    {
+        StopReason reason;
+        long long steps;
+        std::string error;
+
+        /**
+         * @brief For `LOOP`, the step after which the machine was in the state it returned to
+         */
+        long long loopStart;
+    };
+
+private:
+    static const long long CLOCK_INTERVAL = 1 << 16;
+
+    long long maxSteps;
+    double timeout;
+    bool detectLoops;
+
+public:
+    /**
+     * @param maxSteps The instruction budget
+     * @param timeout The wall-clock limit in seconds, 0 for none. The clock is read every
+     *        `CLOCK_INTERVAL` instructions
+     */
+    Supervisor(long long maxSteps, double timeout = 0, bool detectLoops = true)
+        : maxSteps(maxSteps), timeout(timeout), detectLoops(detectLoops) {}
+
+    /**
+     * @brief Runs `machine` from where it is on `CPU::execute`, so faults are reported in the
+     *        result without an exception being thrown
+     */
+    Result run(Machine& machine) const;
+
+    /**
+     * @brief "halted", "budget", "timeout", "loop" or "error"
+     */
+    static const char* reasonName(StopReason reason);
+
+    /**
+     * @brief How the run ended in one sentence
+     */
+    static std::string describe(const Result& result);
+};
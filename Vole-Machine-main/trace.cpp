@@ -0,0 +1,297 @@
+#include "trace.h"
+#include <cstring>
+#include <stdexcept>
+
+static void put64(std::uint8_t* p, std::uint64_t value)
+{
+    for (int i = 0; i < 8; ++i)
+    {
+        p[i] = static_cast<std::uint8_t>(value >> (8 * i));
+    }
+}
+
+static std::uint64_t get64(const std::uint8_t* p)
+{
+    std::uint64_t value = 0;
+    for (int i = 0; i < 8; ++i)
+    {
+        value |= static_cast<std::uint64_t>(p[i]) << (8 * i);
+    }
+    return value;
+}
+
+static std::uint32_t get32(const std::uint8_t* p)
+{
+    return p[0] | (p[1] << 8) | (p[2] << 16) | (static_cast<std::uint32_t>(p[3]) << 24);
+}
+
+static void put32(std::uint8_t* p, std::uint32_t value)
+{
+    for (int i = 0; i < 4; ++i)
+    {
+        p[i] = static_cast<std::uint8_t>(value >> (8 * i));
+    }
+}
+
+TraceRecorder::TraceRecorder(const std::string& fileName, const Machine& machine, std::uint32_t keyframeInterval)
+    : out(fileName, std::ios::binary), used(0), offset(0), interval(keyframeInterval ? keyframeInterval : 1),
+      steps(0), nextKeyframe(interval), nextPc(machine.cpu.getPC()), finished(false)
+{
+    if (!out.is_open())
+    {
+        throw std::runtime_error("Failed to open " + fileName);
+    }
+    std::uint8_t header[TraceFormat::HEADER_SIZE] = {'V', 'O', 'L', 'T', TraceFormat::VERSION, 0, 0, 0};
+    put32(header + 8, interval);
+    write(header, sizeof(header));
+    keyframe(machine);
+}
+
+TraceRecorder::~TraceRecorder()
+{
+    try
+    {
+        finish();
+    }
+    catch (const std::exception&)
+    {
+    }
+}
+
+void TraceRecorder::flushBuffer()
+{
+    out.write(reinterpret_cast<const char*>(buffer), used);
+    offset += used;
+    used = 0;
+}
+
+void TraceRecorder::write(const std::uint8_t* data, std::size_t length)
+{
+    if (used + length > BUFFER_SIZE)
+    {
+        flushBuffer();
+    }
+    if (length > BUFFER_SIZE)
+    {
+        out.write(reinterpret_cast<const char*>(data), length);
+        offset += length;
+        return;
+    }
+    std::memcpy(buffer + used, data, length);
+    used += length;
+}
+
+void TraceRecorder::keyframe(const Machine& machine)
+{
+    std::vector<std::uint8_t> blob = machine.snapshot();
+    std::uint8_t header[13] = {TraceFormat::KEYFRAME};
+    put64(header + 1, steps);
+    put32(header + 9, static_cast<std::uint32_t>(blob.size()));
+    keyframes.push_back({steps, offset + used});
+    write(header, sizeof(header));
+    write(blob.data(), blob.size());
+}
+
+void TraceRecorder::run(Machine& machine, long long maxSteps)
+{
+    while (steps < maxSteps && !machine.cpu.isHalt)
+    {
+        step(machine);
+    }
+}
+
+void TraceRecorder::finish()
+{
+    if (finished)
+    {
+        return;
+    }
+    finished = true;
+    std::uint64_t endOffset = offset + used;
+    std::vector<std::uint8_t> end(1 + 8 + 4 + 16 * keyframes.size() + 8 + 4);
+    std::uint8_t* p = end.data();
+    *p++ = TraceFormat::END;
+    put64(p, steps);
+    put32(p + 8, static_cast<std::uint32_t>(keyframes.size()));
+    p += 12;
+    for (const auto& entry : keyframes)
+    {
+        put64(p, entry.first);
+        put64(p + 8, entry.second);
+        p += 16;
+    }
+    put64(p, endOffset);
+    std::memcpy(p + 8, "VTND", 4);
+    write(end.data(), end.size());
+    flushBuffer();
+    out.flush();
+    if (!out)
+    {
+        throw std::runtime_error("Failed to write the trace");
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+static std::vector<std::uint8_t> readRange(const std::string& fileName, std::uint64_t offset, std::uint64_t length)
+{
+    std::ifstream fin{fileName, std::ios::binary};
+    std::vector<std::uint8_t> data(length);
+    fin.seekg(static_cast<std::streamoff>(offset));
+    fin.read(reinterpret_cast<char*>(data.data()), length);
+    if (!fin)
+    {
+        throw std::runtime_error(fileName + " is truncated");
+    }
+    return data;
+}
+
+TraceReader::TraceReader(const std::string& fileName) : fileName(fileName), interval(1), steps(0), endOffset(0)
+{
+    std::ifstream fin{fileName, std::ios::binary | std::ios::ate};
+    if (!fin.is_open())
+    {
+        throw std::runtime_error("Failed to open " + fileName);
+    }
+    std::uint64_t size = static_cast<std::uint64_t>(fin.tellg());
+    if (size < TraceFormat::HEADER_SIZE + 12)
+    {
+        throw std::runtime_error(fileName + " is not a Vole trace");
+    }
+    std::vector<std::uint8_t> header = readRange(fileName, 0, TraceFormat::HEADER_SIZE);
+    std::vector<std::uint8_t> trailer = readRange(fileName, size - 12, 12);
+    if (std::memcmp(header.data(), "VOLT", 4) != 0 || header[4] != TraceFormat::VERSION)
+    {
+        throw std::runtime_error(fileName + " is not a Vole trace");
+    }
+    if (std::memcmp(trailer.data() + 8, "VTND", 4) != 0)
+    {
+        throw std::runtime_error(fileName + " has no end record, the recording was cut short");
+    }
+    interval = get32(header.data() + 8);
+    endOffset = get64(trailer.data());
+    if (endOffset + 13 > size)
+    {
+        throw std::runtime_error(fileName + " is truncated");
+    }
+
+    std::vector<std::uint8_t> end = readRange(fileName, endOffset, size - endOffset);
+    std::uint32_t count = get32(end.data() + 9);
+    if (end[0] != TraceFormat::END || end.size() != 13 + 16 * static_cast<std::uint64_t>(count) + 12 || count == 0)
+    {
+        throw std::runtime_error(fileName + " has a malformed end record");
+    }
+    steps = static_cast<long long>(get64(end.data() + 1));
+    for (std::uint32_t i = 0; i < count; ++i)
+    {
+        keyframes.push_back({get64(end.data() + 13 + 16 * i), get64(end.data() + 21 + 16 * i)});
+    }
+}
+
+void TraceReader::seek(long long step, Machine& machine, long long& at, std::vector<std::uint8_t>& chunk, std::size_t& position) const
+{
+    std::size_t index = 0;
+    while (index + 1 < keyframes.size() && static_cast<long long>(keyframes[index + 1].first) <= step)
+    {
+        ++index;
+    }
+    std::uint64_t from = keyframes[index].second;
+    std::uint64_t to = index + 1 < keyframes.size() ? keyframes[index + 1].second : endOffset;
+    chunk = readRange(fileName, from, to - from);
+    if (chunk.size() < 13 || chunk[0] != TraceFormat::KEYFRAME || chunk.size() - 13 < get32(chunk.data() + 9))
+    {
+        throw std::runtime_error(fileName + " has a malformed keyframe");
+    }
+    std::uint32_t length = get32(chunk.data() + 9);
+    machine.restore(chunk.data() + 13, length);
+    at = static_cast<long long>(get64(chunk.data() + 1));
+    position = 13 + length;
+}
+
+void TraceReader::apply(const std::vector<std::uint8_t>& chunk, std::size_t& position, Machine& machine, TraceStep& record)
+{
+    std::uint8_t flags = chunk.at(position);
+    std::uint8_t change = flags & TraceFormat::CHANGE_MASK;
+    std::size_t length = 3 + ((flags & TraceFormat::EXPLICIT_PC) ? 1 : 0) + (change != TraceFormat::NONE ? 1 : 0);
+    if (chunk.size() - position < length)
+    {
+        throw std::runtime_error("Trace record is truncated");
+    }
+    const std::uint8_t* p = chunk.data() + position;
+    record.hi = p[1];
+    record.lo = p[2];
+    record.pc = (flags & TraceFormat::EXPLICIT_PC) ? p[3] : machine.cpu.getPC();
+    record.change = change;
+    record.value = change != TraceFormat::NONE ? p[length - 1] : 0;
+    record.target = 0;
+    position += length;
+
+    Register& reg = machine.cpu.reg;
+    int op = record.hi >> 4;
+    int r = record.hi & 0xF;
+    int next = record.pc + 2;
+    if (change == TraceFormat::REGISTER)
+    {
+        record.target = op == 0x4 ? (record.lo & 0xF) : r;
+        reg.setValue(record.target, record.value);
+    }
+    else if (change == TraceFormat::CELL)
+    {
+        record.target = record.lo;
+        machine.memory.setCell(record.target, record.value);
+    }
+    if ((op == 0xB && reg.getValue(r) == reg.getValue(0)) || (op == 0xD && reg.getValue(0) < reg.getValue(r)))
+    {
+        next = record.lo;
+    }
+    machine.cpu.setPC(next);
+    machine.cpu.isHalt = op == 0xC;
+}
+
+Machine TraceReader::stateAt(long long step) const
+{
+    if (step < 0 || step > steps)
+    {
+        throw std::out_of_range("Step is outside the trace");
+    }
+    Machine machine;
+    std::vector<std::uint8_t> chunk;
+    std::size_t position = 0;
+    long long at = 0;
+    seek(step, machine, at, chunk, position);
+    TraceStep record;
+    for (; at < step; ++at)
+    {
+        apply(chunk, position, machine, record);
+    }
+    return machine;
+}
+
+std::vector<TraceStep> TraceReader::stepsFrom(long long from, long long length) const
+{
+    std::vector<TraceStep> records;
+    if (from < 0 || from >= steps || length <= 0)
+    {
+        return records;
+    }
+    Machine machine;
+    std::vector<std::uint8_t> chunk;
+    std::size_t position = 0;
+    long long at = 0;
+    seek(from, machine, at, chunk, position);
+    TraceStep record;
+    for (; at < steps && at < from + length; ++at)
+    {
+        if (position == chunk.size())
+        {
+            seek(at, machine, at, chunk, position);
+        }
+        record.step = at;
+        apply(chunk, position, machine, record);
+        if (at >= from)
+        {
+            records.push_back(record);
+        }
+    }
+    return records;
+}
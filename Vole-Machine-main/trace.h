@@ -0,0 +1,188 @@
+#pragma once
+
+#include "class_T4.h"
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+
+/**
+ * @brief One executed instruction as stored in a trace
+ */
+struct TraceStep
+{
+    long long step;
+    int pc;
+    std::uint8_t hi;
+    std::uint8_t lo;
+
+    /**
+     * @brief `NONE`, or whether `value` went into register `target` or into cell `target`
+     */
+    std::uint8_t change;
+    int target;
+    std::uint8_t value;
+};
+
+/**
+ * @brief The trace file layout shared by the recorder and the reader. All numbers are little endian.
+ *
+ *        Header:   "VOLT", version, 0, 0, 0, u32 keyframe interval
+ *        Step:     flags, the two instruction bytes, the PC if it is not where the previous step
+ *                  left it, then the byte written if the instruction writes a register or cell
+ *        Keyframe: `KEYFRAME`, u64 step, u32 length, a `Machine::snapshot` blob
+ *        End:      `END`, u64 steps, u32 keyframe count, per keyframe u64 step and u64 file offset,
+ *                  then u64 offset of the end record and "VTND"
+ */
+class TraceFormat
+{
+public:
+    static const std::uint8_t VERSION = 1;
+    static const std::size_t HEADER_SIZE = 12;
+    static const std::uint8_t NONE = 0;
+    static const std::uint8_t REGISTER = 1;
+    static const std::uint8_t CELL = 2;
+    static const std::uint8_t CHANGE_MASK = 3;
+    static const std::uint8_t EXPLICIT_PC = 4;
+    static const std::uint8_t KEYFRAME = 0xFF;
+    static const std::uint8_t END = 0xFE;
+
+    /**
+     * @brief What each opcode writes: the register in its R nibble (T for `4`), or the cell XY for `3`
+     */
+    static constexpr std::uint8_t CHANGES[16] = {
+        NONE, REGISTER, REGISTER, CELL, REGISTER, REGISTER, REGISTER, REGISTER,
+        REGISTER, REGISTER, REGISTER, NONE, NONE, NONE, NONE, NONE,
+    };
+};
+
+/**
+ * @brief Runs a machine on the interpreter and streams every executed instruction to a trace file
+ */
+class TraceRecorder
+{
+private:
+    static const std::size_t BUFFER_SIZE = 1 << 16;
+
+    std::ofstream out;
+    std::uint8_t buffer[BUFFER_SIZE];
+    std::size_t used;
+    std::uint64_t offset;
+    std::uint32_t interval;
+    long long steps;
+    long long nextKeyframe;
+    int nextPc;
+    bool finished;
+    std::vector<std::pair<std::uint64_t, std::uint64_t>> keyframes;
+
+    void flushBuffer();
+    void write(const std::uint8_t* data, std::size_t length);
+    void keyframe(const Machine& machine);
+
+public:
+    /**
+     * @brief Opens `fileName` and records `machine` as it is now as the first keyframe
+     * @param keyframeInterval The number of steps between two full snapshots, which bounds the
+     *        work of seeking to a step
+     */
+    TraceRecorder(const std::string& fileName, const Machine& machine, std::uint32_t keyframeInterval = 1 << 16);
+    ~TraceRecorder();
+    TraceRecorder(const TraceRecorder&) = delete;
+    TraceRecorder& operator=(const TraceRecorder&) = delete;
+
+    /**
+     * @brief Runs one instruction of `machine` and records it, a faulting instruction is not recorded.
+     *        The machine must not be changed between steps other than through the recorder
+     */
+    void step(Machine& machine)
+    {
+        int pc = machine.cpu.programCounter;
+        if (finished || pc < 0 || pc > 253)
+        {
+            machine.cpu.runInstruction(machine.memory);
+            return;
+        }
+        std::uint8_t* cells = machine.memory.cells;
+        std::uint8_t* registers = machine.cpu.reg.registers;
+        std::uint8_t hi = cells[pc];
+        std::uint8_t lo = cells[pc + 1];
+        int op = hi >> 4;
+        std::uint8_t change = TraceFormat::CHANGES[op];
+        std::uint8_t* target = change == TraceFormat::CELL ? cells + lo : registers + ((op == 0x4 ? lo : hi) & 0xF);
+
+        machine.cpu.runInstruction(machine.memory);
+
+        if (used + 5 > BUFFER_SIZE)
+        {
+            flushBuffer();
+        }
+        std::uint8_t* p = buffer + used;
+        bool explicitPc = pc != nextPc;
+        p[0] = change | (explicitPc ? TraceFormat::EXPLICIT_PC : 0);
+        p[1] = hi;
+        p[2] = lo;
+        p[3] = static_cast<std::uint8_t>(pc);
+        p[3 + explicitPc] = *target;
+        used += 3 + explicitPc + (change != TraceFormat::NONE);
+        nextPc = machine.cpu.programCounter;
+        if (++steps == nextKeyframe)
+        {
+            nextKeyframe += interval;
+            keyframe(machine);
+        }
+    }
+
+    /**
+     * @brief Steps until the machine halts or `maxSteps` instructions were recorded
+     */
+    void run(Machine& machine, long long maxSteps);
+
+    /**
+     * @brief Writes the end record with the keyframe index, further steps are not recorded
+     */
+    void finish();
+
+    long long count() const { return steps; }
+};
+
+/**
+ * @brief Reads a trace and rebuilds the machine state at any step
+ */
+class TraceReader
+{
+private:
+    std::string fileName;
+    std::uint32_t interval;
+    long long steps;
+    std::uint64_t endOffset;
+    std::vector<std::pair<std::uint64_t, std::uint64_t>> keyframes;
+
+    /**
+     * @brief Reads the records from the last keyframe at or before `step` up to the next keyframe
+     *        and restores that keyframe into `machine`
+     * @param at Set to the step of the keyframe
+     * @param position Set to the offset of the first step record in `chunk`
+     */
+    void seek(long long step, Machine& machine, long long& at, std::vector<std::uint8_t>& chunk, std::size_t& position) const;
+
+    /**
+     * @brief Decodes the step record at `position` of `chunk`, applies it to `machine` and moves past it
+     */
+    static void apply(const std::vector<std::uint8_t>& chunk, std::size_t& position, Machine& machine, TraceStep& record);
+
+public:
+    explicit TraceReader(const std::string& fileName);
+
+    long long count() const { return steps; }
+    std::uint32_t keyframeInterval() const { return interval; }
+
+    /**
+     * @brief The machine as it was before the instruction numbered `step` ran, `count()` gives the final state
+     */
+    Machine stateAt(long long step) const;
+
+    /**
+     * @brief Up to `length` records starting with the instruction numbered `from`
+     */
+    std::vector<TraceStep> stepsFrom(long long from, long long length) const;
+};
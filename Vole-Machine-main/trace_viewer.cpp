@@ -0,0 +1,59 @@
+#include "trace.h"
+#include <exception>
+#include <iostream>
+#include <string>
+
+using namespace std;
+
+static void printStep(const TraceStep& record)
+{
+    cout << record.step << "  " << ALU::DecToHex(record.pc) << "  "
+         << ALU::DecToHex(record.hi) << ALU::DecToHex(record.lo);
+    if (record.change == TraceFormat::REGISTER)
+    {
+        cout << "  R" << "0123456789ABCDEF"[record.target] << " = " << ALU::DecToHex(record.value);
+    }
+    else if (record.change == TraceFormat::CELL)
+    {
+        cout << "  [" << ALU::DecToHex(record.target) << "] = " << ALU::DecToHex(record.value);
+    }
+    cout << '\n';
+}
+
+int main(int argc, char* argv[]){
+    if (argc < 2)
+    {
+        cerr << "Usage: trace_viewer trace.vtr              summary\n"
+             << "       trace_viewer trace.vtr step         state before the step, the step count gives the final state\n"
+             << "       trace_viewer trace.vtr --list from [count]\n";
+        return 2;
+    }
+    try
+    {
+        TraceReader reader(argv[1]);
+        if (argc == 2)
+        {
+            cout << "Steps: " << reader.count() << '\n' << "Keyframe interval: " << reader.keyframeInterval() << '\n';
+            return 0;
+        }
+        if (string(argv[2]) == "--list")
+        {
+            long long from = argc > 3 ? stoll(argv[3]) : 0;
+            long long count = argc > 4 ? stoll(argv[4]) : 20;
+            for (const TraceStep& record : reader.stepsFrom(from, count))
+            {
+                printStep(record);
+            }
+            return 0;
+        }
+        Machine machine = reader.stateAt(stoll(argv[2]));
+        cout << "PC: " << ALU::DecToHex(machine.cpu.getPC()) << (machine.cpu.isHalt ? "  (halted)" : "") << "\n\n";
+        machine.printState();
+    }
+    catch (const exception& e)
+    {
+        cerr << e.what() << '\n';
+        return 1;
+    }
+    return 0;
+}